@@ -0,0 +1,641 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "arff.h"
+#include "matrix.h"
+#include "error.h"
+#include "parallel.h"
+#include "mlbfile.h"
+#include "textscan.h"
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef WIN32
+# include <process.h>
+# define getpid _getpid
+#else // WIN32
+# include <unistd.h>
+#endif // else WIN32
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+// The number of bytes read from the file at a time (per worker thread in the data section)
+#define ARFF_BLOCK_SIZE (4 * 1024 * 1024)
+
+// The smallest piece of the data section worth giving to its own thread
+#define ARFF_MIN_CHUNK_SIZE (64 * 1024)
+
+// The size of the pieces that are hashed separately to make a cache key
+#define ARFF_HASH_CHUNK_SIZE (4 * 1024 * 1024)
+
+#define ARFF_CACHE_MAGIC "ARFFCACH"
+#define ARFF_CACHE_ALIGNMENT 64
+
+typedef unsigned long long int uint64;
+
+namespace
+{
+	bool isDelimiter(char c)
+	{
+		return c == ',' || c == ' ' || c == '\t';
+	}
+
+	// Returns true if the line starts with the specified keyword (ignoring case)
+	bool startsWith(const char* begin, const char* end, const char* keyword)
+	{
+		size_t len = strlen(keyword);
+		if((size_t)(end - begin) < len)
+			return false;
+		for(size_t i = 0; i < len; i++)
+		{
+			if(tolower(begin[i]) != keyword[i])
+				return false;
+		}
+		return true;
+	}
+
+	// Returns the first character of the first line in [p, end) that holds
+	// data (not a blank line or a comment), or end if there is none
+	const char* firstDataLine(const char* p, const char* end)
+	{
+		while(p != end)
+		{
+			const char* eol = endOfLine(p, end);
+			const char* lineBegin = skipSpace(p, eol);
+			if(lineBegin != eol && *lineBegin != '%' && *lineBegin != '\r')
+				return lineBegin;
+			p = eol == end ? end : eol + 1;
+		}
+		return end;
+	}
+
+	// A fast (but not cryptographic) 64-bit hash of some bytes
+	uint64 hashBytes(const char* p, size_t n)
+	{
+		uint64 h = 0x9e3779b97f4a7c15ULL ^ n;
+		size_t words = n / sizeof(uint64);
+		for(size_t i = 0; i < words; i++)
+		{
+			uint64 w;
+			memcpy(&w, p + i * sizeof(uint64), sizeof(uint64));
+			h ^= w * 0x87c37b91114253d5ULL;
+			h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937fULL;
+		}
+		for(size_t i = words * sizeof(uint64); i < n; i++)
+			h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	string fullPath(const string& filename)
+	{
+#ifdef WIN32
+		char* p = _fullpath(NULL, filename.c_str(), 0);
+#else // WIN32
+		char* p = realpath(filename.c_str(), NULL);
+#endif // else WIN32
+		if(!p)
+			return filename;
+		string path(p);
+		free(p);
+		return path;
+	}
+
+	size_t paddingFor(size_t pos)
+	{
+		return (ARFF_CACHE_ALIGNMENT - pos % ARFF_CACHE_ALIGNMENT) % ARFF_CACHE_ALIGNMENT;
+	}
+}
+
+ArffParser::ArffParser(Matrix& matrix, Matrix* pSchema, Matrix::Layout layout)
+: m_matrix(matrix), m_pSchema(pSchema), m_layout(layout), m_lineNum(0), m_inData(false), m_formatKnown(false), m_sparse(false), m_keep(0), m_atEnd(false)
+{
+}
+
+void ArffParser::load(const string& filename)
+{
+	open(filename);
+	while(readBlock())
+	{
+	}
+}
+
+void ArffParser::open(const string& filename)
+{
+	m_pFile.reset(new InputFile(filename));
+	m_matrix.setSize(0, 0);
+	m_lineNum = 0;
+	m_inData = false;
+	m_formatKnown = false;
+	m_sparse = false;
+	m_keep = 0;
+	m_atEnd = false;
+
+	// Read the header. Whatever follows @data is kept for readBlock.
+	m_buf.resize(ARFF_BLOCK_SIZE);
+	while(!m_inData && !m_atEnd)
+	{
+		const char* end = fill();
+		keep(parseHeader(&m_buf[0], end, m_atEnd), end);
+	}
+	if(!m_inData)
+		beginData(); // there is no data section
+}
+
+bool ArffParser::readBlock()
+{
+	if(m_atEnd && m_keep == 0)
+		return false;
+	const char* end = &m_buf[0] + m_keep;
+	if(!m_atEnd)
+	{
+		if(m_keep < m_buf.size() && m_buf.size() < ARFF_BLOCK_SIZE * workerCount())
+			m_buf.resize(ARFF_BLOCK_SIZE * workerCount()); // a block for each worker
+		end = fill();
+	}
+	keep(parseData(&m_buf[0], end, m_atEnd), end);
+	return true;
+}
+
+const char* ArffParser::fill()
+{
+	if(m_keep == m_buf.size())
+		m_buf.resize(m_buf.size() * 2); // a very long line
+	size_t want = m_buf.size() - m_keep;
+	size_t got = m_pFile->read(&m_buf[m_keep], want);
+	m_atEnd = got < want;
+	return &m_buf[0] + m_keep + got;
+}
+
+void ArffParser::keep(const char* p, const char* end)
+{
+	m_keep = end - p;
+	memmove(&m_buf[0], p, m_keep);
+}
+
+const char* ArffParser::parseHeader(const char* p, const char* end, bool atEnd)
+{
+	while(p != end && !m_inData)
+	{
+		const char* eol = endOfLine(p, end);
+		if(eol == end && !atEnd)
+			break;
+		m_lineNum++;
+		const char* lineEnd = eol;
+		if(lineEnd != p && lineEnd[-1] == '\r')
+			lineEnd--;
+		const char* lineBegin = skipSpace(p, lineEnd);
+		if(lineBegin != lineEnd && *lineBegin != '%')
+			parseHeaderLine(lineBegin, lineEnd);
+		p = eol == end ? end : eol + 1;
+	}
+	return p;
+}
+
+void ArffParser::parseHeaderLine(const char* begin, const char* end)
+{
+	end = trimSpace(begin, end);
+	if(startsWith(begin, end, "@relation"))
+	{
+		const char* p = skipSpace(begin + 9, end);
+		m_matrix.m_filename.assign(p, end);
+	}
+	else if(startsWith(begin, end, "@attribute"))
+	{
+		// Parse the attribute name
+		const char* p = skipSpace(begin + 10, end);
+		const char* nameEnd = p;
+		while(nameEnd != end && !isSpace(*nameEnd))
+			nameEnd++;
+		boost::shared_ptr<Matrix::Attribute> pAttr(new Matrix::Attribute());
+		pAttr->name.assign(p, nameEnd);
+		m_matrix.ownSchema().push_back(pAttr);
+
+		// If the attribute is nominal, parse its values. (Anything else is continuous.)
+		p = skipSpace(nameEnd, end);
+		if(p != end && *p == '{')
+		{
+			const char* close = end;
+			while(close != p && close[-1] != '}')
+				close--;
+			if(close == p)
+				ThrowError("Expected a '}' on line ", to_str(m_lineNum));
+			close--;
+			Dictionary& strToEnum = pAttr->strToEnum;
+			vector<string>& enumToStr = pAttr->enumToStr;
+			p++;
+			while(p < close)
+			{
+				const char* valBegin = skipSpace(p, close);
+				const char* valEnd = valBegin;
+				while(valEnd != close && *valEnd != ',')
+					valEnd++;
+				p = valEnd + 1;
+				string_view val(valBegin, trimSpace(valBegin, valEnd) - valBegin);
+				if(val.empty())
+					continue;
+				strToEnum.set(val, enumToStr.size());
+				enumToStr.push_back(string(val));
+			}
+		}
+	}
+	else if(startsWith(begin, end, "@data"))
+		beginData();
+}
+
+void ArffParser::beginData()
+{
+	m_inData = true;
+	if(m_pSchema)
+	{
+		// Use the columns and dictionaries of the schema instead of the header
+		m_pSchema->checkCompatibility(m_matrix);
+		m_matrix.m_pSchema = m_pSchema->m_pSchema;
+	}
+	size_t cols = m_matrix.cols();
+	m_matrix.m_pData.reset(new MatrixStorage());
+	m_matrix.m_rows = 0;
+	m_matrix.m_stride = cols;
+
+	// Look nominal values up in the dictionaries of the matrix. (The
+	// parser keeps the meta-data that holds them, in case the matrix is
+	// given other meta-data while it is being read.)
+	m_pDictionaries = m_matrix.m_pSchema;
+	m_dictionaries.resize(cols);
+	for(size_t i = 0; i < cols; i++)
+		m_dictionaries[i] = &m_matrix.attribute(i).strToEnum;
+}
+
+const char* ArffParser::parseData(const char* begin, const char* end, bool atEnd)
+{
+	// Only take complete lines, unless this is the end of the file
+	const char* last = end;
+	if(!atEnd)
+	{
+		while(last != begin && last[-1] != '\n')
+			last--;
+		if(last == begin)
+			return begin;
+	}
+
+	// The first row decides whether the matrix is sparse
+	if(!m_formatKnown)
+	{
+		const char* first = firstDataLine(begin, last);
+		if(first == last)
+			return last; // nothing but comments so far
+		m_formatKnown = true;
+		m_sparse = *first == '{';
+		if(m_sparse)
+			m_matrix.m_pSparse.reset(new SparseStorage());
+		else if(m_layout == Matrix::SPILL)
+			m_matrix.m_pSpill.reset(new SpillStorage(m_matrix.cols()));
+		else if(m_layout != Matrix::DENSE)
+		{
+			vector<size_t> valueCounts(m_matrix.cols());
+			for(size_t i = 0; i < valueCounts.size(); i++)
+				valueCounts[i] = m_matrix.valueCount(i);
+			m_matrix.m_pColumns.reset(new ColumnStorage(valueCounts, m_layout == Matrix::COMPACT_FLOAT));
+		}
+	}
+
+	if(m_matrix.m_rows == 0)
+		m_missing.assign(m_matrix.cols(), 0);
+
+	// Parse the lines concurrently. The lookup tables are only read, so
+	// every chunk sees the same nominal dictionaries.
+	Chunk blank;
+	blank.missing.assign(m_matrix.cols(), 0);
+	vector<double>& data = m_matrix.m_pData->elements();
+	parseLines(begin, last, ARFF_MIN_CHUNK_SIZE, '%', blank, m_lineNum,
+		[this](const char* lineBegin, const char* lineEnd, Chunk& chunk) { return parseLine(lineBegin, lineEnd, chunk); },
+		[&](Chunk& chunk)
+		{
+			if(m_sparse)
+			{
+				SparseStorage& sparse = *m_matrix.m_pSparse;
+				size_t base = sparse.cols.size();
+				sparse.cols.insert(sparse.cols.end(), chunk.cols.begin(), chunk.cols.end());
+				sparse.values.insert(sparse.values.end(), chunk.data.begin(), chunk.data.end());
+				for(size_t j = 0; j < chunk.rowEnds.size(); j++)
+					sparse.rowStart.push_back(base + chunk.rowEnds[j]);
+			}
+			else if(m_matrix.m_pColumns)
+				m_matrix.m_pColumns->append(chunk.data.data(), chunk.rows);
+			else if(m_matrix.m_pSpill)
+				m_matrix.m_pSpill->append(chunk.data.data(), chunk.rows);
+			else
+				data.insert(data.end(), chunk.data.begin(), chunk.data.end());
+			m_matrix.m_rows += chunk.rows;
+			for(size_t j = 0; j < m_missing.size(); j++)
+				m_missing[j] += chunk.missing[j];
+		});
+
+	// Note which columns have no missing values so far
+	m_matrix.forgetColumnInfo();
+	for(size_t j = 0; j < m_missing.size(); j++)
+	{
+		if(m_missing[j] == 0)
+			m_matrix.setComplete(j);
+	}
+	return last;
+}
+
+bool ArffParser::parseLine(const char* begin, const char* end, Chunk& chunk) const
+{
+	size_t cols = m_dictionaries.size();
+	if(m_sparse)
+	{
+		// Keep the elements that are not zero
+		size_t first = chunk.data.size();
+		if(*begin == '{')
+		{
+			if(!parseSparseLine(begin, end, chunk.cols, chunk.data, chunk.error))
+				return false;
+		}
+		else
+		{
+			chunk.dense.resize(cols);
+			if(!parseDataLine(begin, end, chunk.dense.data(), chunk.error))
+				return false;
+			for(size_t i = 0; i < cols; i++)
+			{
+				if(chunk.dense[i] != 0.0)
+				{
+					chunk.cols.push_back(i);
+					chunk.data.push_back(chunk.dense[i]);
+				}
+			}
+		}
+		chunk.rowEnds.push_back(chunk.cols.size());
+
+		// Count its missing values
+		for(size_t i = first; i < chunk.data.size(); i++)
+		{
+			if(chunk.data[i] == UNKNOWN_VALUE)
+				chunk.missing[chunk.cols[i]]++;
+		}
+	}
+	else
+	{
+		size_t pos = chunk.data.size();
+		chunk.data.resize(pos + cols); // (zeros)
+		double* pRow = chunk.data.data() + pos;
+		if(*begin == '{')
+		{
+			chunk.sparseCols.clear();
+			chunk.sparseValues.clear();
+			if(!parseSparseLine(begin, end, chunk.sparseCols, chunk.sparseValues, chunk.error))
+				return false;
+			for(size_t i = 0; i < chunk.sparseCols.size(); i++)
+				pRow[chunk.sparseCols[i]] = chunk.sparseValues[i];
+		}
+		else if(!parseDataLine(begin, end, pRow, chunk.error))
+			return false;
+
+		// Count its missing values
+		for(size_t i = 0; i < cols; i++)
+		{
+			if(pRow[i] == UNKNOWN_VALUE)
+				chunk.missing[i]++;
+		}
+	}
+	return true;
+}
+
+bool ArffParser::parseDataLine(const char* p, const char* end, double* pOut, string& error) const
+{
+	size_t cols = m_dictionaries.size();
+	for(size_t i = 0; i < cols; i++)
+	{
+		if(p == end)
+		{
+			error = "Expected more elements";
+			return false;
+		}
+		const char* tok = p;
+		while(p != end && !isDelimiter(*p))
+			p++;
+		if(!parseValue(i, tok, p, pOut[i], error))
+			return false;
+
+		// Skip the delimiters
+		while(p != end && isDelimiter(*p))
+			p++;
+	}
+	return true;
+}
+
+bool ArffParser::parseSparseLine(const char* p, const char* end, vector<size_t>& cols, vector<double>& values, string& error) const
+{
+	size_t count = m_dictionaries.size();
+	size_t first = 0; // the smallest column that may come next
+	p++; // skip the '{'
+	while(true)
+	{
+		p = skipSpace(p, end);
+		if(p == end)
+		{
+			error = "Expected a '}'";
+			return false;
+		}
+		if(*p == '}')
+			return true;
+
+		// Parse the column
+		const char* tok = p;
+		while(p != end && !isDelimiter(*p) && *p != '}')
+			p++;
+		size_t col;
+		std::from_chars_result res = std::from_chars(tok, p, col);
+		if(res.ec != std::errc() || res.ptr != p)
+		{
+			error = "Expected a column number, found \"" + string(tok, p) + "\"";
+			return false;
+		}
+		if(col >= count)
+		{
+			error = "Column " + to_str(col) + " is out of range";
+			return false;
+		}
+		if(col < first)
+		{
+			error = "Expected the columns of a sparse row to be in increasing order";
+			return false;
+		}
+		first = col + 1;
+
+		// Parse the value
+		p = skipSpace(p, end);
+		tok = p;
+		while(p != end && !isDelimiter(*p) && *p != '}')
+			p++;
+		if(tok == p)
+		{
+			error = "Expected a value for column " + to_str(col);
+			return false;
+		}
+		double value;
+		if(!parseValue(col, tok, p, value, error))
+			return false;
+		if(value != 0.0)
+		{
+			cols.push_back(col);
+			values.push_back(value);
+		}
+
+		// Skip the delimiter
+		p = skipSpace(p, end);
+		if(p != end && *p == ',')
+			p++;
+	}
+}
+
+bool ArffParser::parseValue(size_t col, const char* begin, const char* end, double& value, string& error) const
+{
+	if(end - begin == 1 && *begin == '?')
+		value = UNKNOWN_VALUE;
+	else if(m_dictionaries[col]->empty())
+	{
+		if(!parseNumber(begin, end, value))
+		{
+			error = "Expected a number, found \"" + string(begin, end) + "\"";
+			return false;
+		}
+	}
+	else
+	{
+		size_t e = m_dictionaries[col]->find(string_view(begin, end - begin));
+		if(e == Dictionary::NOT_FOUND)
+		{
+			error = "Unrecognized value \"" + string(begin, end) + "\" for attribute " + m_matrix.attribute(col).name;
+			return false;
+		}
+		value = (double)e;
+	}
+	return true;
+}
+
+
+ArffReader::ArffReader(const string& filename, Matrix& schema)
+: m_parser(m_batch, &schema)
+{
+	m_parser.open(filename);
+}
+
+bool ArffReader::next()
+{
+	// Start a new batch, without disturbing any views of the previous one
+	if(m_batch.m_pData.unique())
+		m_batch.m_pData->elements().clear();
+	else
+		m_batch.m_pData.reset(new MatrixStorage());
+	if(m_batch.m_pSparse)
+	{
+		if(m_batch.m_pSparse.unique())
+			m_batch.m_pSparse->clear();
+		else
+			m_batch.m_pSparse.reset(new SparseStorage());
+	}
+	m_batch.m_rows = 0;
+
+	// Skip blocks that hold no rows (such as comments)
+	while(m_parser.readBlock())
+	{
+		if(m_batch.rows() > 0)
+			return true;
+	}
+	return false;
+}
+
+string ArffCache::makeKey(const string& filename)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0)
+		ThrowError("failed to open the file: ", filename);
+
+	// Hash the contents in fixed-size pieces (concurrently), then hash those hashes
+	MappedFile file(filename);
+	size_t pieces = (file.size() + ARFF_HASH_CHUNK_SIZE - 1) / ARFF_HASH_CHUNK_SIZE;
+	vector<uint64> hashes(pieces);
+	parallelFor(pieces, [&](size_t i)
+	{
+		size_t begin = i * ARFF_HASH_CHUNK_SIZE;
+		hashes[i] = hashBytes(file.data() + begin, std::min((size_t)ARFF_HASH_CHUNK_SIZE, file.size() - begin));
+	});
+	uint64 hash = hashBytes((const char*)hashes.data(), pieces * sizeof(uint64));
+
+	std::ostringstream os;
+	os << "path=" << fullPath(filename) << "\nsize=" << file.size() << "\nmtime=" << (long long)st.st_mtime << "\nhash=" << std::hex << hash;
+	return os.str();
+}
+
+string ArffCache::cacheName(const string& filename)
+{
+	return filename + ".cache";
+}
+
+// A cache file starts with ARFF_CACHE_MAGIC, then the length of the key
+// (a uint64) and the key, padded to a multiple of ARFF_CACHE_ALIGNMENT
+// bytes. After that comes the matrix as a .mlb image (see mlbfile.h).
+bool ArffCache::load(Matrix& m, const string& cacheFile, const string& key)
+{
+	struct stat st;
+	if(stat(cacheFile.c_str(), &st) != 0)
+		return false; // no cache yet
+	boost::shared_ptr<MappedFile> pFile(new MappedFile(cacheFile));
+	const char* p = pFile->data();
+	size_t size = pFile->size();
+	size_t keyEnd = 8 + sizeof(uint64) + key.size();
+	if(size < keyEnd || memcmp(p, ARFF_CACHE_MAGIC, 8) != 0)
+		return false;
+	uint64 keyLen;
+	memcpy(&keyLen, p + 8, sizeof(uint64));
+	if(keyLen != key.size() || memcmp(p + 8 + sizeof(uint64), key.data(), key.size()) != 0)
+		return false; // the file has changed (or moved)
+	MlbFile::load(m, pFile, keyEnd + paddingFor(keyEnd), cacheFile);
+	return true;
+}
+
+void ArffCache::save(Matrix& m, const string& cacheFile, const string& key)
+{
+	// Write a temporary file that no other process is using, then rename it into place
+	string tempFile = cacheFile + ".tmp" + to_str(getpid());
+	{
+		std::ofstream out(tempFile.c_str(), std::ios::binary);
+		if(!out)
+			ThrowError("failed to create the file: ", tempFile);
+		out.write(ARFF_CACHE_MAGIC, 8);
+		uint64 keyLen = key.size();
+		out.write((const char*)&keyLen, sizeof(uint64));
+		out.write(key.data(), key.size());
+		size_t keyEnd = 8 + sizeof(uint64) + key.size();
+		for(size_t i = paddingFor(keyEnd); i > 0; i--)
+			out.put(0);
+		MlbFile::write(m, out);
+		if(!out.flush())
+		{
+			out.close();
+			remove(tempFile.c_str());
+			ThrowError("failed to write the file: ", tempFile);
+		}
+	}
+#ifdef WIN32
+	remove(cacheFile.c_str()); // (rename will not replace a file here)
+#endif // WIN32
+	if(rename(tempFile.c_str(), cacheFile.c_str()) != 0)
+	{
+		remove(tempFile.c_str());
+		ThrowError("failed to rename ", tempFile, " to ", cacheFile);
+	}
+}
@@ -0,0 +1,186 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef ARFF_H
+#define ARFF_H
+
+#include "matrix.h"
+#include "inputfile.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Loads an ARFF file into a Matrix in a single pass. The file is read in
+// large blocks and each line is tokenized in place, so no strings are made
+// for the data section: numbers are converted with std::from_chars and
+// nominal values are looked up by string_view in the dictionaries of the
+// matrix (see Dictionary). Once the header has been
+// read, each block of the data section is split into newline-aligned
+// chunks that are parsed concurrently and then appended in order.
+//
+// The file may be compressed with gzip or zstd (see InputFile), in which
+// case it is decompressed by another thread while the blocks are parsed.
+//
+// Rows may also be given in the sparse form "{3 1.0, 17 2.5}", which lists
+// only the elements that are not zero. If the first row of the file is
+// sparse, the matrix keeps its elements in sparse form (see
+// Matrix::sparseRow); otherwise sparse rows are expanded. A dense matrix
+// may also be given a compact layout (see Matrix::compact), in which case
+// each block is converted as it is parsed, so the whole matrix is never
+// held as doubles, or be spilled to a file (see Matrix::spill) as it is
+// parsed, so the whole matrix is never held in memory. The parser also notes which columns have no missing
+// values (see Matrix::validity), so that nothing has to look for them.
+class ArffParser
+{
+private:
+	// The rows parsed from one newline-aligned piece of the data section
+	struct Chunk : public LineChunk
+	{
+		std::vector<double> data; // the elements of the rows (or only those that are not zero, if the matrix is sparse)
+		std::vector<size_t> cols; // the column of each element in data (only if the matrix is sparse)
+		std::vector<size_t> rowEnds; // the end of each row in data (only if the matrix is sparse)
+		std::vector<size_t> missing; // the number of elements of each column that are UNKNOWN_VALUE
+		std::vector<double> dense; // a dense line, when the matrix is sparse
+		std::vector<size_t> sparseCols; // the columns of a sparse line, when the matrix is dense
+		std::vector<double> sparseValues; // the values of a sparse line, when the matrix is dense
+	};
+
+	Matrix& m_matrix;
+	Matrix* m_pSchema;
+	Matrix::Layout m_layout;
+	size_t m_lineNum;
+	bool m_inData;
+	bool m_formatKnown; // true once the first row has been seen
+	bool m_sparse; // true if the matrix keeps its elements in sparse form
+	std::vector<const Dictionary*> m_dictionaries; // value to enumeration, for each column (empty if it is continuous)
+	boost::shared_ptr<Matrix::Schema> m_pDictionaries; // the meta-data that holds the dictionaries
+	std::vector<size_t> m_missing; // the number of elements of each column of the matrix that are UNKNOWN_VALUE
+	std::unique_ptr<InputFile> m_pFile;
+	std::vector<char> m_buf;
+	size_t m_keep; // the number of bytes at the start of m_buf that have been read but not parsed
+	bool m_atEnd;
+
+public:
+	// Reads into matrix. If pSchema is non-NULL, the file must have the same
+	// columns as it, and nominal values are looked up in its dictionaries
+	// (rather than in the ones in the header of the file). The elements of
+	// a dense file are kept in the specified layout.
+	ArffParser(Matrix& matrix, Matrix* pSchema = NULL, Matrix::Layout layout = Matrix::DENSE);
+
+	// Reads the specified file into the matrix. (Anything that was already
+	// in the matrix is replaced.)
+	void load(const std::string& filename);
+
+	// Opens the specified file and reads its header into the matrix, which
+	// is left with no rows.
+	void open(const std::string& filename);
+
+	// Parses the next block of the data section and appends its rows to the
+	// matrix. Returns false if there was nothing left to read.
+	bool readBlock();
+
+private:
+	// Reads more of the file into m_buf, after the bytes that are kept.
+	// Returns a pointer just past the last byte read.
+	const char* fill();
+
+	// Keeps the bytes in [p, end) for the next fill
+	void keep(const char* p, const char* end);
+
+	// Parses the header lines in [begin, end) until @data is found. A partial
+	// line at the end is left for later unless atEnd is true. Returns a
+	// pointer to the first character that was not consumed.
+	const char* parseHeader(const char* begin, const char* end, bool atEnd);
+
+	// Parses a line that comes before @data
+	void parseHeaderLine(const char* begin, const char* end);
+
+	// Prepares the matrix and the nominal lookup tables for the data section
+	// (after checking the header against the schema, if there is one)
+	void beginData();
+
+	// Parses the data lines in [begin, end) and appends them to the matrix.
+	// A partial line at the end is left for later unless atEnd is true.
+	// Returns a pointer to the first character that was not consumed.
+	const char* parseData(const char* begin, const char* end, bool atEnd);
+
+	// Parses a line of the data section (dense or sparse) into the chunk.
+	// Returns false, and describes the problem in chunk.error, if it fails.
+	// (This is called concurrently for different chunks.)
+	bool parseLine(const char* begin, const char* end, Chunk& chunk) const;
+
+	// Parses a line of the data section, writing one value per column to
+	// pOut. Returns false, and describes the problem in error, if it fails.
+	bool parseDataLine(const char* begin, const char* end, double* pOut, std::string& error) const;
+
+	// Parses a sparse line of the data section (one that starts with '{'),
+	// adding the column and value of each element that is not zero to cols
+	// and values. Returns false, and describes the problem in error, if it fails.
+	bool parseSparseLine(const char* begin, const char* end, std::vector<size_t>& cols, std::vector<double>& values, std::string& error) const;
+
+	// Parses one value for the specified column
+	bool parseValue(size_t col, const char* begin, const char* end, double& value, std::string& error) const;
+};
+
+
+// An opt-in cache of parsed ARFF files. The parsed matrix is kept in a
+// sidecar file next to the ARFF file (with ".cache" appended to its name),
+// together with a key made of the file's full path, size, modification
+// time and a hash of its contents. The cache is only used when the key
+// still matches. It is written to a temporary file that is then renamed
+// over the old one, so concurrent runs never see a partial cache.
+class ArffCache
+{
+public:
+	// Returns the key that identifies the current contents of the file
+	static std::string makeKey(const std::string& filename);
+
+	// Returns the name of the cache file for the specified ARFF file
+	static std::string cacheName(const std::string& filename);
+
+	// Loads the matrix from the cache file, if it exists and has the
+	// specified key. Returns false otherwise.
+	static bool load(Matrix& m, const std::string& cacheFile, const std::string& key);
+
+	// Writes the matrix to the cache file. Throws if it cannot.
+	static void save(Matrix& m, const std::string& cacheFile, const std::string& key);
+};
+
+
+// Reads the rows of an ARFF file one block at a time, so that a file that
+// is larger than memory can be processed in a single pass. Memory is bounded
+// by the block size, not by the file: a block is about 4 MB per worker
+// thread (so it grows with the number of workers), and each batch holds
+// the rows of one block. (A line longer than a block makes the block grow
+// to fit it.) The columns are interpreted with the meta-data of another
+// matrix (usually the training set), so the batches can be given directly
+// to a learner trained on it.
+// For example:
+//
+// ArffReader reader("test.arff", trainingSet);
+// while(reader.next())
+//     process(reader.batch());
+//
+class ArffReader
+{
+private:
+	Matrix m_batch;
+	ArffParser m_parser;
+
+public:
+	// Opens the file and checks its header against schema
+	ArffReader(const std::string& filename, Matrix& schema);
+
+	// Reads the next batch of rows (replacing the previous batch). Returns
+	// false when there are no rows left.
+	bool next();
+
+	// Returns the current batch of rows. (Each batch holds the rows from
+	// about 4 MB of the file per worker thread.)
+	Matrix& batch() { return m_batch; }
+};
+
+#endif // ARFF_H
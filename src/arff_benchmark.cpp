@@ -0,0 +1,269 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+// Measures how fast ARFF files load, in MB/s, with Matrix::loadARFF (on
+// one thread and on every core) and with the line-by-line loader that it
+// replaced. Usage:
+//
+//   ArffBenchmark [file.arff] [repetitions]
+//
+// With no file, a synthetic file with numeric and nominal columns is
+// written to the current folder and used.
+
+#include "matrix.h"
+#include "rand.h"
+#include "error.h"
+#include "parallel.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace
+{
+	string toLower(string strToConvert)
+	{
+		for(size_t i = 0; i < strToConvert.length(); i++)
+			strToConvert[i] = tolower(strToConvert[i]);
+		return strToConvert;
+	}
+
+	// The previous implementation of Matrix::loadARFF, kept here (reading
+	// into local variables) so the two can be compared.
+	size_t legacyLoad(const string& fileName, vector<double>& data)
+	{
+		size_t lineNum = 0;
+		string line;
+		std::ifstream inputFile;
+		map<string, size_t> tempMap;
+		map<size_t, string> tempMapS;
+		size_t attrCount = 0;
+		vector<string> attrNames;
+		vector< map<string, size_t> > strToEnum;
+		vector< map<size_t, string> > enumToStr;
+		size_t rows = 0;
+
+		inputFile.open(fileName.c_str());
+		if(!inputFile)
+			ThrowError("failed to open the file: ", fileName);
+		while(!inputFile.eof() && inputFile)
+		{
+			getline(inputFile, line);
+			lineNum++;
+			if(toLower(line).find("@relation") == 0)
+			{
+			}
+			else if(toLower(line).find("@attribute") == 0)
+			{
+				line = line.substr(line.find_first_of(" \t") + 1);
+				string attrName = line.substr(0, line.find_first_of(" \t"));
+				attrNames.push_back(attrName);
+				line = line.substr(attrName.size());
+				string value = line.substr(line.find_first_not_of(" \t"));
+				tempMap.clear();
+				tempMapS.clear();
+				if(value.find_first_of("{") == 0)
+				{
+					int firstComma;
+					int firstSpace;
+					int firstLetter;
+					value = value.substr(1, value.find_last_of("}") - 1);
+					size_t valCount = 0;
+					while((firstComma = value.find_first_of(",")) > -1)
+					{
+						firstLetter = value.find_first_not_of(" \t,");
+						value = value.substr(firstLetter);
+						firstComma = value.find_first_of(",");
+						firstSpace = value.find_first_of(" \t");
+						tempMapS[valCount] = value.substr(0, firstComma);
+						string valName = value.substr(0, firstComma);
+						valName = valName.substr(0, valName.find_last_not_of(" \t") + 1);
+						tempMap[valName] = valCount++;
+						firstComma = (firstComma < firstSpace && firstSpace < (firstComma + 2)) ? firstSpace : firstComma;
+						value = value.substr(firstComma + 1);
+					}
+					firstLetter = value.find_first_not_of(" \t,");
+					value = value.substr(firstLetter);
+					string valName = value.substr(0, value.find_last_not_of(" \t") + 1);
+					tempMapS[valCount] = valName;
+					tempMap[valName] = valCount++;
+				}
+				strToEnum.push_back(tempMap);
+				enumToStr.push_back(tempMapS);
+				attrCount++;
+			}
+			else if(toLower(line).find("@data") == 0)
+			{
+				vector<double> temp;
+				temp.reserve(attrCount);
+				while(!inputFile.eof())
+				{
+					getline(inputFile, line);
+					lineNum++;
+					line = line.substr(0, line.find_first_of("\r\n"));
+					if(line.find("%") != 0 && line != "")
+					{
+						for(size_t i = 0; i < attrCount; i++)
+						{
+							size_t vals = enumToStr[i].size();
+							string val = line.substr(line.find_first_not_of(" \t"), line.find_first_of(",\n\r"));
+							if(vals > 0)
+							{
+								if(val == "?")
+									temp.push_back(UNKNOWN_VALUE);
+								else
+								{
+									map<string, size_t>::iterator it = strToEnum[i].find(val);
+									if(it == strToEnum[i].end() && strToEnum[i].size() > 1)
+									{
+										strToEnum[i][val] = enumToStr[i].size() - 1;
+										enumToStr[i][enumToStr[i].size() - 1] = val;
+									}
+									temp.push_back(strToEnum[i][val]);
+								}
+							}
+							else
+							{
+								std::stringstream convert(val);
+								double tempDouble;
+								if(val == "?")
+									tempDouble = UNKNOWN_VALUE;
+								else
+									convert >> tempDouble;
+								temp.push_back(tempDouble);
+							}
+							if(i != attrCount - 1)
+							{
+								size_t pos = line.find_first_of(", \t");
+								if(pos == string::npos)
+									ThrowError("Expected more elements on line ", to_str(lineNum));
+								line = line.substr(pos);
+								pos = line.find_first_not_of(", \t");
+								if(pos == string::npos)
+									ThrowError("Expected something after the last delimiter on line ", to_str(lineNum));
+								line = line.substr(pos);
+							}
+						}
+						data.insert(data.end(), temp.begin(), temp.end());
+						rows++;
+						temp.clear();
+					}
+				}
+			}
+		}
+		return rows;
+	}
+
+	// Writes a file with a mix of continuous and nominal attributes
+	void writeSyntheticFile(const string& filename, size_t rows)
+	{
+		const size_t contCols = 16;
+		const size_t nomCols = 4;
+		const char* colors[] = { "red", "green", "blue", "cyan", "magenta", "yellow" };
+		Rand r(0);
+		std::ofstream out(filename.c_str());
+		out << "@RELATION synthetic\n\n";
+		for(size_t i = 0; i < contCols; i++)
+			out << "@ATTRIBUTE x" << i << " REAL\n";
+		for(size_t i = 0; i < nomCols; i++)
+			out << "@ATTRIBUTE c" << i << " {red, green, blue, cyan, magenta, yellow}\n";
+		out << "\n@DATA\n";
+		out.precision(8);
+		for(size_t i = 0; i < rows; i++)
+		{
+			for(size_t j = 0; j < contCols; j++)
+			{
+				if(r.next(100) == 0)
+					out << "?,";
+				else
+					out << r.normal() * 100.0 << ",";
+			}
+			for(size_t j = 0; j < nomCols; j++)
+				out << colors[r.next(6)] << (j + 1 < nomCols ? "," : "\n");
+		}
+	}
+
+	double fileMegabytes(const string& filename)
+	{
+		std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+		return (double)in.tellg() / (1024.0 * 1024.0);
+	}
+
+	double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		string filename;
+		bool synthetic = false;
+		if(argc > 1)
+			filename = argv[1];
+		else
+		{
+			filename = "arff_benchmark.tmp.arff";
+			writeSyntheticFile(filename, 200000);
+			synthetic = true;
+		}
+		size_t reps = argc > 2 ? atoi(argv[2]) : 3;
+		double mb = fileMegabytes(filename);
+		std::cout << "File: " << filename << " (" << mb << " MB)\n";
+
+		// Take the best of several runs of each loader
+		size_t threads = workerCount();
+		double bestSerial = 1e300;
+		double bestParallel = 1e300;
+		double bestOld = 1e300;
+		size_t rowsNew = 0;
+		size_t rowsOld = 0;
+		for(size_t i = 0; i < reps; i++)
+		{
+			setWorkerCount(1);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			Matrix m;
+			m.loadARFF(filename);
+			bestSerial = std::min(bestSerial, secondsSince(start));
+
+			setWorkerCount(threads);
+			start = std::chrono::steady_clock::now();
+			Matrix m2;
+			m2.loadARFF(filename);
+			bestParallel = std::min(bestParallel, secondsSince(start));
+			rowsNew = m2.rows();
+
+			start = std::chrono::steady_clock::now();
+			vector<double> data;
+			rowsOld = legacyLoad(filename, data);
+			bestOld = std::min(bestOld, secondsSince(start));
+		}
+		if(rowsNew != rowsOld)
+			ThrowError("The loaders disagree about the number of rows: ", to_str(rowsNew), " vs ", to_str(rowsOld));
+		std::cout << "Rows: " << rowsNew << "\n";
+		std::cout << "Matrix::loadARFF, 1 thread: " << bestSerial << " seconds, " << mb / bestSerial << " MB/s\n";
+		std::cout << "Matrix::loadARFF, " << threads << " threads: " << bestParallel << " seconds, " << mb / bestParallel << " MB/s\n";
+		std::cout << "Previous loader: " << bestOld << " seconds, " << mb / bestOld << " MB/s\n";
+		std::cout << "Speedup: " << bestOld / bestParallel << "x\n";
+		if(synthetic)
+			remove(filename.c_str());
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
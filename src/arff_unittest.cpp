@@ -0,0 +1,273 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "matrix.h"
+#include "arff.h"
+#include "parallel.h"
+#include "error.h"
+#include "tests/include/gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace
+{
+    std::string writeFile(const std::string& contents)
+    {
+        std::string filename = "arff_unittest.tmp.arff";
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        out << contents;
+        return filename;
+    }
+}
+
+TEST(ArffParserTest, parsesHeaderAndData)
+{
+    std::string filename = writeFile(
+        "% a comment\r\n"
+        "@RELATION test\r\n"
+        "\r\n"
+        "@ATTRIBUTE width REAL\r\n"
+        "@attribute color { red, green ,blue }\r\n"
+        "@Attribute class {yes,no}\r\n"
+        "@DATA\r\n"
+        "1.5, green,no\r\n"
+        "% another comment\r\n"
+        "?,blue, yes\r\n"
+        "-2e3 red ?");
+
+    Matrix m;
+    m.loadARFF(filename);
+    remove(filename.c_str());
+
+    ASSERT_EQ(3u, m.rows());
+    ASSERT_EQ(3u, m.cols());
+    EXPECT_EQ("color", m.attrName(1));
+    EXPECT_EQ(0u, m.valueCount(0));
+    EXPECT_EQ(3u, m.valueCount(1));
+    EXPECT_EQ("green", m.attrValue(1, 1));
+
+    EXPECT_EQ(1.5, m[0][0]);
+    EXPECT_EQ(1.0, m[0][1]);
+    EXPECT_EQ(1.0, m[0][2]);
+    EXPECT_EQ(UNKNOWN_VALUE, m[1][0]);
+    EXPECT_EQ(2.0, m[1][1]);
+    EXPECT_EQ(0.0, m[1][2]);
+    EXPECT_EQ(-2000.0, m[2][0]);
+    EXPECT_EQ(0.0, m[2][1]);
+    EXPECT_EQ(UNKNOWN_VALUE, m[2][2]);
+}
+
+TEST(ArffParserTest, rejectsBadValues)
+{
+    Matrix m;
+    std::string filename = writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1,z\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+
+    writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1x,y\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+
+    writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+    remove(filename.c_str());
+}
+
+TEST(ArffParserTest, parallelChunksKeepOrderAndLineNumbers)
+{
+    // Enough rows to be split into several chunks
+    std::ostringstream os;
+    os << "@relation big\n@attribute n real\n@attribute c {a,b,c}\n@data\n";
+    size_t rows = 50000;
+    for (size_t i = 0; i < rows; ++i)
+        os << i << "," << "abc"[i % 3] << "\n";
+    std::string contents = os.str();
+
+    setWorkerCount(4);
+    Matrix m;
+    std::string filename = writeFile(contents);
+    m.loadARFF(filename);
+    ASSERT_EQ(rows, m.rows());
+    for (size_t i = 0; i < rows; ++i)
+    {
+        ASSERT_EQ((double)i, m[i][0]);
+        ASSERT_EQ((double)(i % 3), m[i][1]);
+    }
+
+    // Break a row near the end, which lands in the last chunk
+    size_t badRow = rows - 10;
+    size_t pos = contents.find("\n" + to_str(badRow) + ",");
+    contents[pos + 1] = 'x';
+    writeFile(contents);
+    try
+    {
+        m.loadARFF(filename);
+        FAIL();
+    }
+    catch (const std::exception& e)
+    {
+        EXPECT_NE(std::string::npos, std::string(e.what()).find("on line " + to_str(badRow + 5)));
+    }
+    setWorkerCount(0);
+    remove(filename.c_str());
+}
+
+TEST(ArffParserTest, readsGzipFiles)
+{
+    // Several megabytes, in two gzip members (as "cat a.gz b.gz" would make)
+    std::ostringstream header, data;
+    header << "@relation big\n@attribute n real\n@attribute c {a,b,c}\n@data\n";
+    size_t rows = 300000;
+    for (size_t i = 0; i < rows; ++i)
+        data << i << "," << "abc"[i % 3] << "\n";
+    std::string filename = "arff_unittest.tmp.arff.gz";
+    const char* modes[] = { "wb", "ab" };
+    std::string parts[] = { header.str(), data.str() };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        gzFile f = gzopen(filename.c_str(), modes[i]);
+        ASSERT_TRUE(f != NULL);
+        ASSERT_EQ((int)parts[i].size(), gzwrite(f, parts[i].data(), (unsigned)parts[i].size()));
+        gzclose(f);
+    }
+
+    Matrix m;
+    m.loadARFF(filename);
+    ASSERT_EQ(rows, m.rows());
+    EXPECT_EQ(0.0, m[0][0]);
+    EXPECT_EQ((double)(rows - 1), m[rows - 1][0]);
+    EXPECT_EQ((double)((rows - 1) % 3), m[rows - 1][1]);
+
+    // A truncated file is an error, not a short matrix
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(bytes.data(), bytes.size() / 2);
+    out.close();
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+    remove(filename.c_str());
+}
+
+TEST(ArffParserTest, parsesSparseRows)
+{
+    std::string filename = writeFile(
+        "@relation sparse\n"
+        "@attribute a real\n"
+        "@attribute b real\n"
+        "@attribute c {x,y,z}\n"
+        "@attribute d real\n"
+        "@data\n"
+        "{1 2.5, 2 z}\n"
+        "% a comment\n"
+        "{}\n"
+        "0,0,y,?\n"
+        "{0 -1,3 4}\n");
+
+    Matrix m;
+    m.loadARFF(filename);
+    ASSERT_TRUE(m.isSparse());
+    ASSERT_EQ(4u, m.rows());
+    Matrix::SparseRow r = m.sparseRow(0);
+    ASSERT_EQ(2u, r.size());
+    EXPECT_EQ(1u, r.col(0));
+    EXPECT_EQ(2.5, r.value(0));
+    EXPECT_EQ(2u, r.col(1));
+    EXPECT_EQ(2.0, r.value(1));
+    EXPECT_EQ(0u, m.sparseRow(1).size());
+    EXPECT_EQ(2u, m.sparseRow(2).size()); // (a dense row keeps only its nonzero elements)
+
+    // a view of the middle columns leaves out the other elements
+    MatrixView middle(m, 0, 1, m.rows(), 2);
+    ASSERT_TRUE(middle.isSparse());
+    EXPECT_EQ(0u, middle.sparseRow(3).size());
+    EXPECT_EQ(0u, middle.sparseRow(0).col(0));
+    EXPECT_EQ(1u, middle.sparseRow(2).col(0));
+
+    // dense access converts only the view
+    EXPECT_EQ(2.0, middle[0][1]);
+    EXPECT_FALSE(middle.isSparse());
+    EXPECT_TRUE(m.isSparse());
+    EXPECT_EQ(UNKNOWN_VALUE, m[2][3]);
+    EXPECT_EQ(-1.0, m[3][0]);
+    EXPECT_EQ(0.0, m[3][2]);
+
+    // malformed sparse rows
+    writeFile("@attribute a real\n@attribute b real\n@data\n{1 2, 0 1}\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+    writeFile("@attribute a real\n@attribute b real\n@data\n{2 1}\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+    writeFile("@attribute a real\n@attribute b real\n@data\n{0 1\n");
+    EXPECT_THROW(m.loadARFF(filename), std::exception);
+
+    // in a dense file, sparse rows are expanded
+    writeFile("@attribute a real\n@attribute b real\n@data\n1,2\n{1 3}\n");
+    m.loadARFF(filename);
+    EXPECT_FALSE(m.isSparse());
+    EXPECT_EQ(0.0, m[1][0]);
+    EXPECT_EQ(3.0, m[1][1]);
+    remove(filename.c_str());
+}
+
+TEST(ArffCacheTest, reusesUntilFileChanges)
+{
+    std::string filename = writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1,x\n2,y\n");
+    std::string cacheFile = ArffCache::cacheName(filename);
+    remove(cacheFile.c_str());
+
+    Matrix m;
+    m.loadARFF(filename, true);
+    std::ifstream cached(cacheFile.c_str());
+    EXPECT_TRUE(cached.good());
+
+    Matrix fromCache;
+    fromCache.loadARFF(filename, true);
+    ASSERT_EQ(2u, fromCache.rows());
+    EXPECT_EQ("b", fromCache.attrName(1));
+    EXPECT_EQ(2.0, fromCache[1][0]);
+    EXPECT_EQ(1.0, fromCache[1][1]);
+
+    // same size, different contents
+    writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1,x\n3,y\n");
+    Matrix changed;
+    changed.loadARFF(filename, true);
+    EXPECT_EQ(3.0, changed[1][0]);
+
+    remove(cacheFile.c_str());
+    remove(filename.c_str());
+}
+
+TEST(ArffReaderTest, streamsWithSchemaDictionaries)
+{
+    std::string filename = writeFile("@attribute a real\n@attribute b {x,y}\n@data\n1,x\n2,y\n");
+    Matrix schema;
+    schema.loadARFF(filename);
+
+    // the same columns, but the header lists the values the other way around
+    writeFile("@attribute a real\n@attribute b {y,x}\n@data\n5,x\n% comment\n6,y\n7,x\n");
+    ArffReader reader(filename, schema);
+    std::vector<double> a;
+    std::vector<double> b;
+    while (reader.next())
+    {
+        Matrix& batch = reader.batch();
+        for (size_t i = 0; i < batch.rows(); ++i)
+        {
+            a.push_back(batch[i][0]);
+            b.push_back(batch[i][1]);
+        }
+    }
+    ASSERT_EQ(3u, a.size());
+    EXPECT_EQ(6.0, a[1]);
+    EXPECT_EQ(0.0, b[0]);
+    EXPECT_EQ(1.0, b[1]);
+    EXPECT_EQ("x", reader.batch().attrValue(1, 0));
+
+    // a header with different columns is rejected
+    writeFile("@attribute a real\n@data\n5\n");
+    EXPECT_THROW(ArffReader bad(filename, schema), std::exception);
+    remove(filename.c_str());
+}
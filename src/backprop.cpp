@@ -1,5 +1,6 @@
 
 #include "backprop.h"
+#include <cfloat>
 
 
 void Backprop::train(Matrix& features, Matrix& labels)
@@ -24,6 +25,10 @@ void Backprop::train(Matrix& features, Matrix& labels)
         this->continuousOut = true;
     numOutputs = numOutputs < 3 ? 1 : numOutputs;
 
+    // a network without hidden nodes has no hidden layers
+    if (this->hiddenNodes == 0)
+        this->hiddenLayers = 0;
+
     // initialize weight vectors
     this->initWeights(numInputs, numOutputs);
 
@@ -44,8 +49,8 @@ void Backprop::train(Matrix& features, Matrix& labels)
     int bestEpoch = 1;
     int epoch = 0;
     double stopCriteria;
-    size_t numFeatures = features.rows();
     bool stop;
+    std::vector<size_t> order; // the order in which the rows were visited
 //    std::cout << std::endl << "epoch,ClassAcc,MSE(TrS),MSE(VS)" << std::endl;
 //    std::cout << epoch << ",";
 //    std::cout << this->measureAccuracy(validation, validationLabels) << ",";
@@ -55,22 +60,18 @@ void Backprop::train(Matrix& features, Matrix& labels)
     {
         ++epoch;
 
-        // Shuffle the rows
-        features.shuffleRows(m_rand, &labels);
-
-        // for each feature
-        for (size_t featureIndex = 0; featureIndex < numFeatures; ++featureIndex)
+        // for each feature, in a new order each epoch
+        features.visitShuffled(m_rand, order, [&](size_t featureIndex)
         {
-            std::vector<double>& feature = features.row(featureIndex);
             // set input layer outputs to feature vector plus bias node
-            std::vector<double> inputs = feature;
+            std::vector<double>& inputs = this->outputs[0];
+            features.getRow(featureIndex, inputs);
             inputs.push_back (1.0);
-            this->outputs[0] = inputs;
             // run forward algorithm to calculate node outputs
             this->forward(this->weights, this->outputs);
             // run backprop algorithm to adjust node weights
-            this->backward(this->weights, this->outputs, this->errors, labels.row(featureIndex)[0]);
-        }
+            this->backward(this->weights, this->outputs, this->errors, labels.get(featureIndex, 0));
+        });
 
         // Get MSE over validation set
         stopCriteria = this->measureAccuracy(validation, validationLabels);
@@ -116,26 +117,42 @@ void Backprop::train(Matrix& features, Matrix& labels)
 }
 
 
-void Backprop::predict(const std::vector<double>& features, std::vector<double>& labels)
+void Backprop::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
     double MSE = 0.0;
     this->predict(features, labels, MSE);
 }
 
 
-void Backprop::predict(const std::vector<double>& features, std::vector<double>& labels, double& MSE)
+void Backprop::predict(const std::vector<double>& features, std::vector<double>& labels, double& MSE) const
 {
+    if (this->outputs.empty())
+        ThrowError("Backprop::predict:Expected the network to be trained");
+
+    // The node outputs are computed in scratch space that belongs to the
+    // thread (in the shape of the network, with the bias nodes set to 1).
+    // forward never writes the bias nodes, and the input layer is set
+    // below, so the scratch only needs to be copied from the network when
+    // its other layers have different sizes, as on the first call.
+    static thread_local std::vector< std::vector<double> > t_outputs;
+    std::vector< std::vector<double> >& outputs = t_outputs;
+    bool reshape = outputs.size() != this->outputs.size();
+    for (size_t layerIndex = 1; !reshape && layerIndex < outputs.size(); ++layerIndex)
+        reshape = outputs[layerIndex].size() != this->outputs[layerIndex].size();
+    if (reshape)
+        outputs = this->outputs;
+
     // set input layer outputs to feature vector
-    std::vector<double> inputs = features;
+    std::vector<double>& inputs = outputs[0];
+    inputs = features;
     inputs.push_back (1.0);
-    this->outputs[0] = inputs;
     // run forward algorithm to calculate node outputs
-    this->forward(this->weights, this->outputs);
+    this->forward(this->weights, outputs);
 
-    size_t outputCount = this->outputs[this->outputIndex()].size();
+    size_t outputCount = outputs[this->outputIndex()].size();
     if (outputCount == 1)
     {
-        double out = this->outputs[this->outputIndex()][0];
+        double out = outputs[this->outputIndex()][0];
         if (!this->continuousOut)
             labels[0] = out < 0.0 ? 1.0 : 0.0;
         else
@@ -153,7 +170,7 @@ void Backprop::predict(const std::vector<double>& features, std::vector<double>&
             if (i == labels[0])
                 target = 1.0;
 //            std::cout << "outputIndex " << i << " output " << this->outputs[this->outputIndex()][i] << std::endl;
-            double output = this->outputs[this->outputIndex()][i];
+            double output = outputs[this->outputIndex()][i];
             if (maxPred < output)
             {
                 maxPred = output;
@@ -168,25 +185,90 @@ void Backprop::predict(const std::vector<double>& features, std::vector<double>&
 
 }
 
-void Backprop::forward(const std::vector< std::vector< std::vector<double> > >& weights, std::vector< std::vector<double> >& outputs)
+void Backprop::predictBatch(Matrix& features, Matrix& labels) const
 {
-    // Check layer number assertion
-    if(outputs.size() < 2)
-        ThrowError("Backprop::forward:Expected there to be at least one input layer and one output layer");
-    if(weights.size() != outputs.size())
-        ThrowError("Backprop::forward:Expected the weights (minus output layer) and outputs to have the same number of layers");
+    if (labels.rows() != features.rows())
+        ThrowError("Expected a row of labels for each row of features");
 
-    // Check layer size assertion
+    // Make the same checks as forward, with a row of features as the input layer
     size_t numLayers = this->numLayers();
-    for (size_t layerIndex = 0; layerIndex < numLayers; ++layerIndex)
+    this->checkLayers(this->weights, this->outputs, features.cols() + 1);
+
+    // The outputs of a layer for every row, one row after another,
+    // starting with the input layer (each row ending with the bias node).
+    // (A sparse row is made dense by getRow.)
+    size_t rows = features.rows();
+    size_t prevNumNodes = features.cols() + 1;
+    std::vector<double> prevOutputs(rows * prevNumNodes);
+    std::vector<double> row;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        features.getRow(r, row);
+        std::copy(row.begin(), row.end(), prevOutputs.begin() + r * prevNumNodes);
+        prevOutputs[r * prevNumNodes + prevNumNodes - 1] = 1.0;
+    }
+
+    std::vector<double> layerOutputs;
+    std::vector<double> nodeWeights;
+    for (size_t layerIndex = 1; layerIndex < numLayers; ++layerIndex)
     {
-        if (layerIndex < numLayers - 1 && outputs[layerIndex].size() < 2)
-            ThrowError("Backprop::forward:Expected at least one regular node and one bias node in input and hidden layers");
-        if (layerIndex == numLayers - 1 && outputs[layerIndex].size() < 1)
-            ThrowError("Backprop::forward:Expected at least one node in output layer");
-        if (layerIndex < numLayers - 1 && weights[layerIndex].size() != outputs[layerIndex].size())
-            ThrowError("Backprop::forward:Expected the layers in weights and outputs to have the same number of nodes");
+        const std::vector< std::vector<double> >& prevLayerWeights = this->weights[layerIndex - 1];
+        size_t numNodes = this->outputs[layerIndex].size();
+        size_t regularNodes = layerIndex == numLayers - 1 ? numNodes : numNodes - 1;
+        layerOutputs.assign(rows * numNodes, 1.0); // (leaving the bias nodes at 1)
+
+        // Compute each node for every row, with its weights gathered together
+        nodeWeights.resize(prevNumNodes);
+        for (size_t j = 0; j < regularNodes; ++j)
+        {
+            for (size_t i = 0; i < prevNumNodes; ++i)
+                nodeWeights[i] = prevLayerWeights[i][j];
+            for (size_t r = 0; r < rows; ++r)
+            {
+                const double* pIn = prevOutputs.data() + r * prevNumNodes;
+                double net = 0.0;
+                for (size_t i = 0; i < prevNumNodes; ++i)
+                    net += nodeWeights[i] * pIn[i];
+                net *= -1;
+                layerOutputs[r * numNodes + j] = 1 / (1 + exp (net));
+            }
+        }
+        prevOutputs.swap(layerOutputs);
+        prevNumNodes = numNodes;
+    }
+
+    // Turn the output layer into labels, as predict does
+    for (size_t r = 0; r < rows; ++r)
+    {
+        const double* pOut = prevOutputs.data() + r * prevNumNodes;
+        if (prevNumNodes == 1)
+        {
+            if (!this->continuousOut)
+                labels[r][0] = pOut[0] < 0.0 ? 1.0 : 0.0;
+            else
+                labels[r][0] = pOut[0];
+        }
+        else
+        {
+            size_t maxLabel = 0;
+            double maxPred = -DBL_MAX;
+            for (size_t i = 0; i < prevNumNodes; ++i)
+            {
+                if (maxPred < pOut[i])
+                {
+                    maxPred = pOut[i];
+                    maxLabel = i;
+                }
+            }
+            labels[r][0] = maxLabel;
+        }
     }
+}
+
+void Backprop::forward(const std::vector< std::vector< std::vector<double> > >& weights, std::vector< std::vector<double> >& outputs) const
+{
+    this->checkLayers(weights, outputs);
+    size_t numLayers = this->numLayers();
 
     // for each hidden layer
     size_t inputLayer = 0;
@@ -260,7 +342,8 @@ void Backprop::backward(std::vector< std::vector< std::vector<double> > >& weigh
     {
         std::vector<double>& errorVector = errors[layerIndex];
         std::vector<double> outputVector = outputs[layerIndex];
-        for (size_t nodeIndex = 0; nodeIndex < outputVector.size(); ++nodeIndex)
+        // (hidden layers have no error for their bias node)
+        for (size_t nodeIndex = 0; nodeIndex < errorVector.size(); ++nodeIndex)
         {
             double error = 1.0;
             if (layerIndex == numLayers - 1)
@@ -453,17 +536,40 @@ double Backprop::deltaRule(const double& toError, const double& output, const do
 }
 
 
-size_t Backprop::numLayers()
+size_t Backprop::numLayers() const
 {
     if (this->hiddenNodes == 0)
-        this->hiddenLayers = 0;
+        return 2;
     return 1 + this->hiddenLayers + 1;
 }
 
 
-size_t Backprop::outputIndex()
+void Backprop::checkLayers(const std::vector< std::vector< std::vector<double> > >& weights, const std::vector< std::vector<double> >& outputs, size_t inputNodes) const
 {
-    return this->hiddenLayers + 1;
+    // Check layer number assertion
+    if (outputs.size() < 2)
+        ThrowError("Backprop::checkLayers:Expected there to be at least one input layer and one output layer");
+    if (weights.size() != outputs.size())
+        ThrowError("Backprop::checkLayers:Expected the weights (minus output layer) and outputs to have the same number of layers");
+
+    // Check layer size assertion
+    size_t numLayers = this->numLayers();
+    for (size_t layerIndex = 0; layerIndex < numLayers; ++layerIndex)
+    {
+        size_t numNodes = layerIndex == 0 && inputNodes > 0 ? inputNodes : outputs[layerIndex].size();
+        if (layerIndex < numLayers - 1 && numNodes < 2)
+            ThrowError("Backprop::checkLayers:Expected at least one regular node and one bias node in input and hidden layers");
+        if (layerIndex == numLayers - 1 && numNodes < 1)
+            ThrowError("Backprop::checkLayers:Expected at least one node in output layer");
+        if (layerIndex < numLayers - 1 && weights[layerIndex].size() != numNodes)
+            ThrowError("Backprop::checkLayers:Expected the layers in weights and outputs to have the same number of nodes");
+    }
+}
+
+
+size_t Backprop::outputIndex() const
+{
+    return this->numLayers() - 1;
 }
 
 
@@ -492,11 +598,14 @@ double Backprop::getMeanSquaredError(Matrix& features, Matrix& labels)
     double MSE = 0.0;
     std::vector<double> pred;
     pred.resize(1);
-    for(size_t i = 0; i < features.rows(); i++)
+    Matrix::BlockIterator it(features);
+    while(it.next())
     {
-        const std::vector<double>& feat = features.row(i);
-        pred[0] = labels.row(i)[0];
-        predict(feat, pred, MSE);
+        for(size_t i = 0; i < it.size(); i++)
+        {
+            pred[0] = labels.get(it.index(i), 0);
+            predict(it.row(i), pred, MSE);
+        }
     }
     return MSE / features.rows();
 }
@@ -32,15 +32,16 @@ class Backprop : public SupervisedLearner
     std::vector< std::vector<double> > errors;
     double biasAttr;
 
+public:
+    // The parameters that are used unless others are given
     static const int MAX_EPOCHS = 1000;
-    static const double LEARNING_RATE = 0.6;
-    static const double MOMENTUM = 0.2;
+    static constexpr double LEARNING_RATE = 0.6;
+    static constexpr double MOMENTUM = 0.2;
     static const size_t HIDDEN_LAYERS = 4;
 
     // This will be set to twice the input size unless a positive value is given
     static const size_t HIDDEN_NODES = 32;
 
-public:
     Backprop()
     : SupervisedLearner(), maxEpochs(MAX_EPOCHS), learningRate(LEARNING_RATE), momentum(MOMENTUM), 
       hiddenLayers(HIDDEN_LAYERS), hiddenNodes(HIDDEN_NODES)
@@ -91,15 +92,22 @@ public:
 	// Train the model to predict the labels
 	void train(Matrix&, Matrix&);
 
+	// Returns an untrained network with the same settings
+	SupervisedLearner* clone(Rand& r) { return new Backprop(r, maxEpochs, learningRate, momentum, hiddenLayers, hiddenNodes); }
+
 	// Evaluate the features and predict the labels
-	void predict(const std::vector<double>&, std::vector<double>&);
+	void predict(const std::vector<double>&, std::vector<double>&) const;
     // Predict overload, if a double is provided it will put the MSE there, if possible
-    void predict(const std::vector<double>&, std::vector<double>&, double&);
+    void predict(const std::vector<double>&, std::vector<double>&, double&) const;
+
+    // Predicts a batch of rows together, a layer at a time, with the same
+    // results as predict
+    void predictBatch(Matrix&, Matrix&) const;
     
     // Computes the outputs for all layers for a single feature vector
     // Assumes the first vector in the outputs parameter is initialized from feature vector
     // Size of vectors in weights and outputs must match
-    void forward(const std::vector< std::vector< std::vector<double> > >&, std::vector< std::vector<double> >&);
+    void forward(const std::vector< std::vector< std::vector<double> > >&, std::vector< std::vector<double> >&) const;
 
     // Computes the errors for the output and hidden layers, going backwards (the backprop step)
     // Assumes the forward algorithm has been run to update the output vector
@@ -131,10 +139,15 @@ private:
     double deltaRule(const double&, const double&, const double&);
 
     // Returns the number of layers in the MLP
-    size_t numLayers();
+    size_t numLayers() const;
+
+    // Checks that weights and outputs have the shape of the network. If the
+    // number of input nodes (including the bias node) is not 0, it is used
+    // instead of the size of the input layer in outputs.
+    void checkLayers(const std::vector< std::vector< std::vector<double> > >&, const std::vector< std::vector<double> >&, size_t inputNodes = 0) const;
 
     // Calculates the index of the output layer
-    size_t outputIndex();
+    size_t outputIndex() const;
 
     // Stopping criteria
     bool stop(const double& stopCriteria);
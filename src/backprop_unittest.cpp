@@ -15,7 +15,7 @@
 TEST(BackpropTest, forward)
 {
     Rand r (0);
-    Backprop b (r);
+    Backprop b (r, 1000, 0.6, 0.2, 1, 2); // (one hidden layer of two nodes, as below)
 
     // init weight vector
     std::vector< std::vector< std::vector<double> > > weights;
@@ -59,4 +59,56 @@ TEST(BackpropTest, forward)
     outputs[2].push_back (0.0);
 
     b.forward(weights, outputs);
+
+    // Each hidden node sees only the input bias. (The hidden bias output is
+    // left at 0 above, so the output node sees only the hidden nodes.)
+    double hidden = 1.0 / (1.0 + exp(-1.0));
+    EXPECT_DOUBLE_EQ(hidden, outputs[1][0]);
+    EXPECT_DOUBLE_EQ(hidden, outputs[1][1]);
+    EXPECT_DOUBLE_EQ(1.0 / (1.0 + exp(-2.0 * hidden)), outputs[2][0]);
+}
+
+TEST(BackpropTest, predictSwitchesBetweenNetworks)
+{
+    Matrix features;
+    features.setSize(20, 2);
+    Matrix labels;
+    labels.setSize(20, 1);
+    for (size_t i = 0; i < 20; ++i)
+    {
+        features[i][0] = i * 0.05;
+        features[i][1] = 1.0 - i * 0.05;
+        labels[i][0] = i < 10 ? 0.2 : 0.8;
+    }
+    Rand r (0);
+    Backprop small (r, 5, 0.6, 0.2, 1, 2);
+    Backprop large (r, 5, 0.6, 0.2, 2, 3);
+    Matrix trainFeatures;
+    Matrix trainLabels;
+    trainFeatures = features; // (training takes a validation set out of them)
+    trainLabels = labels;
+    small.train(trainFeatures, trainLabels);
+    trainFeatures = features;
+    trainLabels = labels;
+    large.train(trainFeatures, trainLabels);
+
+    // Predicting with one network between the predictions of another (which
+    // share the thread's scratch space) gives the same labels as predicting
+    // all the rows together
+    Matrix smallLabels;
+    smallLabels.setSize(20, 1);
+    small.predictBatch(features, smallLabels);
+    Matrix largeLabels;
+    largeLabels.setSize(20, 1);
+    large.predictBatch(features, largeLabels);
+    std::vector<double> row;
+    std::vector<double> label(1);
+    for (size_t i = 0; i < 20; ++i)
+    {
+        features.getRow(i, row);
+        small.predict(row, label);
+        EXPECT_DOUBLE_EQ(smallLabels[i][0], label[0]);
+        large.predict(row, label);
+        EXPECT_DOUBLE_EQ(largeLabels[i][0], label[0]);
+    }
 }
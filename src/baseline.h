@@ -57,8 +57,14 @@ public:
 		}
 	}
 
+	// Returns an untrained baseline learner
+	virtual SupervisedLearner* clone(Rand& r)
+	{
+		return new BaselineLearner(r);
+	}
+
 	// Evaluate the features and predict the labels
-	virtual void predict(const std::vector<double>& features, std::vector<double>& labels)
+	virtual void predict(const std::vector<double>& features, std::vector<double>& labels) const
 	{
 		if(labels.size() != m_labelVec.size())
 			ThrowError("Unexpected number of label dims");
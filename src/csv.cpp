@@ -0,0 +1,328 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "csv.h"
+#include "error.h"
+#include "inputfile.h"
+#include "parallel.h"
+#include "textscan.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+// The number of bytes read from the file at a time (per worker thread)
+#define CSV_BLOCK_SIZE (4 * 1024 * 1024)
+
+// The smallest piece of a block worth giving to its own thread
+#define CSV_MIN_CHUNK_SIZE (64 * 1024)
+
+CsvParser::CsvParser(Matrix& matrix, Matrix* pSchema, Matrix::Layout layout)
+: m_matrix(matrix), m_pSchema(pSchema), m_layout(layout), m_lineNum(0)
+{
+}
+
+void CsvParser::load(const string& filename)
+{
+	LineReader reader(filename, CSV_BLOCK_SIZE * workerCount());
+	m_matrix.setSize(0, 0);
+	m_matrix.m_filename = filename;
+	m_lineNum = 0;
+	m_nominal.clear();
+	bool haveHeader = false;
+	const char* begin;
+	const char* end;
+	while(reader.next(begin, end))
+	{
+		if(!haveHeader)
+		{
+			begin = parseHeader(begin, end);
+			if(!begin)
+				continue; // nothing but blank lines so far
+			haveHeader = true;
+		}
+		parseBlock(begin, end);
+	}
+	if(!haveHeader)
+		ThrowError("Expected a line of column names in ", filename);
+
+	if(m_layout == Matrix::COMPACT || m_layout == Matrix::COMPACT_FLOAT)
+		m_matrix.compact(m_layout == Matrix::COMPACT_FLOAT);
+
+	// Note which columns have no missing values
+	m_matrix.forgetColumnInfo();
+	for(size_t j = 0; j < m_missing.size(); j++)
+	{
+		if(m_missing[j] == 0)
+			m_matrix.setComplete(j);
+	}
+}
+
+const char* CsvParser::parseHeader(const char* p, const char* end)
+{
+	// Find the first line that is not blank
+	const char* lineEnd = end;
+	while(true)
+	{
+		if(p == end)
+			return NULL;
+		const char* eol = endOfLine(p, end);
+		lineEnd = eol;
+		if(lineEnd != p && lineEnd[-1] == '\r')
+			lineEnd--;
+		m_lineNum++;
+		if(skipSpace(p, lineEnd) != lineEnd)
+			break;
+		p = eol == end ? end : eol + 1;
+	}
+	const char* next = lineEnd == end ? end : endOfLine(lineEnd, end);
+	if(next != end)
+		next++;
+
+	// Parse the names
+	vector<string> names;
+	string scratch;
+	string_view name;
+	while(true)
+	{
+		p = nextValue(p, lineEnd, name, scratch);
+		if(!p)
+			ThrowError("Badly quoted column name on line ", to_str(m_lineNum));
+		if(name.empty())
+			names.push_back("column" + to_str(names.size() + 1));
+		else
+			names.push_back(string(name));
+		if(p == lineEnd)
+			break;
+		p++;
+	}
+	size_t cols = names.size();
+
+	m_nominal.assign(cols, false);
+	if(m_pSchema)
+	{
+		// Use the columns and dictionaries of the schema
+		if(m_pSchema->cols() != cols)
+			ThrowError("Expected ", to_str(m_pSchema->cols()), " columns, found ", to_str(cols));
+		m_matrix.m_pSchema = m_pSchema->m_pSchema;
+		for(size_t i = 0; i < cols; i++)
+			m_nominal[i] = m_matrix.valueCount(i) > 0;
+	}
+	else
+	{
+		// A column is nominal if it has a value in this block that is not a number
+		for(const char* q = next; q != end; )
+		{
+			const char* eol = endOfLine(q, end);
+			const char* qEnd = eol;
+			if(qEnd != q && qEnd[-1] == '\r')
+				qEnd--;
+			for(size_t i = 0; i < cols && q; i++)
+			{
+				if(i > 0)
+				{
+					if(q == qEnd)
+						break;
+					q++;
+				}
+				string_view value;
+				q = nextValue(q, qEnd, value, scratch);
+				if(q && !m_nominal[i] && !isMissing(value))
+				{
+					double d;
+					m_nominal[i] = !parseNumber(value.data(), value.data() + value.size(), d);
+				}
+			}
+			q = eol == end ? end : eol + 1;
+		}
+		for(size_t i = 0; i < cols; i++)
+		{
+			boost::shared_ptr<Matrix::Attribute> pAttr(new Matrix::Attribute());
+			pAttr->name = names[i];
+			m_matrix.ownSchema().push_back(pAttr);
+		}
+	}
+
+	m_matrix.m_pData.reset(new MatrixStorage());
+	if(m_layout == Matrix::SPILL)
+		m_matrix.m_pSpill.reset(new SpillStorage(cols));
+	m_matrix.m_rows = 0;
+	m_matrix.m_stride = cols;
+	m_dictionaries.resize(cols);
+	m_missing.assign(cols, 0);
+	return next;
+}
+
+void CsvParser::parseBlock(const char* begin, const char* end)
+{
+	// Look nominal values up in the current dictionaries of the matrix
+	size_t cols = m_nominal.size();
+	for(size_t i = 0; i < cols; i++)
+		m_dictionaries[i] = &m_matrix.attribute(i).strToEnum;
+
+	// Parse the lines concurrently. The dictionaries are only read, so each
+	// chunk keeps the values that are not in them to itself.
+	Chunk blank;
+	blank.newValues.resize(cols);
+	blank.missing.assign(cols, 0);
+	vector<double>& data = m_matrix.m_pData->elements();
+	vector< vector<size_t> > remap(cols);
+	parseLines(begin, end, CSV_MIN_CHUNK_SIZE, '\0', blank, m_lineNum,
+		[this](const char* lineBegin, const char* lineEnd, Chunk& chunk) { return parseLine(lineBegin, lineEnd, chunk); },
+		[&](Chunk& chunk)
+		{
+			// Enumerate the new values of the chunk, and change its elements
+			// from their numbers within the chunk to their enumerations
+			if(!chunk.newPositions.empty())
+			{
+				for(size_t j = 0; j < cols; j++)
+				{
+					const Dictionary& newValues = chunk.newValues[j];
+					if(newValues.empty())
+						continue;
+					Matrix::Attribute& attr = m_matrix.ownAttribute(j);
+					remap[j].resize(newValues.size());
+					for(size_t k = 0; k < newValues.size(); k++)
+					{
+						const string& value = newValues.key(k);
+						size_t e = attr.strToEnum.find(value);
+						if(e == Dictionary::NOT_FOUND)
+						{
+							e = attr.enumToStr.size();
+							attr.strToEnum.set(value, e);
+							attr.enumToStr.push_back(value);
+						}
+						remap[j][newValues.value(k)] = e;
+					}
+				}
+				for(size_t j = 0; j < chunk.newPositions.size(); j++)
+				{
+					double& element = chunk.data[chunk.newPositions[j]];
+					element = (double)remap[chunk.newPositions[j] % cols][(size_t)element];
+				}
+			}
+
+			if(m_matrix.m_pSpill)
+				m_matrix.m_pSpill->append(chunk.data.data(), chunk.rows);
+			else
+				data.insert(data.end(), chunk.data.begin(), chunk.data.end());
+			m_matrix.m_rows += chunk.rows;
+			for(size_t j = 0; j < cols; j++)
+				m_missing[j] += chunk.missing[j];
+		});
+}
+
+bool CsvParser::parseLine(const char* p, const char* end, Chunk& chunk) const
+{
+	size_t cols = m_nominal.size();
+	size_t pos = chunk.data.size();
+	chunk.data.resize(pos + cols);
+	double* pOut = chunk.data.data() + pos;
+	string_view value;
+	for(size_t i = 0; i < cols; i++)
+	{
+		if(i > 0)
+		{
+			if(p == end)
+			{
+				chunk.error = "Expected " + to_str(cols) + " values, found " + to_str(i);
+				return false;
+			}
+			p++; // skip the comma
+		}
+		p = nextValue(p, end, value, chunk.scratch);
+		if(!p)
+		{
+			chunk.error = "Badly quoted value for attribute " + m_matrix.attribute(i).name;
+			return false;
+		}
+		if(isMissing(value))
+		{
+			pOut[i] = UNKNOWN_VALUE;
+			chunk.missing[i]++;
+		}
+		else if(!m_nominal[i])
+		{
+			if(!parseNumber(value.data(), value.data() + value.size(), pOut[i]))
+			{
+				chunk.error = "Expected a number for attribute " + m_matrix.attribute(i).name + ", found \"" + string(value) + "\"";
+				return false;
+			}
+		}
+		else
+		{
+			size_t e = m_dictionaries[i]->find(value);
+			if(e == Dictionary::NOT_FOUND)
+			{
+				if(m_pSchema)
+				{
+					chunk.error = "Unrecognized value \"" + string(value) + "\" for attribute " + m_matrix.attribute(i).name;
+					return false;
+				}
+				Dictionary& newValues = chunk.newValues[i];
+				e = newValues.find(value);
+				if(e == Dictionary::NOT_FOUND)
+				{
+					e = newValues.size();
+					newValues.set(value, e);
+				}
+				chunk.newPositions.push_back(pos + i);
+			}
+			pOut[i] = (double)e;
+		}
+	}
+	if(p != end)
+	{
+		chunk.error = "Expected only " + to_str(cols) + " values";
+		return false;
+	}
+	return true;
+}
+
+const char* CsvParser::nextValue(const char* p, const char* end, string_view& value, string& scratch)
+{
+	p = skipSpace(p, end);
+	if(p == end || *p != '"')
+	{
+		const char* comma = (const char*)memchr(p, ',', end - p);
+		if(!comma)
+			comma = end;
+		value = string_view(p, trimSpace(p, comma) - p);
+		return comma;
+	}
+
+	// Find the closing quote, passing over doubled quotes
+	const char* begin = ++p;
+	bool doubled = false;
+	while(true)
+	{
+		p = (const char*)memchr(p, '"', end - p);
+		if(!p)
+			return NULL;
+		if(p + 1 == end || p[1] != '"')
+			break;
+		doubled = true;
+		p += 2;
+	}
+	if(doubled)
+	{
+		scratch.clear();
+		for(const char* q = begin; q != p; q++)
+		{
+			scratch.push_back(*q);
+			if(*q == '"')
+				q++;
+		}
+		value = scratch;
+	}
+	else
+		value = string_view(begin, p - begin);
+
+	// Only spaces may come between the closing quote and the comma
+	p = skipSpace(p + 1, end);
+	if(p != end && *p != ',')
+		return NULL;
+	return p;
+}
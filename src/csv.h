@@ -0,0 +1,97 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef CSV_H
+#define CSV_H
+
+#include "matrix.h"
+#include "dictionary.h"
+#include "inputfile.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Loads a CSV file into a Matrix, with the same meta-data that an ARFF
+// file with the same columns would give it. The first line holds the
+// names of the columns, and each other line holds a row. Values are
+// separated by commas, and may be put in double quotes (with a doubled
+// quote for a quote) if they have a comma in them; a quoted value may not
+// span lines. Spaces around a value are ignored, and an empty value or
+// "?" is a missing value.
+//
+// Unless a schema is given, a column is nominal if any of its values in
+// the first block of the file (about 4 MB per worker thread) is not a
+// number, and continuous otherwise. The type of a column is not revisited
+// later, so a value that is not a number in a continuous column after the
+// first block is an error; such a file needs a schema. The values of a
+// nominal column are enumerated in the order in which they first appear. A
+// schema (such as the header of an ARFF file) gives the columns and their
+// values instead, so a CSV file can be read with the same enumerations as
+// a training set.
+//
+// Like ArffParser, the file is read in large blocks (see LineReader), and
+// each block is split into newline-aligned chunks that are parsed
+// concurrently. Values that are not yet in a dictionary are collected by
+// each chunk, and enumerated in order when the chunks are appended.
+class CsvParser
+{
+private:
+	// The rows parsed from one newline-aligned piece of a block
+	struct Chunk : public LineChunk
+	{
+		std::vector<double> data; // the elements of the rows
+		std::vector<Dictionary> newValues; // the values of each nominal column that were not in its dictionary, numbered in the order they were found
+		std::vector<size_t> newPositions; // the position in data of each element that holds one of newValues
+		std::vector<size_t> missing; // the number of elements of each column that are UNKNOWN_VALUE
+		std::string scratch; // where doubled quotes are undone (see nextValue)
+	};
+
+	Matrix& m_matrix;
+	Matrix* m_pSchema;
+	Matrix::Layout m_layout;
+	size_t m_lineNum;
+	std::vector<bool> m_nominal; // whether each column is nominal
+	std::vector<const Dictionary*> m_dictionaries; // value to enumeration, for each column
+	std::vector<size_t> m_missing; // the number of elements of each column of the matrix that are UNKNOWN_VALUE
+
+public:
+	// Reads into matrix. If pSchema is non-NULL, the file must have the
+	// same number of columns as it, and nominal values are looked up in its
+	// dictionaries. The elements are put in the specified layout (a
+	// spilled matrix is written to its file as the blocks are parsed, and a
+	// compact one is converted once the whole file has been read).
+	CsvParser(Matrix& matrix, Matrix* pSchema = NULL, Matrix::Layout layout = Matrix::DENSE);
+
+	// Reads the specified file into the matrix. (Anything that was already
+	// in the matrix is replaced.)
+	void load(const std::string& filename);
+
+private:
+	// Parses the line of column names at the start of the block, and
+	// decides which columns are nominal from the lines after it. Returns a
+	// pointer to the line after the names, or NULL if the block has only
+	// blank lines.
+	const char* parseHeader(const char* begin, const char* end);
+
+	// Parses the lines in [begin, end) and appends them to the matrix
+	void parseBlock(const char* begin, const char* end);
+
+	// Parses one line, appending one value per column to chunk.data.
+	// Returns false, and describes the problem in chunk.error, if it fails.
+	// (This is called concurrently for different chunks.)
+	bool parseLine(const char* begin, const char* end, Chunk& chunk) const;
+
+	// Finds the value that starts at p, which ends at the next comma that
+	// is not in quotes (or at end). Sets value to it, without its quotes or
+	// the spaces around it. (If it had doubled quotes, they are undone in
+	// scratch, which value then refers to.) Returns a pointer to the comma
+	// after it (or end), or NULL if a quote is not closed.
+	static const char* nextValue(const char* p, const char* end, std::string_view& value, std::string& scratch);
+
+	// Returns true if the value is a missing value
+	static bool isMissing(std::string_view value) { return value.empty() || value == "?"; }
+};
+
+#endif // CSV_H
@@ -0,0 +1,164 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "matrix.h"
+#include "arff.h"
+#include "parallel.h"
+#include "error.h"
+#include "tests/include/gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    std::string writeFile(const std::string& filename, const std::string& contents)
+    {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        out << contents;
+        return filename;
+    }
+}
+
+TEST(CsvParserTest, infersColumnsAndParsesQuotes)
+{
+    std::string filename = writeFile("csv_unittest.tmp.csv",
+        "\r\n"
+        "width, \"color\",class\r\n"
+        "1.5, green,no\r\n"
+        "\r\n"
+        "?,\"blue, dark\", yes\r\n"
+        "-2e3,\"say \"\"hi\"\"\",\r\n");
+    Matrix m;
+    m.loadCSV(filename);
+    ASSERT_EQ(3u, m.rows());
+    ASSERT_EQ(3u, m.cols());
+    EXPECT_EQ("color", m.attrName(1));
+    EXPECT_EQ(0u, m.valueCount(0));
+    ASSERT_EQ(3u, m.valueCount(1));
+    EXPECT_EQ("blue, dark", m.attrValue(1, 1));
+    EXPECT_EQ("say \"hi\"", m.attrValue(1, 2));
+    EXPECT_EQ(1.5, m[0][0]);
+    EXPECT_EQ(UNKNOWN_VALUE, m[1][0]);
+    EXPECT_EQ(-2000.0, m[2][0]);
+    EXPECT_EQ(1.0, m[1][2]);
+    EXPECT_EQ(UNKNOWN_VALUE, m[2][2]);
+
+    // A row with too few values is reported with its line number
+    writeFile(filename, "a,b\n1,2\n3\n");
+    try
+    {
+        m.loadCSV(filename);
+        FAIL();
+    }
+    catch (const std::exception& e)
+    {
+        EXPECT_NE(std::string::npos, std::string(e.what()).find("on line 3"));
+    }
+    remove(filename.c_str());
+}
+
+TEST(CsvParserTest, readsWithSchema)
+{
+    std::string filename = writeFile("csv_unittest.tmp.csv",
+        "width,color,class\n"
+        "1,green,yes\n"
+        "2,red,no\n");
+    std::string schemaFile = writeFile("csv_unittest.tmp.arff",
+        "@relation schema\n"
+        "@attribute width real\n"
+        "@attribute color {red,green,blue}\n"
+        "@attribute class {no,yes}\n"
+        "@data\n");
+    Matrix schema;
+    ArffParser(schema).open(schemaFile);
+    Matrix m;
+    m.loadCSV(filename, &schema, Matrix::COMPACT);
+    ASSERT_EQ(2u, m.rows());
+    EXPECT_TRUE(m.isCompact());
+    EXPECT_EQ(3u, m.valueCount(1));
+    EXPECT_EQ(1.0, m.get(0, 1));
+    EXPECT_EQ(1.0, m.get(0, 2));
+    EXPECT_EQ(0.0, m.get(1, 1));
+    EXPECT_EQ(0.0, m.get(1, 2));
+
+    // Values that are not in the schema are rejected
+    writeFile(filename, "width,color,class\n1,purple,yes\n");
+    EXPECT_THROW(m.loadCSV(filename, &schema), std::exception);
+    writeFile(filename, "width,color\n1,red\n");
+    EXPECT_THROW(m.loadCSV(filename, &schema), std::exception);
+    remove(filename.c_str());
+    remove(schemaFile.c_str());
+}
+
+TEST(CsvParserTest, parallelChunksEnumerateInOrder)
+{
+    // Enough rows to be split into several chunks, with new values in each
+    std::ostringstream os;
+    os << "n,c\n";
+    size_t rows = 50000;
+    for (size_t i = 0; i < rows; ++i)
+        os << i << ",v" << i / 100 << "\n";
+    setWorkerCount(4);
+    Matrix m;
+    std::string filename = writeFile("csv_unittest.tmp.csv", os.str());
+    m.loadCSV(filename);
+    setWorkerCount(0);
+    ASSERT_EQ(rows, m.rows());
+    ASSERT_EQ(rows / 100, m.valueCount(1));
+    for (size_t i = 0; i < rows; ++i)
+    {
+        ASSERT_EQ((double)i, m[i][0]);
+        ASSERT_EQ((double)(i / 100), m[i][1]);
+    }
+    EXPECT_EQ("v7", m.attrValue(1, 7));
+    remove(filename.c_str());
+}
+
+TEST(LibSvmParserTest, readsSparseRowsAndLabels)
+{
+    std::string filename = writeFile("csv_unittest.tmp.libsvm",
+        "# a comment\n"
+        "+1 2:0.5 7:3 # a note\n"
+        "-1 qid:4 1:2\n"
+        "1\n");
+    Matrix m;
+    m.loadLibSVM(filename);
+    ASSERT_EQ(3u, m.rows());
+    ASSERT_EQ(8u, m.cols());
+    EXPECT_TRUE(m.isSparse());
+    EXPECT_EQ("f7", m.attrName(6));
+    ASSERT_EQ(2u, m.valueCount(7));
+    EXPECT_EQ("-1", m.attrValue(7, 0));
+    EXPECT_EQ("1", m.attrValue(7, 1));
+    EXPECT_EQ(0.5, m.get(0, 1));
+    EXPECT_EQ(3.0, m.get(0, 6));
+    EXPECT_EQ(1.0, m.get(0, 7));
+    EXPECT_EQ(2.0, m.get(1, 0));
+    EXPECT_EQ(0.0, m.get(1, 7));
+    EXPECT_EQ(1.0, m.get(2, 7));
+    EXPECT_EQ(0.0, m.get(2, 0));
+
+    // A test set gets the columns of the training set
+    std::string testFile = writeFile("csv_unittest.tmp.svm", "-1 1:4\n");
+    Matrix test;
+    test.loadLibSVM(testFile, &m);
+    ASSERT_EQ(8u, test.cols());
+    EXPECT_EQ(4.0, test.get(0, 0));
+    EXPECT_EQ(0.0, test.get(0, 7));
+    writeFile(testFile, "-1 9:4\n");
+    EXPECT_THROW(test.loadLibSVM(testFile, &m), std::exception);
+    writeFile(testFile, "2 1:4\n");
+    EXPECT_THROW(test.loadLibSVM(testFile, &m), std::exception);
+
+    // Labels that are not whole numbers are continuous
+    writeFile(filename, "0.5 1:1\n-2 1:2\n");
+    m.loadLibSVM(filename);
+    EXPECT_EQ(0u, m.valueCount(1));
+    EXPECT_EQ(-2.0, m.get(1, 1));
+    remove(filename.c_str());
+    remove(testFile.c_str());
+}
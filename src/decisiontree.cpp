@@ -37,13 +37,13 @@ void DecisionTree::train(Matrix& features, Matrix& labels)
 }
 
 
-void DecisionTree::predict(const std::vector<double>& features, std::vector<double>& labels)
+void DecisionTree::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
     this->dive(root, features, labels);
 }
 
 
-void DecisionTree::dive(TreeNode::NodePtr node, const std::vector<double>& features, std::vector<double>& labels)
+void DecisionTree::dive(TreeNode::NodePtr node, const std::vector<double>& features, std::vector<double>& labels) const
 {
     // if the current node is a leaf node
     if (node->isLeaf())
@@ -108,10 +108,26 @@ bool DecisionTree::partition(TreeNode::NodePtr node, Matrix& features, Matrix& l
     double entropy = this->calculateEntropy(features, labels);
     double maxGain = 0;
     size_t maxAttr = 0;
+    std::vector<size_t> table;
 
     // for each attribute
     for (size_t attr = 0; attr < features.cols(); ++attr)
     {
+        // count the labels for each value in one pass, if they are all nominal
+        if (features.countValues(attr, labels, 0, table))
+        {
+            double info;
+            if (!this->splitInfo(table, features.valueCount(attr), labels.valueCount(0), dblrows, info))
+                continue;
+            double gain = entropy - info;
+            if (gain > maxGain)
+            {
+                maxGain = gain;
+                maxAttr = attr;
+            }
+            continue;
+        }
+
         std::map<double, size_t> counts = features.getValueCounts(attr);
 
         // if there is only one value, this attribute doesn't help at all. Just skip it.
@@ -129,11 +145,10 @@ bool DecisionTree::partition(TreeNode::NodePtr node, Matrix& features, Matrix& l
             if (it->first != UNKNOWN_VALUE)
                 value = it->first;
 
-            // get reduced matrices
-            Matrix reducedFeatures;
-            Matrix reducedLabels;
-            std::vector<size_t> rowIndices = features.copyReduce(reducedFeatures, attr, value);
-            labels.copyReduce(reducedLabels, rowIndices);
+            // get views of the matching rows (without copying them)
+            std::vector<size_t> rowIndices = features.getRowsWithAttrValues(attr, value);
+            MatrixView reducedFeatures(features, rowIndices, attr);
+            MatrixView reducedLabels(labels, rowIndices);
 
             // get rows in reduced matrix
             size_t redRows = reducedFeatures.rows();
@@ -177,11 +192,10 @@ bool DecisionTree::partition(TreeNode::NodePtr node, Matrix& features, Matrix& l
         TreeNode::NodePtr newNode = node->add();
         newNode->setValue(value, features.attrValue(maxAttr, value));
 
-        // get reduced matrices (again?)
-        Matrix reducedFeatures;
-        Matrix reducedLabels;
-        std::vector<size_t> rowIndices = features.copyReduce(reducedFeatures, maxAttr, value);
-        labels.copyReduce(reducedLabels, rowIndices);
+        // get views of the matching rows, without the attribute we split on
+        std::vector<size_t> rowIndices = features.getRowsWithAttrValues(maxAttr, value);
+        MatrixView reducedFeatures(features, rowIndices, maxAttr);
+        MatrixView reducedLabels(labels, rowIndices);
 
         // call partition with that node and reduced matrices
         bool labeled = this->partition(newNode, reducedFeatures, reducedLabels);
@@ -262,6 +276,10 @@ bool DecisionTree::prune(TreeNode::NodePtr node, Matrix& valFeatures, Matrix& va
 
 double DecisionTree::calculateEntropy(Matrix& features, Matrix& labels)
 {
+    std::vector<size_t> labelCounts;
+    if (labels.countValues(0, labelCounts))
+        return this->entropy(&labelCounts[0], labels.valueCount(0), labels.rows());
+
     std::map<double, size_t> counts = labels.getValueCounts(0);
     double numRows = labels.rows();
 
@@ -276,3 +294,49 @@ double DecisionTree::calculateEntropy(Matrix& features, Matrix& labels)
 
     return entropy;
 }
+
+
+double DecisionTree::entropy(const size_t* counts, size_t labelValues, double rows)
+{
+    double entropy = 0.0;
+    for (size_t i = 0; i <= labelValues; ++i)
+    {
+        size_t count = counts[i == 0 ? labelValues : i - 1]; // (UNKNOWN_VALUE comes first, as in a map)
+        if (count == 0)
+            continue;
+        double p = count / rows;
+        entropy += p * log2 (p);
+    }
+    entropy *= -1;
+
+    return entropy;
+}
+
+
+bool DecisionTree::splitInfo(const std::vector<size_t>& table, size_t values, size_t labelValues, double rows, double& info)
+{
+    // count the rows with each value
+    size_t width = labelValues + 1;
+    std::vector<size_t> valueRows(values + 1, 0);
+    size_t present = 0;
+    for (size_t v = 0; v <= values; ++v)
+    {
+        for (size_t c = 0; c < width; ++c)
+            valueRows[v] += table[v * width + c];
+        if (valueRows[v] > 0)
+            present++;
+    }
+    if (present == 1)
+        return false;
+
+    // rows with an unknown value add nothing, since they match no child
+    info = 0.0;
+    for (size_t v = 0; v < values; ++v)
+    {
+        if (valueRows[v] == 0)
+            continue;
+        double rowRatio = (double) valueRows[v] / rows;
+        info += rowRatio * this->entropy(&table[v * width], labelValues, valueRows[v]);
+    }
+    return true;
+}
@@ -21,10 +21,13 @@ public:
 	// Train the model to predict the labels
 	void train(Matrix&, Matrix&);
 
+	// Returns an untrained tree
+	SupervisedLearner* clone(Rand& r) { return new DecisionTree(r); }
+
 	// Evaluate the features and predict the labels
-	void predict(const std::vector<double>&, std::vector<double>&);
+	void predict(const std::vector<double>&, std::vector<double>&) const;
 
-    void dive(TreeNode::NodePtr node, const std::vector<double>& features, std::vector<double>& labels);
+    void dive(TreeNode::NodePtr node, const std::vector<double>& features, std::vector<double>& labels) const;
 
 	bool partition(TreeNode::NodePtr, Matrix&, Matrix&);
 
@@ -45,6 +48,15 @@ private:
 
     double calculateEntropy(Matrix&, Matrix&);
 
+    // Returns the entropy of labels with the given counts (see Matrix::countValues),
+    // adding the terms in the same order as calculateEntropy
+    double entropy(const size_t* counts, size_t labelValues, double rows);
+
+    // Computes the info of splitting on an attribute from its contingency table
+    // against the labels (see Matrix::countValues). Returns false if the attribute
+    // has only one value, so splitting on it doesn't help.
+    bool splitInfo(const std::vector<size_t>& table, size_t values, size_t labelValues, double rows, double& info);
+
 };
 
 #endif // DECISIONTREE_H
@@ -0,0 +1,52 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "dictionary.h"
+
+const size_t Dictionary::NOT_FOUND;
+
+void Dictionary::set(std::string_view key, size_t e)
+{
+	if(2 * (m_keys.size() + 1) > m_slots.size())
+		rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+	size_t h = hash(key);
+	size_t mask = m_slots.size() - 1;
+	size_t i = h & mask;
+	for( ; m_slots[i].entry != NOT_FOUND; i = (i + 1) & mask)
+	{
+		if(m_slots[i].hash == h && m_keys[m_slots[i].entry] == key)
+		{
+			m_values[m_slots[i].entry] = e;
+			return;
+		}
+	}
+	m_slots[i].hash = h;
+	m_slots[i].entry = m_keys.size();
+	m_keys.push_back(std::string(key));
+	m_values.push_back(e);
+}
+
+void Dictionary::clear()
+{
+	m_keys.clear();
+	m_values.clear();
+	m_slots.clear();
+}
+
+void Dictionary::rehash(size_t slots)
+{
+	Slot empty = { 0, NOT_FOUND };
+	m_slots.assign(slots, empty);
+	size_t mask = slots - 1;
+	for(size_t j = 0; j < m_keys.size(); j++)
+	{
+		size_t h = hash(m_keys[j]);
+		size_t i = h & mask;
+		while(m_slots[i].entry != NOT_FOUND)
+			i = (i + 1) & mask;
+		m_slots[i].hash = h;
+		m_slots[i].entry = j;
+	}
+}
@@ -0,0 +1,81 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps the values of a nominal attribute to their enumerations. The
+// entries are kept in insertion order in two flat arrays, and found
+// through an open-addressing hash table (with linear probing) of their
+// positions. Lookups take a string_view, so finding a value that was just
+// parsed from a buffer neither allocates nor does any string compares
+// other than the one that matches.
+class Dictionary
+{
+private:
+	// One position in the hash table
+	struct Slot
+	{
+		size_t hash; // the hash of the key of the entry
+		size_t entry; // the position of the entry in m_keys and m_values, or NOT_FOUND if the slot is empty
+	};
+
+	std::vector<std::string> m_keys;
+	std::vector<size_t> m_values;
+	std::vector<Slot> m_slots; // the size is zero or a power of two, and at least twice the number of entries
+
+public:
+	// What find returns for a key that is not in the dictionary
+	static const size_t NOT_FOUND = (size_t)-1;
+
+	// Returns the number of entries
+	size_t size() const { return m_keys.size(); }
+
+	// Returns true if there are no entries
+	bool empty() const { return m_keys.empty(); }
+
+	// Returns the enumeration of the specified value, or NOT_FOUND
+	size_t find(std::string_view key) const
+	{
+		if(m_slots.empty())
+			return NOT_FOUND;
+		size_t h = hash(key);
+		size_t mask = m_slots.size() - 1;
+		for(size_t i = h & mask; ; i = (i + 1) & mask)
+		{
+			const Slot& slot = m_slots[i];
+			if(slot.entry == NOT_FOUND)
+				return NOT_FOUND;
+			if(slot.hash == h && m_keys[slot.entry] == key)
+				return m_values[slot.entry];
+		}
+	}
+
+	// Maps the specified value to e, replacing what it was mapped to before (if anything)
+	void set(std::string_view key, size_t e);
+
+	// Removes all the entries
+	void clear();
+
+	// Returns the value of the entry at the specified position in insertion order
+	const std::string& key(size_t entry) const { return m_keys[entry]; }
+
+	// Returns the enumeration of the entry at the specified position in insertion order
+	size_t value(size_t entry) const { return m_values[entry]; }
+
+private:
+	static size_t hash(std::string_view key) { return std::hash<std::string_view>()(key); }
+
+	// Rebuilds the hash table with the specified number of slots
+	void rehash(size_t slots);
+};
+
+#endif // DICTIONARY_H
@@ -0,0 +1,30 @@
+#include "dictionary.h"
+#include <string>
+#include "tests/include/gtest/gtest.h"
+
+TEST(DictionaryTest, findsByStringView)
+{
+    Dictionary d;
+    EXPECT_EQ(Dictionary::NOT_FOUND, d.find("a"));
+
+    // Enough entries to rehash several times
+    for (size_t i = 0; i < 1000; ++i)
+        d.set("value" + std::to_string(i), i);
+    ASSERT_EQ(1000u, d.size());
+    const char* line = "x,value123,y";
+    EXPECT_EQ(123u, d.find(std::string_view(line + 2, 8)));
+    EXPECT_EQ(12u, d.find(std::string_view(line + 2, 7)));
+    EXPECT_EQ(Dictionary::NOT_FOUND, d.find(std::string_view(line, 7)));
+    EXPECT_EQ(Dictionary::NOT_FOUND, d.find(""));
+
+    // Setting a key again replaces its value, and keeps its place
+    d.set("value5", 77);
+    EXPECT_EQ(1000u, d.size());
+    EXPECT_EQ(77u, d.find("value5"));
+    EXPECT_EQ("value5", d.key(5));
+    EXPECT_EQ(77u, d.value(5));
+
+    d.clear();
+    EXPECT_TRUE(d.empty());
+    EXPECT_EQ(Dictionary::NOT_FOUND, d.find("value5"));
+}
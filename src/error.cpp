@@ -16,25 +16,24 @@ using std::exception;
 using std::string;
 using std::cerr;
 
-string g_errorMessage;
-
+// Each exception carries its own message, so that threads can throw them at the same time
 class MLException : public exception
 {
+	string m_message;
+
 public:
+	MLException(const string& message) : m_message(message) {}
+
 	virtual const char* what() const throw()
 	{
-		return g_errorMessage.c_str();
+		return m_message.c_str();
 	}
 };
 
-MLException g_exception;
-
 void ThrowError(string s1)
 {
-	g_errorMessage = s1;
-
 	// This is a really good place to put a breakpoint.
-	throw g_exception;
+	throw MLException(s1);
 }
 
 
@@ -5,12 +5,13 @@
 
 #include "filter.h"
 #include "error.h"
+#include "simd.h"
 #include <memory>
 #include <math.h>
 #include <algorithm>
 
 using std::vector;
-using std::auto_ptr;
+using std::unique_ptr;
 
 
 // virtual
@@ -18,14 +19,14 @@ void Filter::train(Matrix& features, Matrix& labels)
 {
 	trainFilter(features, labels);
 	Matrix* pTrainFeatures = filterFeatures(features);
-	auto_ptr<Matrix> apTrainFeatures(pTrainFeatures);
+	unique_ptr<Matrix> apTrainFeatures(pTrainFeatures);
 	Matrix* pTrainLabels = filterLabels(labels);
-	auto_ptr<Matrix> apTrainLabels(pTrainLabels);
+	unique_ptr<Matrix> apTrainLabels(pTrainLabels);
 	m_pInnerModel->train(*pTrainFeatures, *pTrainLabels);
 }
 
 // virtual
-void Filter::predict(const std::vector<double>& features, std::vector<double>& labels)
+void Filter::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
 	vector<double> feat2 = filterFeatures(features);
 	vector<double> lab2;
@@ -34,6 +35,31 @@ void Filter::predict(const std::vector<double>& features, std::vector<double>& l
 	unfilterLabels(lab2, labels);
 }
 
+// virtual
+void Filter::predictBatch(Matrix& features, Matrix& labels) const
+{
+	if(labels.rows() != features.rows())
+		ThrowError("Expected a row of labels for each row of features");
+
+	// Filter the whole batch, so the inner model can predict it as a batch too
+	Matrix* pFeatures = filterFeatures(features);
+	unique_ptr<Matrix> apFeatures(pFeatures);
+	Matrix innerLabels;
+	innerLabels.setSize(features.rows(), filteredLabelDims());
+	m_pInnerModel->predictBatch(*pFeatures, innerLabels);
+
+	vector<double> lab2;
+	vector<double> after;
+	for(size_t i = 0; i < features.rows(); i++)
+	{
+		innerLabels.getRow(i, lab2);
+		labels.getRow(i, after);
+		unfilterLabels(lab2, after);
+		for(size_t j = 0; j < after.size(); j++)
+			labels[i][j] = after[j];
+	}
+}
+
 
 
 
@@ -53,21 +79,80 @@ void Normalize::trainFilter(Matrix& features, Matrix& labels)
 	m_featureMins.clear();
 	m_featureMaxs.clear();
 	size_t c = features.cols();
- 	m_featureMins.reserve(c);
-	m_featureMaxs.reserve(c);
+	if(features.isSparse())
+	{
+		// Compute the min and max of every column in one pass over the
+		// nonzero elements, then account for the zeros
+		m_featureMins.assign(c, 1e300);
+		m_featureMaxs.assign(c, -1e300);
+		vector<size_t> counts(c, 0);
+		for(size_t i = 0; i < features.rows(); i++)
+		{
+			Matrix::SparseRow row = features.sparseRow(i);
+			for(size_t j = 0; j < row.size(); j++)
+			{
+				size_t col = row.col(j);
+				double val = row.value(j);
+				counts[col]++;
+				if(val != UNKNOWN_VALUE)
+				{
+					m_featureMins[col] = std::min(m_featureMins[col], val);
+					m_featureMaxs[col] = std::max(m_featureMaxs[col], val);
+				}
+			}
+		}
+		for(size_t i = 0; i < c; i++)
+		{
+			if(features.valueCount(i) != 0)
+			{
+				// Don't do nominal attributes
+				m_featureMins[i] = UNKNOWN_VALUE;
+				m_featureMaxs[i] = UNKNOWN_VALUE;
+			}
+			else if(counts[i] < features.rows())
+			{
+				m_featureMins[i] = std::min(m_featureMins[i], 0.0);
+				m_featureMaxs[i] = std::max(m_featureMaxs[i], 0.0);
+			}
+		}
+	}
+	else
+	{
+		m_featureMins.reserve(c);
+		m_featureMaxs.reserve(c);
+		for(size_t i = 0; i < c; i++)
+		{
+			if(features.valueCount(i) == 0)
+			{
+				// Compute the min and max
+				m_featureMins.push_back(features.columnMin(i));
+				m_featureMaxs.push_back(features.columnMax(i));
+			}
+			else
+			{
+				// Don't do nominal attributes
+				m_featureMins.push_back(UNKNOWN_VALUE);
+				m_featureMaxs.push_back(UNKNOWN_VALUE);
+			}
+		}
+	}
+	m_shiftedCols.clear();
+	m_shift.resize(c);
+	m_scale.resize(c);
 	for(size_t i = 0; i < c; i++)
 	{
-		if(features.valueCount(i) == 0)
+		if(m_featureMins[i] != UNKNOWN_VALUE && normalize(i, 0.0) != 0.0)
+			m_shiftedCols.push_back(i);
+		if(m_featureMins[i] == UNKNOWN_VALUE)
 		{
-			// Compute the min and max
-			m_featureMins.push_back(features.columnMin(i));
-			m_featureMaxs.push_back(features.columnMax(i));
+			// (x - 0) / 1 is exactly x, so nominal values pass through unchanged
+			m_shift[i] = 0.0;
+			m_scale[i] = 1.0;
 		}
 		else
 		{
-			// Don't do nominal attributes
-			m_featureMins.push_back(UNKNOWN_VALUE);
-			m_featureMaxs.push_back(UNKNOWN_VALUE);
+			m_shift[i] = m_featureMins[i];
+			m_scale[i] = std::max(1e-12, m_featureMaxs[i] - m_featureMins[i]);
 		}
 	}
 	if(labels.cols() != 1)
@@ -101,29 +186,74 @@ Matrix* Normalize::filterLabels(Matrix& labels)
 }
 
 // virtual
-vector<double> Normalize::filterFeatures(const vector<double>& before)
+vector<double> Normalize::filterFeatures(const vector<double>& before) const
+{
+	vector<double> after;
+	filterFeatures(before, after);
+	return after;
+}
+
+void Normalize::filterFeatures(const vector<double>& before, vector<double>& after) const
 {
 	if(before.size() != m_featureMins.size())
 		ThrowError("Unexpected feature vector size");
-	vector<double> after;
-	after.reserve(before.size());
-	for(size_t c = 0; c < m_featureMins.size(); c++)
+	after.resize(before.size());
+	simdShiftScale(before.data(), after.data(), m_shift.data(), m_scale.data(), before.size());
+}
+
+double Normalize::normalize(size_t col, double value) const
+{
+	if(m_featureMins[col] == UNKNOWN_VALUE) // if the attribute is nominal...
+		return value;
+	if(value == UNKNOWN_VALUE)
+		return UNKNOWN_VALUE;
+	return (value - m_featureMins[col]) / std::max(1e-12, m_featureMaxs[col] - m_featureMins[col]);
+}
+
+void Normalize::filterFeatures(const Matrix::SparseRow& before, vector<size_t>& cols, vector<double>& values) const
+{
+	if(before.width() != m_featureMins.size())
+		ThrowError("Unexpected feature vector size");
+	cols.clear();
+	values.clear();
+
+	// Merge the nonzero elements with the columns where a zero does not stay zero
+	size_t s = 0;
+	for(size_t i = 0; i <= before.size(); i++)
 	{
-		if(m_featureMins[c] == UNKNOWN_VALUE) // if the attribute is nominal...
-			after.push_back(before[c]);
-		else
+		size_t col = i < before.size() ? before.col(i) : before.width();
+		for( ; s < m_shiftedCols.size() && m_shiftedCols[s] < col; s++)
 		{
-			if(before[c] == UNKNOWN_VALUE)
-				after.push_back(UNKNOWN_VALUE);
-			else
-				after.push_back((before[c] - m_featureMins[c]) / std::max(1e-12, m_featureMaxs[c] - m_featureMins[c]));
+			cols.push_back(m_shiftedCols[s]);
+			values.push_back(normalize(m_shiftedCols[s], 0.0));
+		}
+		if(i == before.size())
+			break;
+		if(s < m_shiftedCols.size() && m_shiftedCols[s] == col)
+			s++;
+		double val = normalize(col, before.value(i));
+		if(val != 0.0)
+		{
+			cols.push_back(col);
+			values.push_back(val);
 		}
 	}
-	return after;
 }
 
 // virtual
-void Normalize::unfilterLabels(vector<double>& before, vector<double>& after)
+void Normalize::predictSparse(const Matrix::SparseRow& features, vector<double>& labels) const
+{
+	vector<size_t> cols;
+	vector<double> values;
+	filterFeatures(features, cols, values);
+	vector<double> lab2;
+	lab2.resize(filteredLabelDims());
+	m_pInnerModel->predictSparse(Matrix::SparseRow(cols.data(), values.data(), cols.size(), features.width()), lab2);
+	unfilterLabels(lab2, labels);
+}
+
+// virtual
+void Normalize::unfilterLabels(vector<double>& before, vector<double>& after) const
 {
 	if(before.size() != 1 || after.size() != 1)
 		ThrowError("Unexpected label vector size");
@@ -133,13 +263,27 @@ void Normalize::unfilterLabels(vector<double>& before, vector<double>& after)
 		after[0] = before[0] * (m_labelMax - m_labelMin) + m_labelMin;
 }
 
-Matrix* Normalize::filterFeatures(Matrix& features)
+Matrix* Normalize::filterFeatures(Matrix& features) const
 {
 	Matrix* pOut = new Matrix(features);
+	if(features.isSparse())
+	{
+		vector<size_t> cols;
+		vector<double> values;
+		for(size_t i = 0; i < features.rows(); i++)
+		{
+			filterFeatures(features.sparseRow(i), cols, values);
+			pOut->copyRow(Matrix::SparseRow(cols.data(), values.data(), cols.size(), features.cols()));
+		}
+		return pOut;
+	}
+	vector<double> before;
+	vector<double> after;
 	for(size_t i = 0; i < features.rows(); i++)
 	{
-		vector<double> row = filterFeatures(features[i]);
-		pOut->copyRow(row);
+		features.getRow(i, before);
+		filterFeatures(before, after);
+		pOut->copyRow(after);
 	}
 	return pOut;
 }
@@ -207,13 +351,13 @@ Matrix* NominalToCategorical::filterLabels(Matrix& labels)
 }
 
 // virtual
-vector<double> NominalToCategorical::filterFeatures(const vector<double>& before)
+vector<double> NominalToCategorical::filterFeatures(const vector<double>& before) const
 {
 	if(before.size() != m_featureVals.size())
 		ThrowError("Unexpected feature vector size");
 	vector<double> after;
 	vector<double>::const_iterator bef = before.begin();
-	vector<size_t>::iterator vals = m_featureVals.begin();
+	vector<size_t>::const_iterator vals = m_featureVals.begin();
 	while(bef != before.end())
 	{
 		if(*vals == 1) // If the value is continuous...
@@ -250,7 +394,7 @@ vector<double> NominalToCategorical::filterFeatures(const vector<double>& before
 }
 
 // virtual
-void NominalToCategorical::unfilterLabels(vector<double>& before, vector<double>& after)
+void NominalToCategorical::unfilterLabels(vector<double>& before, vector<double>& after) const
 {
 	if(before.size() != m_labelVals || after.size() != 1)
 		ThrowError("Unexpected label vector size");
@@ -267,13 +411,15 @@ void NominalToCategorical::unfilterLabels(vector<double>& before, vector<double>
 	}
 }
 
-Matrix* NominalToCategorical::filterFeatures(Matrix& features)
+Matrix* NominalToCategorical::filterFeatures(Matrix& features) const
 {
 	Matrix* pOut = new Matrix();
 	pOut->setSize(0, m_totalFeatureVals);
+	vector<double> before;
 	for(size_t i = 0; i < features.rows(); i++)
 	{
-		vector<double> row = filterFeatures(features[i]);
+		features.getRow(i, before);
+		vector<double> row = filterFeatures(before);
 		pOut->copyRow(row);
 	}
 	return pOut;
@@ -330,7 +476,7 @@ Matrix* Discretize::filterLabels(Matrix& labels)
 }
 
 // virtual
-std::vector<double> Discretize::filterFeatures(const std::vector<double>& before)
+std::vector<double> Discretize::filterFeatures(const std::vector<double>& before) const
 {
 	if(before.size() != m_featureMins.size())
 		ThrowError("Unexpected row size");
@@ -355,18 +501,20 @@ std::vector<double> Discretize::filterFeatures(const std::vector<double>& before
 }
 
 // virtual
-void Discretize::unfilterLabels(std::vector<double>& before, std::vector<double>& after)
+void Discretize::unfilterLabels(std::vector<double>& before, std::vector<double>& after) const
 {
 	after[0] = before[0];
 }
 
-Matrix* Discretize::filterFeatures(Matrix& features)
+Matrix* Discretize::filterFeatures(Matrix& features) const
 {
 	Matrix* pOut = new Matrix(features);
 	pOut->makeContinuousAttrsNominal(m_bins);
+	vector<double> before;
 	for(size_t i = 0; i < features.rows(); i++)
 	{
-		vector<double> row = filterFeatures(features[i]);
+		features.getRow(i, before);
+		vector<double> row = filterFeatures(before);
 		pOut->copyRow(row);
 	}
 	return pOut;
@@ -30,26 +30,34 @@ public:
 
 	// Filters the features, makes a prediction, then unfilters the label(s).
 	// (This is a required method of the SupervisedLearner class.)
-	virtual void predict(const std::vector<double>& features, std::vector<double>& labels);
+	virtual void predict(const std::vector<double>& features, std::vector<double>& labels) const;
+
+	// Filters a batch of features (as filterFeatures does a training set),
+	// has the inner model predict them as a batch, then unfilters each row
+	// of labels
+	virtual void predictBatch(Matrix& features, Matrix& labels) const;
+
+	// (Filtering only reads what trainFilter computed, so this is up to the inner model)
+	virtual bool canPredictConcurrently() const { return m_pInnerModel->canPredictConcurrently(); }
 
 	// Trains the filter. (This method is called from train. It prepares
 	// the filter to do its job.)
 	virtual void trainFilter(Matrix& features, Matrix& labels) = 0;
 
 	// Filters the features prior to training the inner model
-	virtual Matrix* filterFeatures(Matrix& features) = 0;
+	virtual Matrix* filterFeatures(Matrix& features) const = 0;
 
 	// Filters the labels prior to training the inner model
 	virtual Matrix* filterLabels(Matrix& labels) = 0;
 
 	// Returns the size of the filtered label vector.
-	virtual size_t filteredLabelDims() = 0;
+	virtual size_t filteredLabelDims() const = 0;
 
 	// Filters a single feature vector prior to making a prediction.
-	virtual std::vector<double> filterFeatures(const std::vector<double>& before) = 0;
+	virtual std::vector<double> filterFeatures(const std::vector<double>& before) const = 0;
 
 	// Unfilters the predicted label(s).
-	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after) = 0;
+	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after) const = 0;
 
 };
 
@@ -75,11 +83,17 @@ public:
 // |                  |                  |                |__________|  |
 // |__________________|                  |______________________________|
 //
+// Sparse features stay sparse. Only the nonzero elements are visited,
+// except in the (few) continuous columns whose minimum is not zero, where
+// a zero does not stay zero.
 class Normalize : public Filter
 {
 private:
 	std::vector<double> m_featureMins;
 	std::vector<double> m_featureMaxs;
+	std::vector<size_t> m_shiftedCols; // the continuous columns in which zero is not normalized to zero
+	std::vector<double> m_shift; // what to subtract from each column (0 for nominal columns)
+	std::vector<double> m_scale; // what to divide each column by after that (1 for nominal columns)
 	double m_labelMin;
 	double m_labelMax;
 
@@ -87,23 +101,40 @@ public:
 	Normalize(SupervisedLearner* pInnerModel) : Filter(pInnerModel) {}
 	virtual ~Normalize() {}
 
+	// Returns an untrained filter around a clone of the inner model
+	virtual SupervisedLearner* clone(Rand& r) { return new Normalize(m_pInnerModel->clone(r)); }
+
 	// Computes the min and max of each column
 	virtual void trainFilter(Matrix& features, Matrix& labels);
 
 	// Normalize continuous features in the training set
-	virtual Matrix* filterFeatures(Matrix& features);
+	virtual Matrix* filterFeatures(Matrix& features) const;
 
 	// Normalize continuous values to fall from 0 to 1
 	virtual Matrix* filterLabels(Matrix& labels);
 
 	// Returns 1.
-	virtual size_t filteredLabelDims() { return 1; }
+	virtual size_t filteredLabelDims() const { return 1; }
 
 	// Normalize continuous values to fall from 0 to 1
-	virtual std::vector<double> filterFeatures(const std::vector<double>& before);
+	virtual std::vector<double> filterFeatures(const std::vector<double>& before) const;
 
 	// De-normalize continuous values back to their original range
-	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after);
+	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after) const;
+
+	// Normalizes a sparse row, and passes it on to the inner model as a sparse row
+	virtual void predictSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const;
+
+private:
+	// Normalizes one element of the specified column
+	double normalize(size_t col, double value) const;
+
+	// Normalizes a dense row. (The same as normalize on each element, but with vector instructions.)
+	void filterFeatures(const std::vector<double>& before, std::vector<double>& after) const;
+
+	// Normalizes a sparse row, putting the columns and values of the
+	// elements that are not zero in cols and values
+	void filterFeatures(const Matrix::SparseRow& before, std::vector<size_t>& cols, std::vector<double>& values) const;
 };
 
 
@@ -158,23 +189,26 @@ public:
 	NominalToCategorical(SupervisedLearner* pInnerModel) : Filter(pInnerModel), m_cap(16) {}
 	virtual ~NominalToCategorical() {}
 
+	// Returns an untrained filter around a clone of the inner model
+	virtual SupervisedLearner* clone(Rand& r) { return new NominalToCategorical(m_pInnerModel->clone(r)); }
+
 	// Decide how many dims are needed for each column
 	virtual void trainFilter(Matrix& features, Matrix& labels);
 
 	// Convert nominal features in the training set to categorical distributions
-	virtual Matrix* filterFeatures(Matrix& features);
+	virtual Matrix* filterFeatures(Matrix& features) const;
 
 	// Convert each label to a categorical distribution
 	virtual Matrix* filterLabels(Matrix& labels);
 
 	// Returns the number of dims used to represent the label
-	virtual size_t filteredLabelDims() { return m_labelVals; }
+	virtual size_t filteredLabelDims() const { return m_labelVals; }
 
 	// Convert all nominal values to a categorical distribution
-	virtual std::vector<double> filterFeatures(const std::vector<double>& before);
+	virtual std::vector<double> filterFeatures(const std::vector<double>& before) const;
 
 	// Convert categorical distributions back to nominal values (by finding the mode)
-	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after);
+	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after) const;
 };
 
 
@@ -194,23 +228,26 @@ public:
 	Discretize(SupervisedLearner* pInnerModel) : Filter(pInnerModel) {}
 	virtual ~Discretize() {}
 
+	// Returns an untrained filter around a clone of the inner model
+	virtual SupervisedLearner* clone(Rand& r) { return new Discretize(m_pInnerModel->clone(r)); }
+
 	// Decides how many bins to use, and computes the min and max of each column.
 	virtual void trainFilter(Matrix& features, Matrix& labels);
 
 	// Bin continuous features in the training set
-	virtual Matrix* filterFeatures(Matrix& features);
+	virtual Matrix* filterFeatures(Matrix& features) const;
 
 	// Discretize the training set
 	virtual Matrix* filterLabels(Matrix& labels);
 
 	// Returns 1
-	virtual size_t filteredLabelDims() { return 1; }
+	virtual size_t filteredLabelDims() const { return 1; }
 
 	// Bins all the continuous values
-	virtual std::vector<double> filterFeatures(const std::vector<double>& before);
+	virtual std::vector<double> filterFeatures(const std::vector<double>& before) const;
 
 	// Copies values straight across. (Throws an exception if there are continuous labels.)
-	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after);
+	virtual void unfilterLabels(std::vector<double>& before, std::vector<double>& after) const;
 };
 
 #endif // FILTER_H
@@ -0,0 +1,369 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "inputfile.h"
+#include "error.h"
+#include <cstring>
+#include <fstream>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif // HAVE_ZLIB
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif // HAVE_ZSTD
+
+using std::string;
+using std::vector;
+
+// The size of the blocks that are decompressed ahead of the reader
+#define INPUT_BLOCK_SIZE (1024 * 1024)
+
+// The number of those blocks
+#define INPUT_BLOCKS 3
+
+// The size of the pieces of compressed input that are read at a time
+#define INPUT_READ_SIZE (256 * 1024)
+
+namespace
+{
+	const unsigned char GZIP_MAGIC[] = { 0x1f, 0x8b };
+	const unsigned char ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+	// Reads the file as it is
+	class PlainDecoder : public Decoder
+	{
+	private:
+		std::ifstream& m_file;
+
+	public:
+		PlainDecoder(std::ifstream& file, const string&) : m_file(file) {}
+
+		virtual size_t decode(char* p, size_t n)
+		{
+			m_file.read(p, n);
+			return m_file.gcount();
+		}
+	};
+
+	// Reads the compressed input of a decoder in pieces
+	class CompressedInput
+	{
+	protected:
+		std::ifstream& m_file;
+		const string& m_filename;
+		vector<char> m_in;
+		bool m_eof;
+
+		CompressedInput(std::ifstream& file, const string& filename)
+		: m_file(file), m_filename(filename), m_in(INPUT_READ_SIZE), m_eof(false) {}
+
+		// Reads the next piece into m_in. Returns the number of bytes read.
+		size_t readPiece()
+		{
+			m_file.read(&m_in[0], m_in.size());
+			m_eof = !m_file;
+			return m_file.gcount();
+		}
+	};
+
+#ifdef HAVE_ZLIB
+	// Decompresses a gzip file (or several gzip files concatenated)
+	class GzipDecoder : public Decoder, private CompressedInput
+	{
+	private:
+		z_stream m_z;
+		bool m_ended; // true at the end of a gzip member
+
+	public:
+		GzipDecoder(std::ifstream& file, const string& filename)
+		: CompressedInput(file, filename), m_ended(false)
+		{
+			memset(&m_z, 0, sizeof(m_z));
+			if(inflateInit2(&m_z, 15 + 16) != Z_OK) // (gzip format only)
+				ThrowError("failed to start decompressing the file: ", filename);
+		}
+
+		virtual ~GzipDecoder()
+		{
+			inflateEnd(&m_z);
+		}
+
+		virtual size_t decode(char* p, size_t n)
+		{
+			m_z.next_out = (Bytef*)p;
+			m_z.avail_out = (uInt)n;
+			while(m_z.avail_out > 0)
+			{
+				if(m_z.avail_in == 0 && !m_eof)
+				{
+					m_z.avail_in = (uInt)readPiece();
+					m_z.next_in = (Bytef*)&m_in[0];
+				}
+				if(m_ended)
+				{
+					if(m_z.avail_in == 0 && m_eof)
+						break;
+					inflateReset(&m_z); // another member follows
+					m_ended = false;
+				}
+				int ret = inflate(&m_z, Z_NO_FLUSH);
+				if(ret == Z_STREAM_END)
+					m_ended = true;
+				else if(ret == Z_BUF_ERROR)
+				{
+					if(m_z.avail_in == 0 && m_eof)
+						ThrowError("The compressed file is truncated: ", m_filename);
+				}
+				else if(ret != Z_OK)
+					ThrowError("The compressed file is corrupt (", m_z.msg ? m_z.msg : "bad data", "): ", m_filename);
+			}
+			return n - m_z.avail_out;
+		}
+	};
+#endif // HAVE_ZLIB
+
+#ifdef HAVE_ZSTD
+	// Decompresses a zstd file (or several zstd frames concatenated)
+	class ZstdDecoder : public Decoder, private CompressedInput
+	{
+	private:
+		ZSTD_DStream* m_pStream;
+		ZSTD_inBuffer m_input;
+		bool m_ended; // true at the end of a frame
+
+	public:
+		ZstdDecoder(std::ifstream& file, const string& filename)
+		: CompressedInput(file, filename), m_pStream(ZSTD_createDStream()), m_ended(false)
+		{
+			if(!m_pStream || ZSTD_isError(ZSTD_initDStream(m_pStream)))
+			{
+				ZSTD_freeDStream(m_pStream);
+				ThrowError("failed to start decompressing the file: ", filename);
+			}
+			m_input.src = &m_in[0];
+			m_input.size = 0;
+			m_input.pos = 0;
+		}
+
+		virtual ~ZstdDecoder()
+		{
+			ZSTD_freeDStream(m_pStream);
+		}
+
+		virtual size_t decode(char* p, size_t n)
+		{
+			ZSTD_outBuffer output = { p, n, 0 };
+			while(output.pos < output.size)
+			{
+				if(m_input.pos == m_input.size && !m_eof)
+				{
+					m_input.size = readPiece();
+					m_input.pos = 0;
+				}
+				size_t outBefore = output.pos;
+				size_t inBefore = m_input.pos;
+				size_t ret = ZSTD_decompressStream(m_pStream, &output, &m_input);
+				if(ZSTD_isError(ret))
+					ThrowError("The compressed file is corrupt (", ZSTD_getErrorName(ret), "): ", m_filename);
+				if(output.pos != outBefore || m_input.pos != inBefore)
+					m_ended = ret == 0;
+				else if(m_input.pos == m_input.size && m_eof)
+				{
+					if(!m_ended)
+						ThrowError("The compressed file is truncated: ", m_filename);
+					break;
+				}
+			}
+			return output.pos;
+		}
+	};
+#endif // HAVE_ZSTD
+
+	bool startsWith(const char* p, size_t n, const unsigned char* magic, size_t len)
+	{
+		return n >= len && memcmp(p, magic, len) == 0;
+	}
+
+	// Owns the file that a decoder reads
+	template<typename T>
+	class FileDecoder : public Decoder
+	{
+	private:
+		std::unique_ptr<std::ifstream> m_pFile;
+		T m_decoder;
+
+	public:
+		FileDecoder(std::unique_ptr<std::ifstream>& pFile, const string& filename)
+		: m_pFile(std::move(pFile)), m_decoder(*m_pFile, filename) {}
+
+		virtual size_t decode(char* p, size_t n) { return m_decoder.decode(p, n); }
+	};
+}
+
+InputFile::InputFile(const string& filename)
+: m_filename(filename), m_compressed(false), m_done(false), m_stop(false), m_pos(0)
+{
+	std::unique_ptr<std::ifstream> pFile(new std::ifstream(filename.c_str(), std::ios::binary));
+	if(!*pFile)
+		ThrowError("failed to open the file: ", filename);
+
+	// Look at the first few bytes to tell what kind of file it is
+	char magic[4];
+	pFile->read(magic, sizeof(magic));
+	size_t got = pFile->gcount();
+	bool gzip = startsWith(magic, got, GZIP_MAGIC, sizeof(GZIP_MAGIC));
+	bool zstd = startsWith(magic, got, ZSTD_MAGIC, sizeof(ZSTD_MAGIC));
+	pFile->clear();
+	pFile->seekg(0);
+	if(!gzip && !zstd)
+	{
+		m_pDecoder.reset(new FileDecoder<PlainDecoder>(pFile, m_filename));
+		return;
+	}
+	m_compressed = true;
+	if(gzip)
+	{
+#ifdef HAVE_ZLIB
+		m_pDecoder.reset(new FileDecoder<GzipDecoder>(pFile, m_filename));
+#else // HAVE_ZLIB
+		ThrowError("This program was built without support for gzip files: ", filename);
+#endif // else HAVE_ZLIB
+	}
+	else
+	{
+#ifdef HAVE_ZSTD
+		m_pDecoder.reset(new FileDecoder<ZstdDecoder>(pFile, m_filename));
+#else // HAVE_ZSTD
+		ThrowError("This program was built without support for zstd files: ", filename);
+#endif // else HAVE_ZSTD
+	}
+
+	// Decompress ahead of the reader
+	m_free.resize(INPUT_BLOCKS);
+	m_thread = std::thread([this]() { decompress(); });
+}
+
+InputFile::~InputFile()
+{
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+}
+
+size_t InputFile::read(char* p, size_t n)
+{
+	if(!m_compressed)
+		return m_pDecoder->decode(p, n);
+	size_t count = 0;
+	while(count < n)
+	{
+		if(m_pos == m_block.size())
+		{
+			// Trade the block that has been read for the next one
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if(m_block.capacity() > 0)
+				m_free.push_back(std::move(m_block));
+			m_block.clear();
+			m_pos = 0;
+			m_cond.notify_all();
+			m_cond.wait(lock, [this]() { return !m_full.empty() || m_done; });
+			if(m_full.empty())
+			{
+				if(m_error)
+					std::rethrow_exception(m_error);
+				break; // the end
+			}
+			m_block = std::move(m_full.front());
+			m_full.pop_front();
+		}
+		size_t len = std::min(n - count, m_block.size() - m_pos);
+		memcpy(p + count, m_block.data() + m_pos, len);
+		m_pos += len;
+		count += len;
+	}
+	return count;
+}
+
+void InputFile::decompress()
+{
+	try
+	{
+		while(true)
+		{
+			vector<char> block;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cond.wait(lock, [this]() { return !m_free.empty() || m_stop; });
+				if(m_stop)
+					break;
+				block = std::move(m_free.back());
+				m_free.pop_back();
+			}
+			block.resize(INPUT_BLOCK_SIZE);
+			block.resize(m_pDecoder->decode(&block[0], block.size()));
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(block.empty())
+				break;
+			m_full.push_back(std::move(block));
+			m_cond.notify_all();
+		}
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_error = std::current_exception();
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_done = true;
+	m_cond.notify_all();
+}
+
+
+LineReader::LineReader(const string& filename, size_t blockSize)
+: m_file(filename), m_buf(blockSize), m_begin(0), m_end(0), m_atEnd(false)
+{
+}
+
+bool LineReader::next(const char*& begin, const char*& end)
+{
+	// Move the partial line that was left over to the front
+	size_t kept = m_end - m_begin;
+	memmove(&m_buf[0], &m_buf[m_begin], kept);
+	m_begin = 0;
+	m_end = kept;
+	while(true)
+	{
+		if(!m_atEnd)
+		{
+			if(m_end == m_buf.size())
+				m_buf.resize(m_buf.size() * 2); // a very long line
+			size_t want = m_buf.size() - m_end;
+			size_t got = m_file.read(&m_buf[m_end], want);
+			m_end += got;
+			m_atEnd = got < want;
+		}
+		const char* first = m_buf.data();
+		const char* last = first + m_end;
+		if(!m_atEnd)
+		{
+			while(last != first && last[-1] != '\n')
+				last--;
+			if(last == first)
+				continue; // no whole line yet
+		}
+		else if(m_end == 0)
+			return false;
+		begin = first;
+		end = last;
+		m_begin = last - first;
+		return true;
+	}
+}
@@ -0,0 +1,192 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef INPUTFILE_H
+#define INPUTFILE_H
+
+#include "error.h"
+#include "parallel.h"
+#include "textscan.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Turns the bytes of a file into the bytes of its contents. (For a
+// compressed file, this is where the decompression happens.)
+class Decoder
+{
+public:
+	virtual ~Decoder() {}
+
+	// Writes up to n bytes of the contents to p. Returns the number of
+	// bytes written, which is less than n only at the end of the contents.
+	virtual size_t decode(char* p, size_t n) = 0;
+};
+
+
+// Reads a file that may be compressed, so that it can be parsed without
+// first being decompressed to disk. gzip files (such as "data.arff.gz")
+// and zstd files ("data.arff.zst") are recognized by the bytes they start
+// with, whatever they are named. (zstd needs the program to be built with
+// ZSTD=1; gzip needs zlib, which is used unless NO_ZLIB=1.) A compressed
+// file is decompressed by another thread, a block ahead of the reader, so
+// that decompressing overlaps with whatever is done with the contents.
+class InputFile
+{
+private:
+	std::string m_filename;
+	std::unique_ptr<Decoder> m_pDecoder;
+	bool m_compressed;
+
+	// Shared with the decompressing thread
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::deque< std::vector<char> > m_full; // decompressed blocks, in order
+	std::vector< std::vector<char> > m_free; // blocks that can be filled
+	bool m_done; // true when the thread has finished (at the end, or after an error)
+	bool m_stop; // true when the thread should finish early
+	std::exception_ptr m_error; // what the thread threw, if anything
+	std::thread m_thread;
+
+	// The block being read
+	std::vector<char> m_block;
+	size_t m_pos;
+
+public:
+	// Opens the specified file
+	InputFile(const std::string& filename);
+	~InputFile();
+
+	// Returns true if the file is compressed
+	bool compressed() const { return m_compressed; }
+
+	// Reads up to n bytes of the contents into p. Returns the number of
+	// bytes read, which is less than n only at the end of the contents.
+	size_t read(char* p, size_t n);
+
+private:
+	// Decompresses blocks until the end of the contents (run by m_thread)
+	void decompress();
+};
+
+
+// Reads a file (see InputFile) in blocks of whole lines, so that each
+// block can be split up and parsed without a line being cut in two.
+// For example:
+//
+// LineReader reader("data.csv", 4 * 1024 * 1024);
+// const char* begin;
+// const char* end;
+// while(reader.next(begin, end))
+//     parseLines(begin, end);
+//
+class LineReader
+{
+private:
+	InputFile m_file;
+	std::vector<char> m_buf;
+	size_t m_begin; // the start of the bytes in m_buf that have been read but not returned
+	size_t m_end; // the end of the bytes in m_buf that have been read
+	bool m_atEnd;
+
+public:
+	// Opens the specified file, which will be returned in blocks of about blockSize bytes
+	LineReader(const std::string& filename, size_t blockSize);
+
+	// Sets [begin, end) to the next block of whole lines. (A block is
+	// bigger than blockSize if one of its lines is. The last line of the
+	// file may have no newline.) The block is valid until the next call.
+	// Returns false when there is nothing left.
+	bool next(const char*& begin, const char*& end);
+};
+
+// What came of parsing one newline-aligned piece of a block (see
+// parseLines). Each parser derives its chunks from this, adding whatever
+// it parses the lines into.
+struct LineChunk
+{
+	const char* begin;
+	const char* end;
+	size_t rows; // the number of lines that were parsed into rows
+	size_t lines; // the number of lines parsed (including the one that failed, if any)
+	std::string error; // empty unless a line failed to parse
+};
+
+
+// Parses the lines in [begin, end) concurrently. The block is split into
+// newline-aligned chunks, one per worker (but none smaller than minSize
+// bytes), which start as copies of blank. For each line of a chunk that is
+// not blank and does not start with comment ('\0' if there are no
+// comments), parseLine(lineBegin, lineEnd, chunk) is called, with the
+// spaces before the line and the line ending removed. It returns false,
+// and describes the problem in chunk.error, if the line is bad, which ends
+// that chunk. Then append(chunk) is called for each chunk, in order, on
+// this thread, and lineNum is advanced past its lines. (If a chunk
+// failed, its error is thrown instead, with the number of its bad line.)
+template <typename Chunk, typename ParseLine, typename Append>
+void parseLines(const char* begin, const char* end, size_t minSize, char comment, const Chunk& blank, size_t& lineNum, ParseLine parseLine, Append append)
+{
+	// Split into newline-aligned chunks, one per worker
+	size_t size = end - begin;
+	size_t chunkCount = std::max((size_t)1, std::min(workerCount(), size / minSize));
+	std::vector<Chunk> chunks(chunkCount, blank);
+	const char* p = begin;
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		chunks[i].begin = p;
+		if(i + 1 < chunkCount)
+		{
+			p = std::max(p, begin + size * (i + 1) / chunkCount);
+			p = endOfLine(p, end);
+			if(p != end)
+				p++;
+		}
+		else
+			p = end;
+		chunks[i].end = p;
+		chunks[i].rows = 0;
+		chunks[i].lines = 0;
+	}
+
+	// Parse them concurrently
+	parallelFor(chunkCount, [&](size_t i)
+	{
+		Chunk& chunk = chunks[i];
+		const char* q = chunk.begin;
+		while(q != chunk.end)
+		{
+			const char* eol = endOfLine(q, chunk.end);
+			chunk.lines++;
+			const char* lineEnd = eol;
+			if(lineEnd != q && lineEnd[-1] == '\r')
+				lineEnd--;
+			const char* lineBegin = skipSpace(q, lineEnd);
+			q = eol == chunk.end ? eol : eol + 1;
+			if(lineBegin == lineEnd || (comment && *lineBegin == comment))
+				continue; // blank line or comment
+			if(!parseLine(lineBegin, lineEnd, chunk))
+				return;
+			chunk.rows++;
+		}
+	});
+
+	// Append the rows in order, reporting the first error with its line number
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		if(!chunks[i].error.empty())
+			ThrowError(chunks[i].error, " on line ", to_str(lineNum + chunks[i].lines));
+		append(chunks[i]);
+		lineNum += chunks[i].lines;
+	}
+}
+
+#endif // INPUTFILE_H
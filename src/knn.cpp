@@ -4,24 +4,135 @@
 
 void KNN::train(Matrix& features, Matrix& labels)
 {
-    this->k = 5;
+    if (k == 0)
+        ThrowError("Expected k to be at least 1");
+    // (These are copies, so the caller can change its matrices afterward)
     this->features = features;
     this->labels = labels;
+
+    // Note whether any feature is missing a value, so distances can skip the checks
+    m_complete = !features.isSparse();
+    m_nominal.resize (features.cols());
+    for (size_t c = 0; c < features.cols(); ++c)
+    {
+        m_nominal[c] = features.valueCount(c) != 0;
+        if (m_complete && features.hasMissing(c))
+            m_complete = false;
+    }
+
+    // Count the labels now, so that voting only reads them
+    m_labelsCounted = labels.countValues(0, m_labelCounts);
+    m_labelValueCounts = labels.getValueCounts(0);
 }
 
 
-void KNN::predict(const std::vector<double>& features, std::vector<double>& labels)
+void KNN::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
     if (features.size() != this->features.cols())
         ThrowError("Invalid number of attributes in given feature vector");
 
+    if (this->features.isSparse())
+    {
+        // Compare only the nonzero elements
+        std::vector<size_t> cols;
+        std::vector<double> values;
+        for (size_t c = 0; c < features.size(); ++c)
+        {
+            if (features[c] != 0.0)
+            {
+                cols.push_back(c);
+                values.push_back(features[c]);
+            }
+        }
+        predictFromSparse (Matrix::SparseRow(cols.data(), values.data(), cols.size(), features.size()), labels);
+        return;
+    }
+
+    std::vector<RowDistance> topFeatures;
+
+    bool complete = m_complete && std::find (features.begin(), features.end(), UNKNOWN_VALUE) == features.end();
+    double maxDist = std::numeric_limits<double>::max();
+    std::vector<double> row;
+    for (size_t r = 0; r < this->features.rows(); ++r)
+    {
+        this->features.getRow(r, row);
+        double distance = complete ? this->completeDist (row, features) : this->dist (row, features);
+
+        if (distance < maxDist)
+        {
+            maxDist = replaceTop (topFeatures, r, distance);
+        }
+    }
+
+    labels[0] = vote (topFeatures);
+}
+
+
+void KNN::predictSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const
+{
+    if (!this->features.isSparse())
+    {
+        SupervisedLearner::predictSparse (features, labels);
+        return;
+    }
+    if (features.width() != this->features.cols())
+        ThrowError("Invalid number of attributes in given feature vector");
+    predictFromSparse (features, labels);
+}
+
+
+void KNN::predictBatch(Matrix& features, Matrix& labels) const
+{
+    if (this->features.isSparse() || features.isSparse())
+    {
+        SupervisedLearner::predictBatch (features, labels);
+        return;
+    }
+    if (labels.rows() != features.rows())
+        ThrowError("Expected a row of labels for each row of features");
+    if (features.cols() != this->features.cols())
+        ThrowError("Invalid number of attributes in given feature vector");
+
+    size_t count = features.rows();
+    std::vector< std::vector<double> > inputs(count);
+    std::vector<char> complete(count);
+    for (size_t q = 0; q < count; ++q)
+    {
+        features.getRow(q, inputs[q]);
+        complete[q] = m_complete && std::find (inputs[q].begin(), inputs[q].end(), UNKNOWN_VALUE) == inputs[q].end();
+    }
+
+    // Visit each training row once, keeping the nearest rows of every input
+    std::vector< std::vector<RowDistance> > topFeatures(count);
+    std::vector<double> maxDist(count, std::numeric_limits<double>::max());
+    std::vector<double> row;
+    for (size_t r = 0; r < this->features.rows(); ++r)
+    {
+        this->features.getRow(r, row);
+        for (size_t q = 0; q < count; ++q)
+        {
+            double distance = complete[q] ? this->completeDist (row, inputs[q]) : this->dist (row, inputs[q]);
+
+            if (distance < maxDist[q])
+            {
+                maxDist[q] = replaceTop (topFeatures[q], r, distance);
+            }
+        }
+    }
+
+    for (size_t q = 0; q < count; ++q)
+        labels[q][0] = vote (topFeatures[q]);
+}
+
+
+void KNN::predictFromSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const
+{
     std::vector<RowDistance> topFeatures;
 
     double maxDist = std::numeric_limits<double>::max();
     for (size_t r = 0; r < this->features.rows(); ++r)
     {
-        std::vector<double> row = this->features.row(r);
-        double distance = this->dist (row, features);
+        double distance = this->sparseDist (this->features.sparseRow(r), features);
 
         if (distance < maxDist)
         {
@@ -33,7 +144,7 @@ void KNN::predict(const std::vector<double>& features, std::vector<double>& labe
 }
 
 
-double KNN::dist(const std::vector<double>& feature, const std::vector<double>& input)
+double KNN::dist(const std::vector<double>& feature, const std::vector<double>& input) const
 {
     double dist = 0.1; // prevent divide-by-zero problem
     for (size_t c = 0; c < this->features.cols(); ++c)
@@ -61,7 +172,69 @@ double KNN::dist(const std::vector<double>& feature, const std::vector<double>&
 }
 
 
-double KNN::replaceTop(std::vector<RowDistance>& topFeatures, size_t newRow, double newDist)
+double KNN::completeDist(const std::vector<double>& feature, const std::vector<double>& input) const
+{
+    double dist = 0.1; // prevent divide-by-zero problem
+    for (size_t c = 0; c < feature.size(); ++c)
+    {
+        double d = feature[c] - input[c];
+        dist += m_nominal[c] ? (feature[c] == input[c] ? 0.0 : 1.0) : d * d;
+    }
+
+    return sqrt (dist);
+}
+
+
+double KNN::sparseDist(const Matrix::SparseRow& feature, const Matrix::SparseRow& input) const
+{
+    double dist = 0.1; // prevent divide-by-zero problem
+    size_t i = 0;
+    size_t j = 0;
+    while (i < feature.size() || j < input.size())
+    {
+        // Take the next column that is nonzero in either row
+        size_t c;
+        double target = 0.0;
+        double value = 0.0;
+        if (j == input.size() || (i < feature.size() && feature.col(i) < input.col(j)))
+        {
+            c = feature.col(i);
+            target = feature.value(i++);
+        }
+        else if (i == feature.size() || input.col(j) < feature.col(i))
+        {
+            c = input.col(j);
+            value = input.value(j++);
+        }
+        else
+        {
+            c = feature.col(i);
+            target = feature.value(i++);
+            value = input.value(j++);
+        }
+
+        if (target == UNKNOWN_VALUE || value == UNKNOWN_VALUE)
+        {
+            dist += 1.0;
+            continue;
+        }
+
+        size_t valueCount = this->features.valueCount(c);
+        if (valueCount == 0) // continuous
+        {
+            dist += pow (target - value, 2.0);
+        }
+        else // nominal
+        {
+            dist += target == value ? 0.0 : 1.0;
+        }
+    }
+
+    return sqrt (dist);
+}
+
+
+double KNN::replaceTop(std::vector<RowDistance>& topFeatures, size_t newRow, double newDist) const
 {
     if (topFeatures.size() < this->k)
         topFeatures.push_back ( std::make_pair (newRow, newDist) );
@@ -89,7 +262,7 @@ bool compareVotes(const std::pair<double, double>& first, const std::pair<double
 }
 
 
-double KNN::vote(const std::vector<RowDistance>& topFeatures, bool weight)
+double KNN::vote(const std::vector<RowDistance>& topFeatures, bool weight) const
 {
     size_t valueCount = this->labels.valueCount(0);
     double denom = 0.0;
@@ -102,10 +275,43 @@ double KNN::vote(const std::vector<RowDistance>& topFeatures, bool weight)
             denom += 1.0;
     }
 
+    // nominal labels are voted in an array indexed by value (with UNKNOWN_VALUE last)
+    const std::vector<size_t>& labelCounts = m_labelCounts;
+    if (valueCount != 0 && m_labelsCounted)
+    {
+        std::vector<double> votes(valueCount + 1, 0.0);
+        for (size_t i = 0; i < topFeatures.size(); ++i)
+        {
+            RowDistance tf = topFeatures[i];
+            double value = this->labels.get(tf.first, 0);
+            double distanceWeight = 1.0;
+            if (weight)
+                distanceWeight /= pow (tf.second, 2.0);
+            votes[value == UNKNOWN_VALUE ? valueCount : (size_t)value] += distanceWeight;
+        }
+
+        // take the first of the values that occur with the most votes, in the order of a map
+        size_t best = 0;
+        double bestVotes = -1.0;
+        for (size_t j = 0; j <= valueCount; ++j)
+        {
+            size_t i = j == 0 ? valueCount : j - 1;
+            if (labelCounts[i] == 0)
+                continue;
+            double v = votes[i] / denom;
+            if (v > bestVotes)
+            {
+                best = i;
+                bestVotes = v;
+            }
+        }
+        return best == valueCount ? UNKNOWN_VALUE : (double)best;
+    }
+
     // create map for nominal label votes
-    std::map<double, size_t> valueCounts = this->labels.getValueCounts(0);
+    const std::map<double, size_t>& valueCounts = m_labelValueCounts;
     std::map<double, double> votes;
-    for (std::map<double, size_t>::iterator it = valueCounts.begin(); it != valueCounts.end(); ++it)
+    for (std::map<double, size_t>::const_iterator it = valueCounts.begin(); it != valueCounts.end(); ++it)
         votes[it->first] = 0.0;
 
     // this value is for continuous labels (regression)
@@ -116,7 +322,7 @@ double KNN::vote(const std::vector<RowDistance>& topFeatures, bool weight)
     {
         RowDistance tf = topFeatures[i];
         size_t row = tf.first;
-        double value = this->labels.row(row)[0];
+        double value = this->labels.get(row, 0);
         double distanceWeight = 1.0;
         if (weight)
             distanceWeight /= pow (tf.second, 2.0);
@@ -197,7 +403,7 @@ void IVDM::train(Matrix& features, Matrix& labels)
 }
 
 
-void IVDM::predict(const std::vector<double>& features, std::vector<double>& labels)
+void IVDM::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
     std::vector<double> dFeatures = discretize (features);
 
@@ -206,7 +412,7 @@ void IVDM::predict(const std::vector<double>& features, std::vector<double>& lab
 }
 
 
-double IVDM::dist(const std::vector<double>& feature, const std::vector<double>& input) {
+double IVDM::dist(const std::vector<double>& feature, const std::vector<double>& input) const {
 
     double distance = 0.1;
     double Pauc, Pau1c, Mau, Mau1;
@@ -222,25 +428,24 @@ double IVDM::dist(const std::vector<double>& feature, const std::vector<double>&
         if (value == UNKNOWN_VALUE)
             value = m_bins;
 
-        std::map<double, std::map<double, double> >& probs_a = probabilities[a];
 
         size_t valueCount = this->features.valueCount(a);
-        for (std::map<double, size_t>::iterator it = labelValueCounts.begin(); it != labelValueCounts.end(); ++it)
+        for (std::map<double, size_t>::const_iterator it = labelValueCounts.begin(); it != labelValueCounts.end(); ++it)
         {
             double label = it->first;
             if (valueCount == 0) // continuous
             {
                 size_t targetBin = getBin(target, min, width);
-                Pauc = probs_a[targetBin][label];
-                Pau1c = probs_a[targetBin + 1][label];
+                Pauc = probability(a, targetBin, label);
+                Pau1c = probability(a, targetBin + 1, label);
                 Mau = min + width * (targetBin + 0.5);
                 Mau1 = min + width * (targetBin + 1.5);
                 double Pacx = Pauc + ( (target - Mau) / (Mau1 - Mau) ) * (Pau1c - Pauc);
 //                double Pacx = calcPac(target, targetBin, a, label);
 
                 size_t valueBin = getBin(value, min, width);
-                Pauc = probs_a[valueBin][label];
-                Pau1c = probs_a[valueBin + 1][label];
+                Pauc = probability(a, valueBin, label);
+                Pau1c = probability(a, valueBin + 1, label);
                 Mau = min + width * (targetBin + 0.5);
                 Mau1 = min + width * (targetBin + 1.5);
                 double Pacy = Pauc + ( (value - Mau) / (Mau1 - Mau) ) * (Pau1c - Pauc);
@@ -299,7 +504,7 @@ Matrix IVDM::discretizeFeatures(Matrix& features)
 }
 
 
-std::vector<double> IVDM::discretize(const std::vector<double>& before)
+std::vector<double> IVDM::discretize(const std::vector<double>& before) const
 {
 	if(before.size() != m_featureMins.size())
 		ThrowError ("Unexpected row size");
@@ -325,7 +530,7 @@ std::vector<double> IVDM::discretize(const std::vector<double>& before)
 }
 
 
-size_t IVDM::getBin(double x, double min, double width)
+size_t IVDM::getBin(double x, double min, double width) const
 {
     if (x < min)
         return 0;
@@ -333,9 +538,9 @@ size_t IVDM::getBin(double x, double min, double width)
 }
 
 
-double IVDM::calcPac(double x, size_t u, size_t a, double c)
+double IVDM::calcPac(double x, size_t u, size_t a, double c) const
 {
-    double Pauc = this->probabilities[a][u][c];
+    double Pauc = probability(a, u, c);
 
     double min = m_featureMins[a];
     double width = m_featureWidths[a];
@@ -343,13 +548,27 @@ double IVDM::calcPac(double x, size_t u, size_t a, double c)
     double Mau = min + width * (u + 0.5);
     double Mau1 = min + width * (u + 1.5);
 
-    double Pau1c = this->probabilities[a][u + 1][c];
+    double Pau1c = probability(a, u + 1, c);
 
     return Pauc + ( (x - Mau) / (Mau1 - Mau) ) * (Pau1c - Pauc);
 }
 
 
-double IVDM::calcMid(size_t a, size_t u)
+double IVDM::probability(size_t a, double u, double c) const
+{
+    // (Looked up without adding the bins and labels that were never seen)
+    std::map<size_t, std::map<double, std::map<double, double> > >::const_iterator probs_a = this->probabilities.find(a);
+    if (probs_a == this->probabilities.end())
+        return 0.0;
+    std::map<double, std::map<double, double> >::const_iterator probs_au = probs_a->second.find(u);
+    if (probs_au == probs_a->second.end())
+        return 0.0;
+    std::map<double, double>::const_iterator p = probs_au->second.find(c);
+    return p == probs_au->second.end() ? 0.0 : p->second;
+}
+
+
+double IVDM::calcMid(size_t a, size_t u) const
 {
     return m_featureMins[a] + m_featureWidths[a] * (u + 0.5);
 }
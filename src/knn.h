@@ -19,28 +19,60 @@ typedef std::pair<size_t, double> RowDistance;
 class KNN : public SupervisedLearner
 {
 public:
-    KNN(Rand rand)
-        : m_rand(rand)
+    // The number of neighbors that vote, unless another is given
+    static const size_t K = 5;
+
+    KNN(Rand rand, size_t k = K)
+        : m_rand(rand), k(k)
     {}
 
     void train(Matrix&, Matrix&);
 
-    void predict(const std::vector<double>&, std::vector<double>&);
+    // Returns an untrained learner
+    SupervisedLearner* clone(Rand& r) { return new KNN(r, k); }
+
+    void predict(const std::vector<double>&, std::vector<double>&) const;
+
+    // If the training set is sparse, this compares sparse rows directly
+    void predictSparse(const Matrix::SparseRow&, std::vector<double>&) const;
+
+    // Finds the nearest training rows of a whole batch of rows in one pass
+    // through the training set, rather than a pass for each row
+    void predictBatch(Matrix&, Matrix&) const;
 
-    virtual double dist(const std::vector<double>&, const std::vector<double>&);
+    virtual double dist(const std::vector<double>&, const std::vector<double>&) const;
+
+    // The same distance as dist, for rows that are known to have no missing
+    // values, so it needs no checks for them
+    virtual double completeDist(const std::vector<double>&, const std::vector<double>&) const;
+
+    // The same distance as dist, for sparse rows. (Columns that are zero in
+    // both rows add nothing, so only the nonzero elements are visited.)
+    virtual double sparseDist(const Matrix::SparseRow&, const Matrix::SparseRow&) const;
 
 private:
 
     Rand m_rand;
 
-    size_t k;
+    bool m_complete; // true if no training feature is missing a value
+
+    std::vector<char> m_nominal; // whether each feature is nominal
 
-    double replaceTop(std::vector<RowDistance>&, size_t, double);
+    bool m_labelsCounted; // true if m_labelCounts counts the values of a nominal label (see Matrix::countValues)
+    std::vector<size_t> m_labelCounts;
+    std::map<double, size_t> m_labelValueCounts; // the number of times each label occurs
 
-    double vote(const std::vector<RowDistance>&, bool weight = false);
+    // Finds the nearest rows of a sparse training set, and votes
+    void predictFromSparse(const Matrix::SparseRow&, std::vector<double>&) const;
+
+    double replaceTop(std::vector<RowDistance>&, size_t, double) const;
+
+    double vote(const std::vector<RowDistance>&, bool weight = false) const;
 
 protected:
 
+    size_t k; // the number of neighbors that vote
+
     Matrix features;
     Matrix labels;
 
@@ -51,15 +83,24 @@ protected:
 class IVDM : public KNN
 {
 public:
-    IVDM(Rand rand)
-        : KNN(rand)
+    IVDM(Rand rand, size_t k = K)
+        : KNN(rand, k)
     {}
 
     void train(Matrix&, Matrix&);
 
-    void predict(const std::vector<double>&, std::vector<double>&);
+    // Returns an untrained learner
+    SupervisedLearner* clone(Rand& r) { return new IVDM(r, k); }
+
+    void predict(const std::vector<double>&, std::vector<double>&) const;
 
-    virtual double dist(const std::vector<double>&, const std::vector<double>&);
+    // (Each row is predicted by predict, which checks it against the filter)
+    void predictBatch(Matrix& features, Matrix& labels) const { SupervisedLearner::predictBatch (features, labels); }
+
+    virtual double dist(const std::vector<double>&, const std::vector<double>&) const;
+
+    // (There is no faster form of this distance for complete rows.)
+    virtual double completeDist(const std::vector<double>& feature, const std::vector<double>& input) const { return dist (feature, input); }
 
 private:
 
@@ -76,16 +117,20 @@ private:
     Matrix discretizeFeatures(Matrix&);
     
     // Based off of equation (18) from http://axon.cs.byu.edu/~martinez/classes/478/readings/Wilson_distance.pdf
-    std::vector<double> discretize(const std::vector<double>&);
+    std::vector<double> discretize(const std::vector<double>&) const;
 
     // Based off of part 3 of equation (18) from http://axon.cs.byu.edu/~martinez/classes/478/readings/Wilson_distance.pdf
-    size_t getBin(double, double, double);
+    size_t getBin(double, double, double) const;
 
     // Based off of equation (23) from http://axon.cs.byu.edu/~martinez/classes/478/readings/Wilson_distance.pdf
-    double calcPac(double, size_t, size_t, double);
+    double calcPac(double, size_t, size_t, double) const;
+
+    // Returns p(a,u,c), the fraction of the rows in bin u of feature a
+    // that have label c (or 0 if there are none)
+    double probability(size_t a, double u, double c) const;
 
     // Based off of equation (24) from http://axon.cs.byu.edu/~martinez/classes/478/readings/Wilson_distance.pdf
-    double calcMid(size_t, size_t);
+    double calcMid(size_t, size_t) const;
 
 };
 
@@ -5,9 +5,13 @@
 
 #include "learner.h"
 #include "error.h"
+#include "arff.h"
+#include "parallel.h"
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <algorithm>
 #include <sstream>
@@ -18,133 +22,287 @@
 
 using std::vector;
 using std::cout;
+using std::string;
+
+// The number of rows that measureAccuracy and getMSE pass to predictBatch at a time
+#define PREDICT_BATCH_ROWS 256
+
+namespace
+{
+	// The training and test sets of one fold, and what came of it
+	struct Fold
+	{
+		boost::shared_ptr<MatrixView> trainFeatures;
+		boost::shared_ptr<MatrixView> trainLabels;
+		boost::shared_ptr<MatrixView> testFeatures;
+		boost::shared_ptr<MatrixView> testLabels;
+		Rand rand;
+		string output; // what was printed while the fold ran
+		double trainAccuracy;
+		double accuracy;
+		bool done;
+
+		Fold(uint64 seed) : rand(seed), trainAccuracy(0.0), accuracy(0.0), done(false) {}
+	};
+}
+
+// virtual
+void SupervisedLearner::predictSparse(const Matrix::SparseRow& features, vector<double>& labels) const
+{
+	vector<double> dense;
+	features.copyTo(dense);
+	predict(dense, labels);
+}
+
+// virtual
+void SupervisedLearner::predictBatch(Matrix& features, Matrix& labels) const
+{
+	if(labels.rows() != features.rows())
+		ThrowError("Expected a row of labels for each row of features");
+	vector<double> row;
+	vector<double> prediction;
+	for(size_t i = 0; i < features.rows(); i++)
+	{
+		labels.getRow(i, prediction);
+		if(features.isSparse())
+			predictSparse(features.sparseRow(i), prediction);
+		else
+		{
+			features.getRow(i, row);
+			predict(row, prediction);
+		}
+		for(size_t j = 0; j < prediction.size(); j++)
+			labels[i][j] = prediction[j];
+	}
+}
+
+size_t SupervisedLearner::predictThreads() const
+{
+	return canPredictConcurrently() ? workerCount() : 1;
+}
+
+void SupervisedLearner::predictBatches(Matrix& features, size_t labelDims, const Matrix* pInitial, size_t threads, const std::function<void (size_t, const vector<size_t>&, Matrix&)>& f) const
+{
+	Matrix::BlockIterator it(features);
+	bool done = !it.next();
+	size_t next = 0; // the first row of the current block that no batch has taken
+	size_t batches = 0;
+	std::mutex mutex; // held while a batch is taken, and while f is called
+	size_t runs = std::max((size_t)1, std::min(threads, (features.rows() + PREDICT_BATCH_ROWS - 1) / PREDICT_BATCH_ROWS));
+	parallelFor(runs, [&](size_t)
+	{
+		Matrix predictions;
+		vector<size_t> rows;
+		while(true)
+		{
+			// Take the next batch
+			size_t batch;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				while(!done && next >= it.size())
+				{
+					done = !it.next();
+					next = 0;
+				}
+				if(done)
+					return;
+				size_t n = std::min((size_t)PREDICT_BATCH_ROWS, it.size() - next);
+				rows.resize(n);
+				for(size_t j = 0; j < n; j++)
+					rows[j] = it.index(next + j);
+				next += n;
+				batch = batches++;
+			}
+
+			MatrixView view(features, rows);
+			predictions.setSize(rows.size(), labelDims);
+			if(pInitial)
+			{
+				for(size_t j = 0; j < rows.size(); j++)
+				{
+					Matrix::Row prediction = predictions.row(j);
+					for(size_t k = 0; k < labelDims; k++)
+						prediction[k] = pInitial->get(rows[j], k);
+				}
+			}
+			predictBatch(view, predictions);
+			std::lock_guard<std::mutex> lock(mutex);
+			f(batch, rows, predictions);
+		}
+	});
+}
 
 double SupervisedLearner::measureAccuracy(Matrix& features, Matrix& labels, Matrix* pOutStats)
+{
+	if(features.rows() == 0)
+		ThrowError("Expected at least one row");
+	beginAccuracy(features, labels, pOutStats);
+	double total = 0.0;
+	accumulateAccuracy(features, labels, total, pOutStats);
+	if(labels.valueCount(0) == 0)
+		return sqrt(total / features.rows()); // root mean squared error
+	else
+		return total / features.rows(); // predictive accuracy
+}
+
+double SupervisedLearner::measureAccuracy(ArffReader& reader, size_t labelDims, Matrix* pOutStats)
+{
+	double total = 0.0;
+	size_t rows = 0;
+	bool continuous = false;
+	while(reader.next())
+	{
+		Matrix& batch = reader.batch();
+		MatrixView features(batch, 0, 0, batch.rows(), batch.cols() - labelDims);
+		MatrixView labels(batch, 0, batch.cols() - labelDims, batch.rows(), labelDims);
+		if(rows == 0)
+			beginAccuracy(features, labels, pOutStats);
+		accumulateAccuracy(features, labels, total, pOutStats);
+		rows += batch.rows();
+		continuous = labels.valueCount(0) == 0;
+	}
+	if(rows == 0)
+		ThrowError("Expected at least one row");
+	if(continuous)
+		return sqrt(total / rows);
+	else
+		return total / rows;
+}
+
+void SupervisedLearner::beginAccuracy(Matrix& features, Matrix& labels, Matrix* pOutStats)
 {
 	// Check assumptions
 	if(features.rows() != labels.rows())
 		ThrowError("Expected the features and labels to have the same number of rows");
 	if(labels.cols() != 1)
 		ThrowError("Sorry, this method currently only supports one-dimensional labels");
-	if(features.rows() == 0)
-		ThrowError("Expected at least one row");
 
-    std::clock_t start;
-    start = std::clock();
-
-	// Measure Accuracy
 	size_t labelValues = labels.valueCount(0);
-	if(labelValues == 0) // If the label is continuous...
+	if(labelValues > 0 && pOutStats)
 	{
-        //std::cout << "continuous measureAccuracy" << std::endl;
-		// The label is continuous, so measure root mean squared error
-		vector<double> pred;
-		pred.resize(1);
-		double sse = 0.0;
-		for(size_t i = 0; i < features.rows(); i++)
-		{
-			const vector<double>& feat = features.row(i);
-			vector<double>& targ = labels.row(i);
-			pred[0] = labels[i][0];
-			predict(feat, pred);
-			double delta = targ[0] - pred[0];
-			sse += (delta * delta);
-
-            if (i % 100 == 0)
-            {
-                //std::cout << i << " out of " << features.rows() << " predicted.";
-                std::clock_t next;
-                next = std::clock();
-                //std::cout << " time elapsed " << (next - start) / (double)CLOCKS_PER_SEC << std::endl;
-                start = next;
-            }
-		}
-		return sqrt(sse / features.rows());
+		pOutStats->setSize(labelValues, labelValues);
+		pOutStats->setAll(0.0);
 	}
-	else
+}
+
+void SupervisedLearner::accumulateAccuracy(Matrix& features, Matrix& labels, double& total, Matrix* pOutStats)
+{
+	// Each batch has its own total, and they are added up in order at the
+	// end, so the total does not depend on the number of threads
+	size_t labelValues = labels.valueCount(0);
+	vector<double> totals;
+	predictBatches(features, labels.cols(), &labels, predictThreads(), [&](size_t batch, const vector<size_t>& rows, Matrix& predictions)
 	{
-        //std::cout << "nominal measureAccuracy" << std::endl;
-		// The label is nominal, so measure predictive accuracy
-		if(pOutStats)
-		{
-			pOutStats->setSize(labelValues, labelValues);
-			pOutStats->setAll(0.0);
-		}
-		size_t correctCount = 0;
-		vector<double> prediction;
-		prediction.resize(1);
-		for(size_t i = 0; i < features.rows(); i++)
+		if(batch >= totals.size())
+			totals.resize(batch + 1, 0.0);
+		double& batchTotal = totals[batch];
+		for(size_t j = 0; j < rows.size(); j++)
 		{
-			const vector<double>& feat = features.row(i);
-			size_t targ = (size_t)labels[i][0];
-            prediction[0] = labels[i][0];
-			if(targ >= labelValues)
-				ThrowError("The label is out of range");
-//			if(pOutStats)
-//				(*pOutStats)[1][targ]++; // increment the "possible" count
-			predict(feat, prediction);
-			size_t pred = (size_t)prediction[0];
-//            std::cout << "pred " << pred << " targ " << targ << std::endl;
-			if(pred == targ)
+			double targ = labels.get(rows[j], 0);
+			double prediction = predictions.get(j, 0);
+			if(labelValues == 0)
 			{
-				correctCount++;
+				// The label is continuous, so measure the squared error
+				double delta = targ - prediction;
+				batchTotal += (delta * delta);
+			}
+			else
+			{
+				// The label is nominal, so count the correct predictions
+				if((size_t)targ >= labelValues)
+					ThrowError("The label is out of range");
+				size_t pred = (size_t)prediction;
+				if(pred == (size_t)targ)
+					batchTotal++;
+				if(pOutStats)
+					(*pOutStats)[pred][(size_t)targ]++; // increment the confusion matrix count
 			}
-            if(pOutStats)
-                (*pOutStats)[pred][targ]++; // increment the confusion matrix count
-
-            if (i % 100 == 0)
-            {
-                //std::cout << i << " out of " << features.rows() << " predicted.";
-                std::clock_t next;
-                next = std::clock();
-                //std::cout << " time elapsed " << (next - start) / (double)CLOCKS_PER_SEC << std::endl;
-                start = next;
-            }
 		}
-		return (double)correctCount / features.rows();
-	}
+	});
+	for(size_t i = 0; i < totals.size(); i++)
+		total += totals[i];
 }
 
 double SupervisedLearner::crossValidate(size_t reps, size_t folds, Matrix& features, Matrix& labels, Rand& r, bool verbose)
 {
 	if(features.rows() != labels.rows())
 		ThrowError("Expected the features and labels to have the same number of rows");
-	double sum = 0.0;
+	if(folds == 0)
+		ThrowError("Expected at least one fold");
+
+	// Make the training and test sets of every fold first. (The views keep
+	// the order of the rows, so the next shuffle leaves them alone.)
+	vector< boost::shared_ptr<Fold> > runs;
 	for(size_t rep = 0; rep < reps; rep++)
 	{
 		features.shuffleRows(r, &labels);
 		size_t foldSize = features.rows() / folds;
 		for(size_t fold = 0; fold < folds; fold++)
 		{
-			// Make the training and test sets
+			boost::shared_ptr<Fold> pRun(new Fold(r.next()));
 			size_t foldBegin = foldSize * fold;
 			size_t foldEnd = foldBegin + foldSize;
-			Matrix trainFeatures, trainLabels, testFeatures, testLabels;
-			trainFeatures.copyPart(features, 0, 0, foldBegin, features.cols());
-			trainFeatures.copyPart(features, foldEnd, 0, features.rows() - foldEnd, features.cols());
-			trainLabels.copyPart(labels, 0, 0, foldBegin, labels.cols());
-			trainLabels.copyPart(labels, foldEnd, 0, labels.rows() - foldEnd, labels.cols());
-			testFeatures.copyPart(features, foldBegin, 0, foldEnd - foldBegin, features.cols());
-			testLabels.copyPart(labels, foldBegin, 0, foldEnd - foldBegin, labels.cols());
-
-			// Train
-			train(trainFeatures, trainLabels);
-
-			// Test
-            double trAccuracy = measureAccuracy(trainFeatures, trainLabels);
-			double accuracy = measureAccuracy(testFeatures, testLabels);
-			sum += accuracy;
-
-			// Print intermediate results
-			if(verbose)
+			pRun->trainFeatures.reset(new MatrixView(features, 0, 0, foldBegin, features.cols()));
+			pRun->trainFeatures->addRows(features, foldEnd, features.rows() - foldEnd);
+			pRun->trainLabels.reset(new MatrixView(labels, 0, 0, foldBegin, labels.cols()));
+			pRun->trainLabels->addRows(labels, foldEnd, labels.rows() - foldEnd);
+			pRun->testFeatures.reset(new MatrixView(features, foldBegin, 0, foldEnd - foldBegin, features.cols()));
+			pRun->testLabels.reset(new MatrixView(labels, foldBegin, 0, foldEnd - foldBegin, labels.cols()));
+			runs.push_back(pRun);
+		}
+	}
+
+	// Train and test each fold with its own clone of this learner
+	std::exception_ptr pError;
+	{
+		OutputCapture output(cout);
+		try
+		{
+			parallelFor(runs.size(), [&](size_t i)
 			{
-				cout << "Rep, " << rep << " - Fold, " << fold << "\n";
-                cout << "Training Set Accuracy, " << trAccuracy << "\n";
-                cout << "Test Set Accuracy, " << accuracy << "\n";
-				cout.flush();
-			}
+				Fold& run = *runs[i];
+				OutputCapture::captureTo(&run.output);
+				try
+				{
+					std::unique_ptr<SupervisedLearner> pLearner(clone(run.rand));
+					pLearner->train(*run.trainFeatures, *run.trainLabels);
+					run.trainAccuracy = pLearner->measureAccuracy(*run.trainFeatures, *run.trainLabels);
+					run.accuracy = pLearner->measureAccuracy(*run.testFeatures, *run.testLabels);
+					run.done = true;
+				}
+				catch(...)
+				{
+					OutputCapture::captureTo(NULL);
+					throw;
+				}
+				OutputCapture::captureTo(NULL);
+			});
+		}
+		catch(...)
+		{
+			pError = std::current_exception();
+		}
+	}
+
+	// Print the results in order (up to the first fold that failed)
+	double sum = 0.0;
+	for(size_t i = 0; i < runs.size(); i++)
+	{
+		Fold& run = *runs[i];
+		cout << run.output;
+		if(!run.done)
+			break;
+		sum += run.accuracy;
+		if(verbose)
+		{
+			cout << "Rep, " << i / folds << " - Fold, " << i % folds << "\n";
+			cout << "Training Set Accuracy, " << run.trainAccuracy << "\n";
+			cout << "Test Set Accuracy, " << run.accuracy << "\n";
 		}
 	}
+	cout.flush();
+	if(pError)
+		std::rethrow_exception(pError);
 	return sum / (reps * folds);
 }
 
@@ -168,40 +326,38 @@ void SupervisedLearner::splitValidationSet(Matrix& features, Matrix& labels, Mat
     size_t featureRows = (size_t)(totalRows * featurePercent);
     size_t validationRows = totalRows - featureRows;
 
-    // copy new feature rows to new matrix
-    Matrix newFeatures ( features );
-    newFeatures.copyPart(features, 0, 0, featureRows, featureCols);
+    // refer to the new feature rows
+    MatrixView newFeatures(features, 0, 0, featureRows, featureCols);
 
-    // copy new label rows to new matrix
-    Matrix newLabels ( labels );
-    newLabels.copyPart(labels, 0, 0, featureRows, labelCols);
+    // refer to the new label rows
+    MatrixView newLabels(labels, 0, 0, featureRows, labelCols);
 
     // set validation matrix
-    validation.setSize(0, 0);
-    validation.copyPart(features, featureRows, 0, validationRows, featureCols);
+    validation.share(MatrixView(features, featureRows, 0, validationRows, featureCols));
 
     // set validation labels matrix
-    validationLabels.setSize(0, 0);
-    validationLabels.copyPart(labels, featureRows, 0, validationRows, labelCols);
+    validationLabels.share(MatrixView(labels, featureRows, 0, validationRows, labelCols));
 
-    features = newFeatures;
-    labels = newLabels;
+    features.share(newFeatures);
+    labels.share(newLabels);
 }
 
 
 double SupervisedLearner::getMSE(Matrix& features, Matrix& labels)
 {
-    vector<double> pred;
-    pred.resize(1);
-    double sse = 0.0;
-    for(size_t i = 0; i < features.rows(); i++)
+    std::vector<double> sse; // for each batch
+    predictBatches(features, 1, NULL, predictThreads(), [&](size_t batch, const vector<size_t>& rows, Matrix& predictions)
     {
-        const vector<double>& feat = features.row(i);
-        vector<double>& targ = labels.row(i);
-        pred[0] = 0.0; // make sure the prediction is not biassed by a previous prediction
-        predict(feat, pred);
-        double delta = targ[0] - pred[0];
-        sse += (delta * delta);
-    }
-    return sqrt(sse / features.rows());
+        if(batch >= sse.size())
+            sse.resize(batch + 1, 0.0);
+        for(size_t j = 0; j < rows.size(); j++)
+        {
+            double delta = labels.get(rows[j], 0) - predictions.get(j, 0);
+            sse[batch] += (delta * delta);
+        }
+    });
+    double total = 0.0;
+    for(size_t i = 0; i < sse.size(); i++)
+        total += sse[i];
+    return sqrt(total / features.rows());
 }
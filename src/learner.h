@@ -9,8 +9,11 @@
 
 #include "matrix.h"
 #include "rand.h"
+#include <functional>
 #include <vector>
 
+class ArffReader;
+
 // This is the base class of supervised learning algorithms.
 class SupervisedLearner
 {
@@ -21,8 +24,40 @@ public:
 	// Train the model to predict the labels
 	virtual void train(Matrix& features, Matrix& labels) = 0;
 
-	// Evaluate the features and predict the labels
-	virtual void predict(const std::vector<double>& features, std::vector<double>& labels) = 0;
+	// Evaluate the features and predict the labels. (Prediction does not
+	// change the learner, so a trained model can predict from several
+	// threads at once. Any scratch space belongs to the call, or to the
+	// thread.)
+	virtual void predict(const std::vector<double>& features, std::vector<double>& labels) const = 0;
+
+	// Returns a new, untrained learner with the same settings as this one,
+	// which draws its random numbers from r (which must outlive it). The
+	// caller takes ownership. (crossValidate trains a clone for each fold,
+	// so that the folds can be trained at the same time.)
+	virtual SupervisedLearner* clone(Rand& r) = 0;
+
+	// Predicts the labels of every row of features, putting them in the
+	// same row of labels, which must already have a row for each row of
+	// features and a column for each label. (Its elements are the initial
+	// values of the predictions: measureAccuracy starts each one at the
+	// row's label, as it always has, and getMSE starts them at 0.)
+	// measureAccuracy and getMSE predict through this, a batch of rows at a
+	// time. By default, it calls predict (or predictSparse) for each row;
+	// learners that can predict many rows faster together should override
+	// it.
+	virtual void predictBatch(Matrix& features, Matrix& labels) const;
+
+	// Returns true if predictBatch may be called by several threads at once
+	// (which measureAccuracy and getMSE do when there are worker threads).
+	// It is true of every learner here, since prediction is const; one
+	// that keeps a cache in mutable members should return false, so that
+	// its rows are predicted serially.
+	virtual bool canPredictConcurrently() const { return true; }
+
+	// Evaluate a sparse row of features and predict the labels. (Learners
+	// that can work with sparse rows directly should override this. By
+	// default, it makes the row dense and calls predict.)
+	virtual void predictSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const;
 
 	// The model must be trained before you call this method. If the label is nominal,
 	// it returns the predictive accuracy. If the label is continuous, it returns
@@ -31,17 +66,55 @@ public:
 	// contain stats about the frequency of correct predictions with each label.
 	double measureAccuracy(Matrix& features, Matrix& labels, Matrix* pOutStats = NULL);
 
-	// Performs cross-validation. If verbose is true, it prints the accuracy to
-	// cout after each fold.
+	// Like measureAccuracy, but reads the rows to test from reader one batch
+	// at a time, so the test set does not need to fit in memory. The last
+	// labelDims columns of each row are the labels.
+	double measureAccuracy(ArffReader& reader, size_t labelDims, Matrix* pOutStats = NULL);
+
+	// Performs cross-validation. The folds (of every repetition) are
+	// trained and tested in parallel, each by its own clone of this learner
+	// with its own Rand, seeded from r in fold order, so the results do not
+	// depend on how many threads there are. (This learner is left
+	// untrained.) If verbose is true, it prints the accuracy to cout after
+	// each fold. Whatever a fold prints (including from parallel work of its
+	// own, which runs on the fold's thread) is held back and printed in fold
+	// order, along with its accuracy.
 	double crossValidate(size_t reps, size_t folds, Matrix& features, Matrix& labels, Rand& r, bool verbose = false);
 
     // Splits the feature set into feature and validation sets
     // feature matrix and corresponding labels altered in place
     // validation matrix and corresponding labels returned by reference
     // featurePercent - percentage of feature set retained
+    // (All four matrices share the original elements, so nothing is copied,
+    // and a change made through them is seen through the caller's matrices.)
     void splitValidationSet(Matrix& features, Matrix& labels, Matrix& validation, Matrix& validationLabels, const double featurePercent);
 
     double getMSE(Matrix& features, Matrix& labels);
+
+private:
+	// Checks that the labels can be used by measureAccuracy, and prepares pOutStats
+	void beginAccuracy(Matrix& features, Matrix& labels, Matrix* pOutStats);
+
+	// Returns the number of threads that measureAccuracy and getMSE predict
+	// with (1 unless the learner can predict concurrently)
+	size_t predictThreads() const;
+
+	// Predicts the rows of features a batch at a time (visiting a spilled
+	// matrix in the order of its blocks), on up to threads threads. Each
+	// thread takes the next batch when it is done with the last, so one
+	// call spreads all of the batches over the threads. The batches are
+	// numbered in the order they are taken. f is called with the number
+	// of each batch, its rows, and their predictions (which have labelDims
+	// columns, and start out as the same rows of pInitial, or as 0 if it is
+	// NULL). The calls to f are made one at a time, but not necessarily
+	// in order, so totals that should not depend on the number of threads
+	// should be kept for each batch and added up in order at the end.
+	void predictBatches(Matrix& features, size_t labelDims, const Matrix* pInitial, size_t threads, const std::function<void (size_t, const std::vector<size_t>&, Matrix&)>& f) const;
+
+	// Predicts each row of features. Adds the squared error (if the label is
+	// continuous) or 1 if the prediction is correct (if it is nominal) to
+	// total, and counts the predictions in pOutStats.
+	void accumulateAccuracy(Matrix& features, Matrix& labels, double& total, Matrix* pOutStats);
 };
 
 
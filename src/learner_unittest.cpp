@@ -0,0 +1,231 @@
+#include "learner.h"
+#include "filter.h"
+#include "perceptron.h"
+#include "knn.h"
+#include "backprop.h"
+#include "parallel.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "tests/include/gtest/gtest.h"
+
+// Loads a dataset of two continuous features with a label that is 1 when
+// their sum is positive (with a little noise). (With more classes, the
+// label is the number of the thresholds around 0, a unit apart, that the
+// sum is above.)
+void makeDataset(Matrix& features, Matrix& labels, size_t rows, size_t classes = 2)
+{
+    std::string filename = "learner_unittest.tmp.arff";
+    {
+        Rand r(5);
+        std::ofstream out(filename.c_str());
+        out << "@attribute x real\n@attribute y real\n@attribute class {0";
+        for (size_t c = 1; c < classes; ++c)
+            out << "," << c;
+        out << "}\n@data\n";
+        for (size_t i = 0; i < rows; ++i)
+        {
+            double x = r.normal();
+            double y = r.normal();
+            double sum = x + y + 0.3 * r.normal();
+            size_t label = 0;
+            while (label + 1 < classes && sum > label - (classes - 2) / 2.0)
+                ++label;
+            out << x << "," << y << "," << label << "\n";
+        }
+    }
+    Matrix data;
+    data.loadARFF(filename);
+    remove(filename.c_str());
+    features.copyPart(data, 0, 0, rows, 2);
+    labels.copyPart(data, 0, 2, rows, 1);
+}
+
+// Runs crossValidate with the specified number of threads, and returns
+// what it printed
+std::string crossValidate(SupervisedLearner& learner, size_t threads, double& accuracy)
+{
+    Matrix features, labels;
+    makeDataset(features, labels, 90);
+    std::ostringstream out;
+    std::streambuf* pOld = std::cout.rdbuf(out.rdbuf());
+    setWorkerCount(threads);
+    Rand r(11);
+    accuracy = learner.crossValidate(2, 5, features, labels, r, true);
+    setWorkerCount(0);
+    std::cout.rdbuf(pOld);
+    return out.str();
+}
+
+TEST(CrossValidateTest, sameForAnyThreadCount)
+{
+    Rand r(0);
+    Normalize learner(new Perceptron(r));
+    double serial, parallel;
+    std::string serialOut = crossValidate(learner, 1, serial);
+    std::string parallelOut = crossValidate(learner, 4, parallel);
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serialOut, parallelOut);
+    EXPECT_LT(0.8, serial);
+
+    // Each fold's output comes before its results, in fold order
+    size_t first = serialOut.find("Rep, 0 - Fold, 0");
+    size_t last = serialOut.find("Rep, 1 - Fold, 4");
+    ASSERT_NE(std::string::npos, first);
+    ASSERT_NE(std::string::npos, last);
+    EXPECT_LT(first, last);
+    EXPECT_LT(serialOut.find("Epochs completed"), first);
+    EXPECT_EQ(std::string::npos, serialOut.find("Rep, 2"));
+}
+
+// A learner that prints from parallel work while it trains, and always predicts 0
+class ChattyLearner : public SupervisedLearner
+{
+public:
+    void train(Matrix& features, Matrix&)
+    {
+        parallelFor(8, [&](size_t i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); // (so that any other threads get some of the parts)
+            std::cout << "Training on " << features.rows() << " rows, part " << i << "\n";
+        });
+    }
+
+    void predict(const std::vector<double>&, std::vector<double>& labels) const { labels[0] = 0.0; }
+
+    SupervisedLearner* clone(Rand&) { return new ChattyLearner(); }
+};
+
+TEST(CrossValidateTest, nestedOutputStaysWithItsFold)
+{
+    ChattyLearner learner;
+    double serial, parallel;
+    std::string serialOut = crossValidate(learner, 1, serial);
+    std::string parallelOut = crossValidate(learner, 4, parallel);
+    EXPECT_EQ(serialOut, parallelOut);
+    size_t part0 = serialOut.find("part 0");
+    ASSERT_NE(std::string::npos, part0);
+    EXPECT_LT(part0, serialOut.find("part 7"));
+    EXPECT_LT(serialOut.find("part 7"), serialOut.find("Rep, 0 - Fold, 0"));
+}
+
+// A learner whose predictions are whatever they started out as
+class UnchangedLearner : public SupervisedLearner
+{
+public:
+    void train(Matrix&, Matrix&) {}
+    void predict(const std::vector<double>&, std::vector<double>&) const {}
+    SupervisedLearner* clone(Rand&) { return new UnchangedLearner(); }
+};
+
+TEST(MeasureAccuracyTest, predictionsStartAtTheLabels)
+{
+    Matrix features, labels;
+    makeDataset(features, labels, 600);
+    UnchangedLearner learner;
+    EXPECT_EQ(1.0, learner.measureAccuracy(features, labels));
+
+    // (getMSE starts them at 0 instead)
+    double sse = 0.0;
+    for (size_t i = 0; i < labels.rows(); ++i)
+        sse += labels.get(i, 0) * labels.get(i, 0);
+    EXPECT_DOUBLE_EQ(std::sqrt(sse / labels.rows()), learner.getMSE(features, labels));
+}
+
+TEST(PredictBatchTest, sameAsPredict)
+{
+    Matrix features, labels;
+    makeDataset(features, labels, 300);
+    Rand r(0);
+    Normalize learner(new KNN(r));
+    learner.train(features, labels);
+
+    Matrix test, testLabels;
+    makeDataset(test, testLabels, 40);
+    Matrix predictions;
+    predictions.setSize(test.rows(), 1);
+    learner.predictBatch(test, predictions);
+    std::vector<double> row, prediction(1);
+    for (size_t i = 0; i < test.rows(); ++i)
+    {
+        test.getRow(i, row);
+        learner.predict(row, prediction);
+        EXPECT_EQ(prediction[0], predictions.get(i, 0));
+    }
+}
+
+TEST(MeasureAccuracyTest, sameForAnyThreadCount)
+{
+    Matrix features, labels;
+    makeDataset(features, labels, 300);
+    Rand r(0);
+    Normalize learner(new KNN(r));
+    learner.train(features, labels);
+    ASSERT_TRUE(learner.canPredictConcurrently());
+
+    Matrix test, testLabels;
+    makeDataset(test, testLabels, 2000);
+    Matrix serialStats, parallelStats;
+    setWorkerCount(1);
+    double serial = learner.measureAccuracy(test, testLabels, &serialStats);
+    setWorkerCount(4);
+    double parallel = learner.measureAccuracy(test, testLabels, &parallelStats);
+    setWorkerCount(0);
+    EXPECT_EQ(serial, parallel);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        for (size_t j = 0; j < 2; ++j)
+            EXPECT_EQ(serialStats.get(i, j), parallelStats.get(i, j));
+    }
+    EXPECT_EQ(2000.0, serialStats.get(0, 0) + serialStats.get(0, 1) + serialStats.get(1, 0) + serialStats.get(1, 1));
+}
+
+// Predicts every row of features with predict, from the specified number of
+// threads at once (each taking every threads'th row)
+std::vector<double> predictConcurrently(const SupervisedLearner& learner, Matrix& features, size_t threads)
+{
+    std::vector<double> predictions(features.rows());
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.push_back(std::thread([&, t]()
+        {
+            std::vector<double> row, prediction(1);
+            for (size_t i = t; i < features.rows(); i += threads)
+            {
+                features.getRow(i, row);
+                prediction[0] = 0.0;
+                learner.predict(row, prediction);
+                predictions[i] = prediction[0];
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads; ++t)
+        pool[t].join();
+    return predictions;
+}
+
+TEST(PredictTest, oneModelFromManyThreads)
+{
+    Matrix features, labels;
+    makeDataset(features, labels, 200, 3);
+    Rand r(0);
+    Backprop backprop(r, 20);
+    IVDM ivdm(r);
+    SupervisedLearner* learners[] = { &backprop, &ivdm };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        Matrix trainFeatures, trainLabels;
+        trainFeatures.copyPart(features, 0, 0, features.rows(), features.cols());
+        trainLabels.copyPart(labels, 0, 0, labels.rows(), labels.cols());
+        std::ostringstream out;
+        std::streambuf* pOld = std::cout.rdbuf(out.rdbuf());
+        learners[i]->train(trainFeatures, trainLabels);
+        std::cout.rdbuf(pOld);
+        EXPECT_EQ(predictConcurrently(*learners[i], features, 1), predictConcurrently(*learners[i], features, 4));
+    }
+}
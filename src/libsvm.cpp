@@ -0,0 +1,221 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "libsvm.h"
+#include "error.h"
+#include "inputfile.h"
+#include "parallel.h"
+#include "textscan.h"
+#include <algorithm>
+#include <cmath>
+
+using std::string;
+using std::vector;
+
+// The number of bytes read from the file at a time (per worker thread)
+#define LIBSVM_BLOCK_SIZE (4 * 1024 * 1024)
+
+// The smallest piece of a block worth giving to its own thread
+#define LIBSVM_MIN_CHUNK_SIZE (64 * 1024)
+
+namespace
+{
+	// Returns true if the label can be the value of a nominal label
+	bool isWhole(double label)
+	{
+		return label == std::floor(label) && std::fabs(label) < 1e15;
+	}
+
+	// Returns the name of the value of a nominal label
+	string labelName(double label)
+	{
+		return to_str((long long)label);
+	}
+}
+
+LibSvmParser::LibSvmParser(Matrix& matrix, Matrix* pSchema)
+: m_matrix(matrix), m_pSchema(pSchema), m_lineNum(0), m_width(0)
+{
+}
+
+void LibSvmParser::load(const string& filename)
+{
+	if(m_pSchema && m_pSchema->cols() == 0)
+		ThrowError("Expected the schema to have a label column");
+	LineReader reader(filename, LIBSVM_BLOCK_SIZE * workerCount());
+	m_matrix.setSize(0, 0);
+	m_matrix.m_filename = filename;
+	m_matrix.m_pSparse.reset(new SparseStorage());
+	m_lineNum = 0;
+	m_width = m_pSchema ? m_pSchema->cols() - 1 : 0;
+	m_labels.clear();
+	const char* begin;
+	const char* end;
+	while(reader.next(begin, end))
+		parseBlock(begin, end);
+	addLabels();
+}
+
+void LibSvmParser::parseBlock(const char* begin, const char* end)
+{
+	Chunk blank;
+	blank.width = 0;
+	SparseStorage& sparse = *m_matrix.m_pSparse;
+	parseLines(begin, end, LIBSVM_MIN_CHUNK_SIZE, '#', blank, m_lineNum,
+		[this](const char* lineBegin, const char* lineEnd, Chunk& chunk) { return parseLine(lineBegin, lineEnd, chunk); },
+		[&](Chunk& chunk)
+		{
+			size_t base = sparse.cols.size();
+			sparse.cols.insert(sparse.cols.end(), chunk.cols.begin(), chunk.cols.end());
+			sparse.values.insert(sparse.values.end(), chunk.values.begin(), chunk.values.end());
+			for(size_t j = 0; j < chunk.rowEnds.size(); j++)
+				sparse.rowStart.push_back(base + chunk.rowEnds[j]);
+			m_labels.insert(m_labels.end(), chunk.labels.begin(), chunk.labels.end());
+			m_width = std::max(m_width, chunk.width);
+			m_matrix.m_rows += chunk.rows;
+		});
+}
+
+bool LibSvmParser::parseLine(const char* p, const char* end, Chunk& chunk) const
+{
+	// Parse the label
+	const char* tok = p;
+	while(p != end && !isSpace(*p))
+		p++;
+	double label;
+	if(!parseNumber(tok, p, label))
+	{
+		chunk.error = "Expected a label, found \"" + string(tok, p) + "\"";
+		return false;
+	}
+
+	// Parse the features
+	size_t last = 0; // the index of the previous feature
+	while(true)
+	{
+		p = skipSpace(p, end);
+		if(p == end || *p == '#')
+			break;
+		tok = p;
+		while(p != end && !isSpace(*p))
+			p++;
+		const char* colon = (const char*)memchr(tok, ':', p - tok);
+		if(!colon)
+		{
+			chunk.error = "Expected index:value, found \"" + string(tok, p) + "\"";
+			return false;
+		}
+		if(colon - tok == 3 && memcmp(tok, "qid", 3) == 0)
+			continue;
+		size_t index;
+		std::from_chars_result res = std::from_chars(tok, colon, index);
+		if(res.ec != std::errc() || res.ptr != colon || index == 0)
+		{
+			chunk.error = "Expected a feature index, found \"" + string(tok, colon) + "\"";
+			return false;
+		}
+		if(index <= last)
+		{
+			chunk.error = "Expected the feature indices of a row to be in increasing order";
+			return false;
+		}
+		last = index;
+		if(m_pSchema && index > m_width)
+		{
+			chunk.error = "Feature " + to_str(index) + " is out of range";
+			return false;
+		}
+		double value;
+		if(!parseNumber(colon + 1, p, value))
+		{
+			chunk.error = "Expected a number, found \"" + string(colon + 1, p) + "\"";
+			return false;
+		}
+		if(value != 0.0)
+		{
+			chunk.cols.push_back(index - 1);
+			chunk.values.push_back(value);
+		}
+	}
+	chunk.width = std::max(chunk.width, last);
+	chunk.labels.push_back(label);
+	chunk.rowEnds.push_back(chunk.cols.size());
+	return true;
+}
+
+void LibSvmParser::addLabels()
+{
+	// Give the matrix its meta-data, and turn nominal labels into enumerations
+	if(m_pSchema)
+	{
+		m_matrix.m_pSchema = m_pSchema->m_pSchema;
+		const Matrix::Attribute& attr = m_matrix.attribute(m_width);
+		if(!attr.enumToStr.empty())
+		{
+			for(size_t i = 0; i < m_labels.size(); i++)
+			{
+				size_t e = isWhole(m_labels[i]) ? attr.strToEnum.find(labelName(m_labels[i])) : Dictionary::NOT_FOUND;
+				if(e == Dictionary::NOT_FOUND)
+					ThrowError("Unrecognized label ", to_str(m_labels[i]), " for attribute ", attr.name);
+				m_labels[i] = (double)e;
+			}
+		}
+	}
+	else
+	{
+		Matrix::Schema& schema = m_matrix.ownSchema();
+		for(size_t i = 0; i < m_width; i++)
+		{
+			boost::shared_ptr<Matrix::Attribute> pAttr(new Matrix::Attribute());
+			pAttr->name = "f" + to_str(i + 1);
+			schema.push_back(pAttr);
+		}
+		boost::shared_ptr<Matrix::Attribute> pLabel(new Matrix::Attribute());
+		pLabel->name = "class";
+		schema.push_back(pLabel);
+		if(std::all_of(m_labels.begin(), m_labels.end(), isWhole))
+		{
+			vector<double> values(m_labels);
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+			for(size_t i = 0; i < values.size(); i++)
+			{
+				pLabel->strToEnum.set(labelName(values[i]), i);
+				pLabel->enumToStr.push_back(labelName(values[i]));
+			}
+			for(size_t i = 0; i < m_labels.size(); i++)
+				m_labels[i] = (double)(std::lower_bound(values.begin(), values.end(), m_labels[i]) - values.begin());
+		}
+	}
+
+	// Add the labels that are not zero to the ends of the rows, moving
+	// the elements back from the last row to the first
+	SparseStorage& sparse = *m_matrix.m_pSparse;
+	size_t to = sparse.cols.size() + (m_labels.size() - std::count(m_labels.begin(), m_labels.end(), 0.0));
+	sparse.cols.resize(to);
+	sparse.values.resize(to);
+	for(size_t i = m_labels.size(); i-- > 0; )
+	{
+		size_t rowBegin = sparse.rowStart[i];
+		size_t rowEnd = sparse.rowStart[i + 1];
+		sparse.rowStart[i + 1] = to;
+		if(m_labels[i] != 0.0)
+		{
+			to--;
+			sparse.cols[to] = m_width;
+			sparse.values[to] = m_labels[i];
+		}
+		std::move_backward(sparse.cols.begin() + rowBegin, sparse.cols.begin() + rowEnd, sparse.cols.begin() + to);
+		std::move_backward(sparse.values.begin() + rowBegin, sparse.values.begin() + rowEnd, sparse.values.begin() + to);
+		to -= rowEnd - rowBegin;
+	}
+	m_matrix.m_pData.reset(new MatrixStorage());
+	m_matrix.m_stride = m_width + 1;
+
+	// There are no missing values
+	m_matrix.forgetColumnInfo();
+	for(size_t j = 0; j <= m_width; j++)
+		m_matrix.setComplete(j);
+}
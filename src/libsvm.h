@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef LIBSVM_H
+#define LIBSVM_H
+
+#include "matrix.h"
+#include "inputfile.h"
+#include <string>
+#include <vector>
+
+// Loads a file in the sparse format of LibSVM (and SVMlight) into a
+// sparse Matrix (see Matrix::sparseRow). Each line holds a label followed
+// by the features that are not zero, as "index:value" pairs with 1-based
+// indices in increasing order, such as "+1 3:0.5 17:2". ("qid:" pairs and
+// anything after a '#' are ignored.)
+//
+// Feature i is put in column i - 1 (named "f<i>"), and the label in the
+// last column (named "class"), so the matrix can be given to a learner
+// like any other. The features are continuous. Unless a schema is given,
+// the label is nominal, with its distinct values in increasing order, if
+// every label is an integer, and continuous otherwise. A schema (usually
+// the training set) gives the number of features and the values of the
+// label instead, so a test set gets the same columns as the training set.
+//
+// Like ArffParser, the file is read in large blocks (see LineReader), and
+// each block is split into newline-aligned chunks that are parsed
+// concurrently.
+class LibSvmParser
+{
+private:
+	// The rows parsed from one newline-aligned piece of a block
+	struct Chunk : public LineChunk
+	{
+		std::vector<size_t> cols; // the column of each feature that is not zero
+		std::vector<double> values; // the value of each of those features
+		std::vector<size_t> rowEnds; // the end of each row in cols and values
+		std::vector<double> labels; // the label of each row
+		size_t width; // one more than the largest feature column
+	};
+
+	Matrix& m_matrix;
+	Matrix* m_pSchema;
+	size_t m_lineNum;
+	size_t m_width; // the number of feature columns
+	std::vector<double> m_labels; // the label of each row
+
+public:
+	// Reads into matrix. If pSchema is non-NULL, the file may not have more
+	// features than it has columns before its last, and the labels must be
+	// values of its last column.
+	LibSvmParser(Matrix& matrix, Matrix* pSchema = NULL);
+
+	// Reads the specified file into the matrix. (Anything that was already
+	// in the matrix is replaced.)
+	void load(const std::string& filename);
+
+private:
+	// Parses the lines in [begin, end) and appends their features to the matrix
+	void parseBlock(const char* begin, const char* end);
+
+	// Parses one line into the chunk. Returns false, and describes the
+	// problem in chunk.error, if it fails. (This is called concurrently
+	// for different chunks.)
+	bool parseLine(const char* begin, const char* end, Chunk& chunk) const;
+
+	// Gives the matrix its meta-data, and adds the label to the end of each row
+	void addLabels();
+};
+
+#endif // LIBSVM_H
@@ -13,6 +13,8 @@
 #include "backprop.h"
 #include "decisiontree.h"
 #include "knn.h"
+#include "arff.h"
+#include "search.h"
 #include <iostream>
 #include <fstream>
 #include <map>
@@ -37,12 +39,16 @@ using namespace std;
 class ArgParser
 {
 	string arff;
+	string exportBin;
+	string schema;
 	string learner;
 	string evaluation;
 	char* evalExtra;
 	bool normalize;
 	bool nominal_to_cat;
 	bool discretize;
+	bool cache;
+	Matrix::Layout layout;
 	unsigned int seed;
 
 public:
@@ -50,18 +56,30 @@ public:
 	ArgParser ( char* argv[], int argc )
 	{
 		arff = "";
+		exportBin = "";
+		schema = "";
 		learner = "";
 		evaluation = "";
 		seed = (unsigned int)time ( NULL );
 		normalize = false;
 		nominal_to_cat = false;
 		discretize = false;
+		cache = false;
+		layout = Matrix::DENSE;
 		for ( int i = 1; i < argc; i++ )
 		{
 			if ( strcmp ( argv[i], "-A" ) == 0 )
 			{
 				arff = argv[++i];
 			}
+			else if ( strcmp ( argv[i], "--export-bin" ) == 0 )
+			{
+				exportBin = argv[++i];
+			}
+			else if ( strcmp ( argv[i], "--schema" ) == 0 )
+			{
+				schema = argv[++i];
+			}
 			else if ( strcmp ( argv[i], "-L" ) == 0 )
 			{
 				learner = argv[++i];
@@ -76,6 +94,8 @@ public:
 				else if ( strcmp ( argv[i], "cross" ) == 0 )
 					
 					evalExtra = argv[++i]; //expecting the number of folds
+				else if ( strcmp ( argv[i], "search" ) == 0 )
+					evalExtra = argv[++i]; //expecting a grid of parameters, like "k=1,3,5"
 				else if ( strcmp ( argv[i], "training" ) != 0 )
 					ThrowError ( "Invalid Evaluation Method: ", argv[i] );
 			}
@@ -87,30 +107,63 @@ public:
 				discretize = true;
 			else if ( strcmp ( argv[i], "-R" ) == 0 )
 				seed = atoi ( argv[++i] );
+			else if ( strcmp ( argv[i], "--cache" ) == 0 )
+				cache = true;
+			else if ( strcmp ( argv[i], "--compact" ) == 0 )
+			{
+				if ( layout == Matrix::DENSE )
+					layout = Matrix::COMPACT;
+			}
+			else if ( strcmp ( argv[i], "--float32" ) == 0 )
+				layout = Matrix::COMPACT_FLOAT;
+			else if ( strcmp ( argv[i], "--spill" ) == 0 )
+				layout = Matrix::SPILL;
 			else
 				ThrowError ( "Invalid paramater: ", argv[i] );
 		}
-		if ( arff == "" || learner == "" || evaluation == "" )
+		if ( arff == "" || ( exportBin == "" && ( learner == "" || evaluation == "" ) ) )
 		{
 			cout << "Missing parameters.  Usage:\n"
 			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E [EvaluationMethod] {[ExtraParameters]} [-N] [-R seed]\n\n"
+			<< "The dataset may be an ARFF file, a CSV file (.csv) with a line of column names, a LibSVM file (.libsvm\n"
+			<< "or .svm), or a binary dataset (.mlb) file. Text files may be compressed with gzip (.gz) or zstd (.zst).\n"
+			<< "The columns of a CSV file that hold values other than numbers near the start of the file are nominal.\n"
+			<< "Add --schema [ARFF_File] to take the columns and their values from the header of an ARFF file instead.\n"
+			<< "To convert a dataset to a binary dataset:\n"
+			<< "MLSystemManager -A [ARFF_File] --export-bin [MLB_File]\n"
+			<< "Add --cache to keep parsed ARFF files in a sidecar cache ([ARFF_File].cache) for later runs.\n"
+			<< "Add --compact to keep nominal attributes in one or two bytes each, and --float32 to also keep\n"
+			<< "continuous attributes as floats (which rounds them). Add --spill to keep a dataset that is too big\n"
+			<< "for memory in a temporary file (in $TMPDIR), reading it a block at a time. (A binary dataset is\n"
+			<< "already read from its file as it is needed.)\n\n"
 			<< "Possible evaluation methods are:\n"
 			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E training\n"
 			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E static [TestARFF_File]\n"
 			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E random [PercentageForTraining]\n"
-			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E cross [numOfFolds]\n\n";
+			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E cross [numOfFolds]\n"
+			<< "MLSystemManager -L [learningAlgorithm] -A [ARFF_File] -E search [ParameterGrid]\n\n"
+			<< "A search tries every setting in a grid of the learner's parameters, like\n"
+			<< "\"learningRate=0.1,0.3;momentum=0,0.5;hiddenLayers=1,2;hiddenNodes=8,16\" for backprop (which also\n"
+			<< "takes maxEpochs) or \"k=1,3,5,7\" for knn and ivdm. It holds out a quarter of the rows to score the\n"
+			<< "settings with, and trains them all on a small part of the rest. Only the better half goes on to\n"
+			<< "train on twice as many rows, and so on, until the best one is trained on all of them. Then it\n"
+			<< "prints the settings, ranked.\n\n";
 			ThrowError ( "Missing parameters" );
 		}
 	}
 
 	//The getter methods
 	string getARFF() { return arff; }
+	string getExportBin() { return exportBin; }
+	string getSchema() { return schema; }
 	string getLearner() { return learner; }
 	string getEvaluation() { return evaluation; }
 	char* getEvalExtra() { return evalExtra; }
 	bool getNormal() { return normalize; }
 	bool getNominalToCat() { return nominal_to_cat; }
 	bool getDiscretize() { return discretize; }
+	bool getCache() { return cache; }
+	Matrix::Layout getLayout() { return layout; }
 	unsigned int getSeed() { return seed; }
 };
 
@@ -129,55 +182,169 @@ double getTime()
 #endif
 }
 
-SupervisedLearner* getLearner(string model, Rand& r)
+// Throws if a setting has any parameter that is not in the list of those the model takes
+void expectParams(const string& model, const ParamSetting& setting, const vector<string>& names)
+{
+	for ( size_t i = 0; i < setting.size(); i++ )
+	{
+		if ( find ( names.begin(), names.end(), setting[i].first ) == names.end() )
+			ThrowError ( "The ", model, " learner has no parameter named ", setting[i].first );
+	}
+}
+
+// Returns the value of a parameter that must be a whole number, or defaultValue if the setting does not name it
+size_t wholeParam(const ParamSetting& setting, const string& name, size_t defaultValue)
+{
+	double value = paramValue ( setting, name, (double)defaultValue );
+	if ( value < 0.0 || value != floor ( value ) )
+		ThrowError ( "Expected ", name, " to be a whole number, not ", to_str ( value ) );
+	return (size_t)value;
+}
+
+// Returns a new learner of the specified model. The setting gives values for
+// some of its parameters (see -E search); the rest keep their defaults.
+SupervisedLearner* getLearner(string model, Rand& r, const ParamSetting& setting = ParamSetting())
 {
+	if (model.compare("backprop") == 0)
+	{
+		expectParams ( model, setting, { "maxEpochs", "learningRate", "momentum", "hiddenLayers", "hiddenNodes" } );
+		return new Backprop(r, (int)wholeParam(setting, "maxEpochs", Backprop::MAX_EPOCHS),
+			paramValue(setting, "learningRate", Backprop::LEARNING_RATE), paramValue(setting, "momentum", Backprop::MOMENTUM),
+			(int)wholeParam(setting, "hiddenLayers", Backprop::HIDDEN_LAYERS), (int)wholeParam(setting, "hiddenNodes", Backprop::HIDDEN_NODES));
+	}
+	else if (model.compare("knn") == 0 || model.compare("ivdm") == 0)
+	{
+		expectParams ( model, setting, { "k" } );
+		size_t k = wholeParam ( setting, "k", KNN::K );
+		if (model.compare("knn") == 0)
+			return new KNN(r, k);
+		return new IVDM(r, k);
+	}
+	expectParams ( model, setting, vector<string>() );
 	if (model.compare("baseline") == 0)
 		return new BaselineLearner(r);
     else if (model.compare("perceptron") == 0)
         return new Perceptron(r);
     else if (model.compare("nbperceptron") == 0)
         return new NBPerceptron(r);
-    else if (model.compare("backprop") == 0)
-        return new Backprop(r);
 	else if (model.compare("neuralnet") == 0)
 		ThrowError("Sorry, ", model, " is not yet implemented");
 	else if (model.compare("decisiontree") == 0)
         return new DecisionTree(r);
 	else if (model.compare("naivebayes") == 0)
 		ThrowError("Sorry, ", model, " is not yet implemented");
-	else if (model.compare("knn") == 0)
-        return new KNN(r);
-	else if (model.compare("ivdm") == 0)
-        return new IVDM(r);
 	else
 		ThrowError("Unrecognized model: ", model);
 	return NULL;
 }
 
-void doit(ArgParser& parser)
+// The kinds of dataset files
+enum DatasetFormat
 {
-	// Load the model
-	Rand r ( parser.getSeed() );
-	string model = parser.getLearner();
-	SupervisedLearner* learner = getLearner ( model, r );
+	ARFF_DATASET,
+	CSV_DATASET,
+	LIBSVM_DATASET,
+	BINARY_DATASET,
+};
+
+// Returns true if the file name ends with the specified extension
+bool hasExtension(const string& filename, const string& ext)
+{
+	return filename.size() >= ext.size() && filename.compare ( filename.size() - ext.size(), ext.size(), ext ) == 0;
+}
+
+// Returns the kind of a dataset file from the extension of its name. (The
+// extension of a compressed file, ".gz" or ".zst", is passed over.) Any
+// file that is not recognized is taken to be an ARFF file.
+DatasetFormat datasetFormat(string filename)
+{
+	if ( hasExtension ( filename, ".mlb" ) )
+		return BINARY_DATASET;
+	if ( hasExtension ( filename, ".gz" ) )
+		filename.resize ( filename.size() - 3 );
+	else if ( hasExtension ( filename, ".zst" ) )
+		filename.resize ( filename.size() - 4 );
+	if ( hasExtension ( filename, ".csv" ) )
+		return CSV_DATASET;
+	if ( hasExtension ( filename, ".libsvm" ) || hasExtension ( filename, ".svm" ) )
+		return LIBSVM_DATASET;
+	return ARFF_DATASET;
+}
+
+// Loads a dataset, which may be an ARFF, CSV, LibSVM or binary dataset
+// (.mlb) file. If useCache is true, parsed ARFF files are cached next to
+// the originals. If schemaFile is not empty, a CSV or LibSVM file is read
+// with the columns in the header of that ARFF file. The elements are kept
+// in the specified layout (unless the file is sparse, or a binary dataset
+// is to be spilled).
+void loadDataset(Matrix& m, const string& filename, bool useCache, Matrix::Layout layout, const string& schemaFile)
+{
+	DatasetFormat format = datasetFormat ( filename );
+	Matrix schema;
+	if ( schemaFile != "" )
+	{
+		if ( format != CSV_DATASET && format != LIBSVM_DATASET )
+			ThrowError ( "A schema can only be given for a CSV or LibSVM file" );
+		ArffParser schemaParser ( schema );
+		schemaParser.open ( schemaFile );
+	}
+	Matrix* pSchema = schemaFile == "" ? NULL : &schema;
+	if ( format == BINARY_DATASET )
+	{
+		m.loadBinary ( filename );
+		if ( layout == Matrix::COMPACT || layout == Matrix::COMPACT_FLOAT )
+			m.compact ( layout == Matrix::COMPACT_FLOAT );
+	}
+	else if ( format == CSV_DATASET )
+		m.loadCSV ( filename, pSchema, layout );
+	else if ( format == LIBSVM_DATASET )
+		m.loadLibSVM ( filename, pSchema );
+	else
+		m.loadARFF ( filename, useCache, layout );
+}
+
+// Converts a dataset to a binary dataset file
+void exportBinary(ArgParser& parser)
+{
+	Matrix dataset;
+	double timeBeforeLoading = getTime();
+	loadDataset ( dataset, parser.getARFF(), parser.getCache(), parser.getLayout(), parser.getSchema() );
+	double timeAfterLoading = getTime();
+	dataset.saveBinary ( parser.getExportBin() );
+	cout << "Wrote " << dataset.rows() << " rows and " << dataset.cols() << " attributes to " << parser.getExportBin() << "\n";
+	cout << "Loading time, " << (timeAfterLoading - timeBeforeLoading) << " seconds\n";
+}
 
-	// Wrap the learner with the specified filters
+// Returns a new learner of the model that the arguments specify, wrapped
+// with the filters that they specify
+SupervisedLearner* makeLearner(ArgParser& parser, Rand& r, const ParamSetting& setting = ParamSetting())
+{
+	SupervisedLearner* learner = getLearner ( parser.getLearner(), r, setting );
 	if ( parser.getNominalToCat() )
 		learner = new NominalToCategorical( learner );
 	if ( parser.getNormal() )
 		learner = new Normalize( learner );
 	if ( parser.getDiscretize() )
 		learner = new Discretize( learner );
+	return learner;
+}
+
+void doit(ArgParser& parser)
+{
+	// Load the model, wrapped with the specified filters
+	Rand r ( parser.getSeed() );
+	string model = parser.getLearner();
+	SupervisedLearner* learner = makeLearner ( parser, r );
 
 	// This line says to "delete(learner)" when this object (ap_learner) goes out of scope. This
 	// technique is better than just calling "delete(learner)" ourselves at the end
 	// of this method because this will clean up memory even if an exception is thrown.
-	auto_ptr<SupervisedLearner> ap_learner ( learner );
+	unique_ptr<SupervisedLearner> ap_learner ( learner );
 
 	// Load the ARFF file
 	string fileName = parser.getARFF();
 	Matrix dataset;
-	dataset.loadARFF ( fileName );
+	loadDataset ( dataset, fileName, parser.getCache(), parser.getLayout(), parser.getSchema() );
 	size_t labelDims = 1;
 
 	// Display some values
@@ -190,9 +357,8 @@ void doit(ArgParser& parser)
 	if ( evaluation.compare ( "training" ) == 0 )
 	{
 		// Train
-		Matrix trainFeatures, trainLabels;
-		trainFeatures.copyPart(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
-		trainLabels.copyPart(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
+		MatrixView trainFeatures(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
+		MatrixView trainLabels(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
 		double timeBeforeTraining = getTime();
 		learner->train(trainFeatures, trainLabels);
 		double timeAfterTraining = getTime();
@@ -217,9 +383,8 @@ void doit(ArgParser& parser)
 	else if ( evaluation.compare ( "static" ) == 0 )
 	{
 		// Train
-		Matrix trainFeatures, trainLabels;
-		trainFeatures.copyPart(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
-		trainLabels.copyPart(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
+		MatrixView trainFeatures(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
+		MatrixView trainLabels(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
 		double timeBeforeTraining = getTime();
 		learner->train(trainFeatures, trainLabels);
 		double timeAfterTraining = getTime();
@@ -239,14 +404,31 @@ void doit(ArgParser& parser)
 		if(!parser.getEvalExtra())
 			ThrowError("Expected a test dataset to be specified");
 		string testSetFilename = parser.getEvalExtra();
-		Matrix testSet;
-		testSet.loadARFF(testSetFilename);
-		dataset.checkCompatibility(testSet);
-		Matrix testFeatures, testLabels;
-		testFeatures.copyPart(testSet, 0, 0, testSet.rows(), testSet.cols() - labelDims);
-		testLabels.copyPart(testSet, 0, testSet.cols() - labelDims, testSet.rows(), labelDims);
 		double timeBeforeTesting = getTime();
-		accuracy = learner->measureAccuracy(testFeatures, testLabels, &stats);
+		DatasetFormat testFormat = datasetFormat ( testSetFilename );
+		if ( testFormat != ARFF_DATASET )
+		{
+			// Read CSV and LibSVM test sets with the columns of the training set
+			Matrix testSet;
+			if ( testFormat == CSV_DATASET )
+				testSet.loadCSV(testSetFilename, &dataset);
+			else if ( testFormat == LIBSVM_DATASET )
+				testSet.loadLibSVM(testSetFilename, &dataset);
+			else
+			{
+				testSet.loadBinary(testSetFilename);
+				dataset.checkCompatibility(testSet);
+			}
+			MatrixView testFeatures(testSet, 0, 0, testSet.rows(), testSet.cols() - labelDims);
+			MatrixView testLabels(testSet, 0, testSet.cols() - labelDims, testSet.rows(), labelDims);
+			accuracy = learner->measureAccuracy(testFeatures, testLabels, &stats);
+		}
+		else
+		{
+			// Stream the test set, so it does not need to fit in memory
+			ArffReader testReader(testSetFilename, dataset);
+			accuracy = learner->measureAccuracy(testReader, labelDims, &stats);
+		}
 		double timeAfterTesting = getTime();
 
 		// Print results
@@ -268,14 +450,12 @@ void doit(ArgParser& parser)
 			ThrowError("Expected the percentage to be between 0 and 1\n");
 		size_t trainRows = (size_t)floor(dataset.rows() * trainPercent + 0.5);
 		dataset.shuffleRows(r);
-		Matrix trainSet, testSet;
-		trainSet.copyPart(dataset, 0, 0, trainRows, dataset.cols());
-		testSet.copyPart(dataset, trainRows, 0, dataset.rows() - trainRows, dataset.cols());
+		MatrixView trainSet(dataset, 0, 0, trainRows, dataset.cols());
+		MatrixView testSet(dataset, trainRows, 0, dataset.rows() - trainRows, dataset.cols());
 
 		// Train
-		Matrix trainFeatures, trainLabels;
-		trainFeatures.copyPart(trainSet, 0, 0, trainSet.rows(), trainSet.cols() - labelDims);
-		trainLabels.copyPart(trainSet, 0, trainSet.cols() - labelDims, trainSet.rows(), labelDims);
+		MatrixView trainFeatures(trainSet, 0, 0, trainSet.rows(), trainSet.cols() - labelDims);
+		MatrixView trainLabels(trainSet, 0, trainSet.cols() - labelDims, trainSet.rows(), labelDims);
 		double timeBeforeTraining = getTime();
 		learner->train(trainFeatures, trainLabels);
 		double timeAfterTraining = getTime();
@@ -293,9 +473,8 @@ void doit(ArgParser& parser)
 		cout.flush();
 
 		// Test on the test set
-		Matrix testFeatures, testLabels;
-		testFeatures.copyPart(testSet, 0, 0, testSet.rows(), testSet.cols() - labelDims);
-		testLabels.copyPart(testSet, 0, testSet.cols() - labelDims, testSet.rows(), labelDims);
+		MatrixView testFeatures(testSet, 0, 0, testSet.rows(), testSet.cols() - labelDims);
+		MatrixView testLabels(testSet, 0, testSet.cols() - labelDims, testSet.rows(), labelDims);
 		double timeBeforeTesting = getTime();
 		accuracy = learner->measureAccuracy(testFeatures, testLabels, &stats);
 		double timeAfterTesting = getTime();
@@ -315,9 +494,8 @@ void doit(ArgParser& parser)
 		if(!parser.getEvalExtra())
 			ThrowError("Expected the number of folds to be specified");
 		size_t folds = atoi ( parser.getEvalExtra() );
-		Matrix features, labels;
-		features.copyPart(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
-		labels.copyPart(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
+		MatrixView features(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
+		MatrixView labels(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
 		double accuracy = learner->crossValidate(1, folds, features, labels, r, true);
 		if(labels.valueCount(0) == 0)
 			cout << "Root Mean Squared Error, " << accuracy << "\n";
@@ -325,6 +503,30 @@ void doit(ArgParser& parser)
 			cout << "Mean predictive accuracy, " << accuracy << "\n";
 		cout.flush();
 	}
+	else if ( evaluation.compare ( "search" ) == 0 )
+	{
+		if(!parser.getEvalExtra())
+			ThrowError("Expected a grid of parameters to be specified");
+		ParamGrid grid ( parser.getEvalExtra() );
+		MatrixView features(dataset, 0, 0, dataset.rows(), dataset.cols() - labelDims);
+		MatrixView labels(dataset, 0, dataset.cols() - labelDims, dataset.rows(), labelDims);
+		cout << "Parameter settings: " << grid.size() << endl;
+		double timeBeforeSearch = getTime();
+		vector<SearchResult> results = successiveHalving ( grid, [&](const ParamSetting& setting, Rand& rand)
+		{
+			return makeLearner ( parser, rand, setting );
+		}, features, labels, r );
+		double timeAfterSearch = getTime();
+
+		// Print results
+		bool continuous = labels.valueCount(0) == 0;
+		cout << "\n\nSearch results: (ranked by the rounds each setting lasted, then by its score on the validation set)\n";
+		cout << "Rank, Rounds, Training rows, " << ( continuous ? "Root Mean Squared Error" : "Accuracy" ) << ", Setting\n";
+		for ( size_t i = 0; i < results.size(); i++ )
+			cout << i + 1 << ", " << results[i].rounds << ", " << results[i].trainingRows << ", " << results[i].score << ", " << describeSetting ( results[i].setting ) << "\n";
+		cout << "\nSearch time, " << (timeAfterSearch - timeBeforeSearch) << " seconds\n";
+		cout.flush();
+	}
 }
 
 int main(int argc, char *argv[])
@@ -351,7 +553,10 @@ int main(int argc, char *argv[])
 		ArgParser parser(argv, argc);
 
 		// do what they say to do
-		doit(parser);
+		if(parser.getExportBin() != "")
+			exportBinary(parser);
+		else
+			doit(parser);
 	}
 	catch(const std::exception& e)
 	{
@@ -4,126 +4,943 @@
 // ----------------------------------------------------------------
 
 #include "matrix.h"
+#include "arff.h"
+#include "csv.h"
+#include "libsvm.h"
+#include "mlbfile.h"
 #include "rand.h"
 #include "error.h"
-#include <fstream>
+#include "simd.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
 
 using std::string;
-using std::ifstream;
 using std::map;
 using std::vector;
 
+// The number of rows that Matrix::compact converts at a time
+#define COMPACT_BATCH_ROWS 1024
+
+namespace
+{
+	// Returns true if val is one of the values (enumerations) of a nominal column with the specified number of values
+	inline bool isValue(double val, size_t values)
+	{
+		return val >= 0.0 && val < (double)values && val == (double)(size_t)val;
+	}
+
+	// Converts an element of a nominal column to a code of type T
+	template<class T>
+	T toCode(double val, size_t values, T missing)
+	{
+		if(val == UNKNOWN_VALUE)
+			return missing;
+		if(!isValue(val, values))
+			ThrowError("The value ", to_str(val), " is not one of the values of a nominal column");
+		return (T)val;
+	}
+}
+
+const uint8_t ColumnStorage::MISSING8;
+const uint16_t ColumnStorage::MISSING16;
+
+ColumnStorage::ColumnStorage(const vector<size_t>& valueCounts, bool floats)
+: m_columns(valueCounts.size()), m_rows(0)
+{
+	for(size_t i = 0; i < valueCounts.size(); i++)
+	{
+		size_t values = valueCounts[i];
+		if(values == 0)
+			m_columns[i].type = floats ? FLOAT32 : FLOAT64;
+		else if(values <= MISSING8) // (the largest code means UNKNOWN_VALUE)
+			m_columns[i].type = UINT8;
+		else if(values <= MISSING16)
+			m_columns[i].type = UINT16;
+		else
+			m_columns[i].type = FLOAT64;
+		m_columns[i].values = values;
+		m_columns[i].missing = 0;
+	}
+}
+
+void ColumnStorage::append(const double* pRows, size_t rows)
+{
+	size_t cols = m_columns.size();
+	for(size_t c = 0; c < cols; c++)
+	{
+		Column& column = m_columns[c];
+		const double* p = pRows + c;
+		switch(column.type)
+		{
+			case UINT8:
+				column.uint8s.resize(m_rows + rows);
+				for(size_t i = 0; i < rows; i++, p += cols)
+					column.uint8s[m_rows + i] = toCode<uint8_t>(*p, column.values, MISSING8);
+				column.missing += std::count(column.uint8s.begin() + m_rows, column.uint8s.end(), MISSING8);
+				break;
+			case UINT16:
+				column.uint16s.resize(m_rows + rows);
+				for(size_t i = 0; i < rows; i++, p += cols)
+					column.uint16s[m_rows + i] = toCode<uint16_t>(*p, column.values, MISSING16);
+				column.missing += std::count(column.uint16s.begin() + m_rows, column.uint16s.end(), MISSING16);
+				break;
+			case FLOAT32:
+				column.floats.resize(m_rows + rows);
+				for(size_t i = 0; i < rows; i++, p += cols)
+				{
+					if(*p == UNKNOWN_VALUE)
+					{
+						column.floats[m_rows + i] = std::numeric_limits<float>::quiet_NaN();
+						column.missing++;
+					}
+					else
+						column.floats[m_rows + i] = (float)*p;
+				}
+				break;
+			case FLOAT64:
+				column.doubles.resize(m_rows + rows);
+				for(size_t i = 0; i < rows; i++, p += cols)
+				{
+					column.doubles[m_rows + i] = *p;
+					if(*p == UNKNOWN_VALUE)
+						column.missing++;
+				}
+				break;
+		}
+	}
+	m_rows += rows;
+}
+
+double ColumnStorage::get(size_t row, size_t col) const
+{
+	const Column& column = m_columns[col];
+	switch(column.type)
+	{
+		case UINT8: return toDouble(column.uint8s[row]);
+		case UINT16: return toDouble(column.uint16s[row]);
+		case FLOAT32: return toDouble(column.floats[row]);
+		default: return column.doubles[row];
+	}
+}
+
+void ColumnStorage::checkType(size_t col, Type type) const
+{
+	if(m_columns[col].type != type)
+		ThrowError("Column ", to_str(col), " is not kept in the requested type");
+}
+
+
+
+Matrix::Matrix()
+: m_pData(new MatrixStorage()), m_rows(0), m_stride(0), m_rowBegin(0), m_colBegin(0), m_infoVersion(0), m_pSchema(new Schema())
+{
+}
+
 Matrix::Matrix(Matrix& that)
+: m_pData(new MatrixStorage()), m_rows(0), m_stride(that.cols()), m_rowBegin(0), m_colBegin(0), m_infoVersion(0), m_pSchema(that.m_pSchema)
 {
-	m_attr_name = that.m_attr_name;
-	m_str_to_enum = that.m_str_to_enum;
-	m_enum_to_str = that.m_enum_to_str;
 }
 
 Matrix::Matrix(const Matrix& that)
+: m_pData(new MatrixStorage()), m_rows(0), m_stride(that.m_pSchema->size()), m_rowBegin(0), m_colBegin(0), m_infoVersion(0), m_pSchema(that.m_pSchema)
 {
-    m_attr_name = that.m_attr_name;
-	m_str_to_enum = that.m_str_to_enum;
-	m_enum_to_str = that.m_enum_to_str;
+}
+
+Matrix::Matrix(Matrix&& that)
+: Matrix()
+{
+	swap(that);
+}
+
+Matrix& Matrix::operator=(Matrix&& that)
+{
+	swap(that);
+	return *this;
+}
+
+void Matrix::swap(Matrix& that)
+{
+	m_pData.swap(that.m_pData);
+	m_pSparse.swap(that.m_pSparse);
+	m_pColumns.swap(that.m_pColumns);
+	m_pSpill.swap(that.m_pSpill);
+	std::swap(m_rows, that.m_rows);
+	std::swap(m_stride, that.m_stride);
+	std::swap(m_rowBegin, that.m_rowBegin);
+	std::swap(m_colBegin, that.m_colBegin);
+	m_rowIndex.swap(that.m_rowIndex);
+	m_colIndex.swap(that.m_colIndex);
+	m_columnInfo.swap(that.m_columnInfo);
+	m_pInfoData.swap(that.m_pInfoData);
+	std::swap(m_infoVersion, that.m_infoVersion);
+	m_filename.swap(that.m_filename);
+	m_pSchema.swap(that.m_pSchema);
+}
+
+Matrix::Schema& Matrix::ownSchema()
+{
+	if(!m_pSchema.unique())
+		m_pSchema.reset(new Schema(*m_pSchema));
+	return *m_pSchema;
+}
+
+Matrix::Attribute& Matrix::ownAttribute(size_t col)
+{
+	boost::shared_ptr<Attribute>& pAttr = ownSchema()[col];
+	if(!pAttr.unique())
+		pAttr.reset(new Attribute(*pAttr));
+	return *pAttr;
+}
+
+void Matrix::shareSchema(const Matrix& that, size_t colBegin, size_t colCount)
+{
+	if(colBegin == 0 && colCount == that.m_pSchema->size())
+		m_pSchema = that.m_pSchema;
+	else
+		m_pSchema.reset(new Schema(that.m_pSchema->begin() + colBegin, that.m_pSchema->begin() + colBegin + colCount));
+}
+
+const std::string& Matrix::attrValue(size_t attr, size_t val)
+{
+	static const std::string empty;
+	const vector<string>& enumToStr = attribute(attr).enumToStr;
+	return val < enumToStr.size() ? enumToStr[val] : empty;
+}
+
+size_t Matrix::nameValue(size_t attr, std::string_view name)
+{
+	size_t e = attribute(attr).strToEnum.find(name);
+	return e == Dictionary::NOT_FOUND ? 0 : e;
+}
+
+Matrix& Matrix::operator=(const Matrix& that)
+{
+	if(this != &that)
+	{
+		share(that);
+		if(!m_pSparse && !m_pColumns && !m_pSpill)
+			detach(); // (the storage is shared with that, so this copies it)
+	}
+	return *this;
+}
+
+void Matrix::share(const Matrix& that)
+{
+	m_pData = that.m_pData;
+	m_pSparse = that.m_pSparse;
+	m_pColumns = that.m_pColumns;
+	m_pSpill = that.m_pSpill;
+	m_rows = that.m_rows;
+	m_stride = that.m_stride;
+	m_rowBegin = that.m_rowBegin;
+	m_colBegin = that.m_colBegin;
+	m_rowIndex = that.m_rowIndex;
+	m_colIndex = that.m_colIndex;
+	m_columnInfo = that.m_columnInfo;
+	m_pInfoData = that.m_pInfoData;
+	m_infoVersion = that.m_infoVersion;
+	m_filename = that.m_filename;
+	m_pSchema = that.m_pSchema;
 }
 
 void Matrix::setSize(size_t rows, size_t cols)
 {
 	// Make space for the data
-	m_data.resize(rows);
-	for(size_t i = 0; i < rows; i++)
-		m_data[i].resize(cols);
+	m_pData.reset(new MatrixStorage(rows * cols, 0.0));
+	m_pSparse.reset();
+	m_pColumns.reset();
+	m_pSpill.reset();
+	m_rows = rows;
+	m_stride = cols;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+	m_colIndex.clear();
+	forgetColumnInfo();
 
-	// Set the meta-data
+	// Set the meta-data. The columns keep their names, but lose their values.
+	// (New columns share one empty attribute until they are changed.)
 	m_filename = "";
-	m_attr_name.resize(cols);
-	m_str_to_enum.resize(cols);
-	m_enum_to_str.resize(cols);
+	boost::shared_ptr<Schema> pSchema(new Schema(cols));
+	boost::shared_ptr<Attribute> pEmpty;
 	for(size_t i = 0; i < cols; i++)
 	{
-		m_str_to_enum[i].clear();
-		m_enum_to_str[i].clear();
+		if(i < m_pSchema->size() && (*m_pSchema)[i]->enumToStr.empty() && (*m_pSchema)[i]->strToEnum.empty())
+			(*pSchema)[i] = (*m_pSchema)[i];
+		else if(i < m_pSchema->size() && !attribute(i).name.empty())
+		{
+			(*pSchema)[i].reset(new Attribute());
+			(*pSchema)[i]->name = attribute(i).name;
+		}
+		else
+		{
+			if(!pEmpty)
+				pEmpty.reset(new Attribute());
+			(*pSchema)[i] = pEmpty;
+		}
 	}
+	m_pSchema = pSchema;
 }
 
-std::vector<size_t> Matrix::allAttrValues(size_t attr)
+void Matrix::detach()
 {
-    std::map<std::string, size_t> attrMap = m_str_to_enum[attr];
-    std::vector<size_t> attrValues;
+	if(m_pSparse || m_pColumns || m_pSpill)
+	{
+		densify(); // (which makes a private copy)
+		return;
+	}
+	size_t c = cols();
+	if(m_pData.unique() && m_pData->growable() && m_rowIndex.empty() && m_colIndex.empty() && m_rowBegin == 0 && m_colBegin == 0 && m_stride == c && m_pData->size() == m_rows * c)
+		return;
+	bool infoWasCurrent = infoCurrent();
+	boost::shared_ptr<MatrixStorage> pData(new MatrixStorage());
+	vector<double>& elements = pData->elements();
+	elements.reserve(m_rows * c);
+	for(size_t i = 0; i < m_rows; i++)
+	{
+		Row r = row(i);
+		for(size_t j = 0; j < c; j++)
+			elements.push_back(r[j]);
+	}
+	m_pData = pData;
+	m_stride = c;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+	m_colIndex.clear();
+	keepColumnInfo(infoWasCurrent);
+}
 
-    for (map<std::string, size_t>::iterator it = attrMap.begin(); it != attrMap.end(); ++it)
-    {
-        attrValues.push_back(it->second);
-    }
+void Matrix::densify()
+{
+	if(!m_pSparse && !m_pColumns && !m_pSpill)
+		return;
+	bool infoWasCurrent = infoCurrent();
+	size_t c = cols();
+	boost::shared_ptr<MatrixStorage> pData(new MatrixStorage(m_rows * c, 0.0));
+	double* pOut = pData->data();
+	if(m_pSparse)
+	{
+		for(size_t i = 0; i < m_rows; i++)
+		{
+			SparseRow r = sparseRow(i);
+			for(size_t j = 0; j < r.size(); j++)
+				pOut[r.col(j)] = r.value(j);
+			pOut += c;
+		}
+	}
+	else if(m_pSpill)
+	{
+		BlockIterator it(*this);
+		while(it.next())
+		{
+			for(size_t i = 0; i < it.size(); i++)
+			{
+				const vector<double>& r = it.row(i);
+				std::copy(r.begin(), r.end(), pOut + it.index(i) * c);
+			}
+		}
+	}
+	else
+	{
+		for(size_t j = 0; j < c; j++)
+		{
+			size_t k = 0;
+			forEachInColumn(j, [&](double val) { pOut[k++ * c + j] = val; });
+		}
+	}
+	m_pData = pData;
+	m_pSparse.reset();
+	m_pColumns.reset();
+	m_pSpill.reset();
+	m_stride = c;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+	m_colIndex.clear();
+	keepColumnInfo(infoWasCurrent);
+}
 
+void Matrix::keepColumnInfo(bool wasCurrent)
+{
+	if(!wasCurrent)
+		return;
+	m_pInfoData = m_pData;
+	m_infoVersion = m_pData->observe();
+}
+
+void Matrix::compact(bool floats)
+{
+	size_t c = cols();
+	vector<size_t> valueCounts(c);
+	for(size_t i = 0; i < c; i++)
+		valueCounts[i] = valueCount(i);
+	bool infoWasCurrent = infoCurrent();
+	boost::shared_ptr<ColumnStorage> pColumns(new ColumnStorage(valueCounts, floats));
+
+	// Convert a batch of rows at a time
+	vector<double> batch;
+	vector<double> row;
+	for(size_t i = 0; i < m_rows; i += COMPACT_BATCH_ROWS)
+	{
+		size_t n = std::min((size_t)COMPACT_BATCH_ROWS, m_rows - i);
+		batch.resize(n * c);
+		for(size_t j = 0; j < n; j++)
+		{
+			getRow(i + j, row);
+			std::copy(row.begin(), row.end(), batch.begin() + j * c);
+		}
+		pColumns->append(batch.data(), n);
+	}
+	m_pColumns = pColumns;
+	m_pData.reset(new MatrixStorage());
+	m_pSparse.reset();
+	m_pSpill.reset();
+	m_stride = c;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+	m_colIndex.clear();
+	keepColumnInfo(infoWasCurrent);
+}
+
+void Matrix::spill(size_t blockRows)
+{
+	if(m_pSpill)
+		return;
+	size_t c = cols();
+	bool infoWasCurrent = infoCurrent();
+	boost::shared_ptr<SpillStorage> pSpill(new SpillStorage(c, blockRows));
+
+	// Convert a batch of rows at a time
+	vector<double> batch;
+	vector<double> row;
+	for(size_t i = 0; i < m_rows; i += COMPACT_BATCH_ROWS)
+	{
+		size_t n = std::min((size_t)COMPACT_BATCH_ROWS, m_rows - i);
+		batch.resize(n * c);
+		for(size_t j = 0; j < n; j++)
+		{
+			getRow(i + j, row);
+			std::copy(row.begin(), row.end(), batch.begin() + j * c);
+		}
+		pSpill->append(batch.data(), n);
+	}
+	m_pSpill = pSpill;
+	m_pData.reset(new MatrixStorage());
+	m_pSparse.reset();
+	m_pColumns.reset();
+	m_stride = c;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+	m_colIndex.clear();
+	keepColumnInfo(infoWasCurrent);
+}
+
+Matrix::BlockIterator::BlockIterator(Matrix& m)
+: m_matrix(m), m_block(0), m_started(false)
+{
+	if(!m.m_pSpill)
+		return;
+
+	// Group the rows by the block that holds them (keeping their order
+	// within each block), with a counting sort
+	size_t blockRows = m.m_pSpill->blockRows();
+	size_t blocks = m.m_pSpill->blockCount();
+	m_starts.assign(blocks + 1, 0);
+	for(size_t i = 0; i < m.m_rows; i++)
+		m_starts[m.storedRowIndex(i) / blockRows + 1]++;
+	for(size_t b = 0; b < blocks; b++)
+		m_starts[b + 1] += m_starts[b];
+	vector<size_t> pos(m_starts.begin(), m_starts.end() - 1);
+	m_rows.resize(m.m_rows);
+	for(size_t i = 0; i < m.m_rows; i++)
+		m_rows[pos[m.storedRowIndex(i) / blockRows]++] = i;
+}
+
+bool Matrix::BlockIterator::next()
+{
+	if(!m_matrix.m_pSpill)
+	{
+		// The whole matrix is one block
+		if(m_started)
+			m_block = 1;
+		m_started = true;
+		return m_block == 0;
+	}
+
+	// Move to the next block that holds any of the rows
+	size_t blocks = m_starts.size() - 1;
+	if(m_started)
+		m_block++;
+	m_started = true;
+	while(m_block < blocks && m_starts[m_block + 1] == m_starts[m_block])
+		m_block++;
+	if(m_block >= blocks)
+	{
+		m_pBlock.reset();
+		return false;
+	}
+	m_pBlock = m_matrix.m_pSpill->block(m_block);
+
+	// Start reading the one after it
+	for(size_t b = m_block + 1; b < blocks; b++)
+	{
+		if(m_starts[b + 1] > m_starts[b])
+		{
+			m_matrix.m_pSpill->readAhead(b);
+			break;
+		}
+	}
+	return true;
+}
+
+double Matrix::BlockIterator::get(size_t i, size_t col)
+{
+	if(!m_pBlock)
+		return m_matrix.get(index(i), col);
+	size_t stored = m_matrix.storedRowIndex(index(i)) % m_matrix.m_pSpill->blockRows();
+	return m_pBlock->elements[stored * m_matrix.m_stride + m_matrix.storedCol(col)];
+}
+
+const vector<double>& Matrix::BlockIterator::row(size_t i)
+{
+	if(!m_pBlock)
+	{
+		m_matrix.getRow(index(i), m_row);
+		return m_row;
+	}
+	size_t c = m_matrix.cols();
+	size_t stored = m_matrix.storedRowIndex(index(i)) % m_matrix.m_pSpill->blockRows();
+	const double* pRow = m_pBlock->elements.data() + stored * m_matrix.m_stride;
+	m_row.resize(c);
+	for(size_t j = 0; j < c; j++)
+		m_row[j] = pRow[m_matrix.storedCol(j)];
+	return m_row;
+}
+
+void Matrix::BlockIterator::shuffle(Rand& r)
+{
+	if(m_starts.empty())
+	{
+		// (A matrix that is not spilled is one block, in order)
+		identityOrder(m_matrix.rows(), m_rows);
+		m_starts.push_back(0);
+		m_starts.push_back(m_rows.size());
+	}
+	vector<size_t> order(m_rows.begin() + m_starts[m_block], m_rows.begin() + m_starts[m_block + 1]);
+	shuffleOrder(r, order);
+	std::copy(order.begin(), order.end(), m_rows.begin() + m_starts[m_block]);
+}
+
+void Matrix::gatherColumn(size_t col, vector<double>& values)
+{
+	values.resize(m_rows);
+	BlockIterator it(*this);
+	while(it.next())
+	{
+		for(size_t i = 0; i < it.size(); i++)
+			values[it.index(i)] = it.get(i, col);
+	}
+}
+
+const ColumnStorage& Matrix::columnStorage()
+{
+	if(!m_pColumns)
+		ThrowError("Expected a compact matrix");
+	return *m_pColumns;
+}
+
+double Matrix::get(size_t row, size_t col) const
+{
+	if(m_pSparse)
+		return sparseElement(row, col);
+	if(m_pColumns)
+		return m_pColumns->get(storedRowIndex(row), storedCol(col));
+	if(m_pSpill)
+		return m_pSpill->get(storedRowIndex(row), storedCol(col));
+	return storedRow(row)[storedCol(col)];
+}
+
+void Matrix::getRow(size_t index, vector<double>& out) const
+{
+	if(m_pSparse)
+		sparseRow(index).copyTo(out);
+	else if(m_pColumns)
+	{
+		size_t c = cols();
+		size_t stored = storedRowIndex(index);
+		out.resize(c);
+		for(size_t j = 0; j < c; j++)
+			out[j] = m_pColumns->get(stored, storedCol(j));
+	}
+	else if(m_pSpill)
+	{
+		size_t c = cols();
+		size_t stored = storedRowIndex(index);
+		SpillStorage::BlockPtr pBlock = m_pSpill->block(stored / m_pSpill->blockRows());
+		const double* pRow = pBlock->elements.data() + (stored % m_pSpill->blockRows()) * m_stride;
+		out.resize(c);
+		for(size_t j = 0; j < c; j++)
+			out[j] = pRow[storedCol(j)];
+	}
+	else
+	{
+		// (Not through row, which would count as a change)
+		size_t c = cols();
+		const double* pRow = storedRow(index);
+		if(m_colIndex.empty())
+			out.assign(pRow + m_colBegin, pRow + m_colBegin + c);
+		else
+		{
+			out.resize(c);
+			for(size_t j = 0; j < c; j++)
+				out[j] = pRow[m_colIndex[j]];
+		}
+	}
+}
+
+void Matrix::detachSparse()
+{
+	size_t c = cols();
+	if(m_pSparse.unique() && m_rowIndex.empty() && m_rowBegin == 0 && m_colBegin == 0 && m_stride == c && m_pSparse->rows() == m_rows)
+		return;
+	boost::shared_ptr<SparseStorage> pSparse(new SparseStorage());
+	for(size_t i = 0; i < m_rows; i++)
+	{
+		SparseRow r = sparseRow(i);
+		for(size_t j = 0; j < r.size(); j++)
+		{
+			pSparse->cols.push_back(r.col(j));
+			pSparse->values.push_back(r.value(j));
+		}
+		pSparse->endRow();
+	}
+	m_pSparse = pSparse;
+	m_pData.reset(new MatrixStorage());
+	m_stride = c;
+	m_rowBegin = 0;
+	m_colBegin = 0;
+	m_rowIndex.clear();
+}
+
+Matrix::SparseRow Matrix::sparseRow(size_t index) const
+{
+	if(!m_pSparse)
+		ThrowError("Expected a sparse matrix");
+	SparseStorage& s = *m_pSparse;
+	size_t stored = storedRowIndex(index);
+	const size_t* pFirst = s.cols.data();
+	const size_t* pBegin = pFirst + s.rowStart[stored];
+	const size_t* pEnd = pFirst + s.rowStart[stored + 1];
+
+	// Leave out the elements of stored columns that are not in this matrix
+	size_t c = cols();
+	if(m_colBegin > 0)
+		pBegin = std::lower_bound(pBegin, pEnd, m_colBegin);
+	if(m_colBegin + c < m_stride)
+		pEnd = std::lower_bound(pBegin, pEnd, m_colBegin + c);
+	return SparseRow(pBegin, s.values.data() + (pBegin - pFirst), pEnd - pBegin, c, m_colBegin);
+}
+
+double Matrix::sparseElement(size_t row, size_t col) const
+{
+	SparseStorage& s = *m_pSparse;
+	size_t stored = storedRowIndex(row);
+	const size_t* pFirst = s.cols.data();
+	const size_t* pEnd = pFirst + s.rowStart[stored + 1];
+	const size_t* p = std::lower_bound(pFirst + s.rowStart[stored], pEnd, m_colBegin + col);
+	if(p == pEnd || *p != m_colBegin + col)
+		return 0.0;
+	return s.values[p - pFirst];
+}
+
+std::vector<size_t> Matrix::allAttrValues(size_t attr)
+{
+    // (in the order of their names)
+    const Dictionary& dict = attribute(attr).strToEnum;
+    std::vector<size_t> entries(dict.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        entries[i] = i;
+    std::sort(entries.begin(), entries.end(), [&dict](size_t a, size_t b) { return dict.key(a) < dict.key(b); });
+
+    std::vector<size_t> attrValues;
+    attrValues.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        attrValues.push_back(dict.value(entries[i]));
     return attrValues;
 }
 
 void Matrix::shuffleRows(Rand& r, Matrix* pBuddy)
 {
+	vector<size_t> order;
+	identityOrder(m_rows, order);
+	shuffleOrder(r, order);
+	reorderRows(order);
 	if(pBuddy)
+		pBuddy->reorderRows(order);
+}
+
+// static
+void Matrix::shuffleOrder(Rand& r, vector<size_t>& order)
+{
+	for(size_t n = order.size(); n > 0; n--)
+		std::swap(order[(size_t)r.next(n)], order[n - 1]);
+}
+
+// static
+void Matrix::identityOrder(size_t rows, vector<size_t>& order)
+{
+	order.resize(rows);
+	for(size_t i = 0; i < rows; i++)
+		order[i] = i;
+}
+
+void Matrix::visitShuffled(Rand& r, vector<size_t>& order, const std::function<void (size_t)>& f)
+{
+	if(!m_pSpill)
+	{
+		if(order.size() != m_rows)
+			identityOrder(m_rows, order);
+		shuffleOrder(r, order);
+		for(size_t i = 0; i < order.size(); i++)
+			f(order[i]);
+		return;
+	}
+	BlockIterator blocks(*this);
+	while(blocks.next())
+	{
+		blocks.shuffle(r);
+		for(size_t i = 0; i < blocks.size(); i++)
+			f(blocks.index(i));
+	}
+}
+
+void Matrix::reorderRows(const vector<size_t>& order)
+{
+	if(order.size() != m_rows)
+		ThrowError("Expected the same number of rows");
+	if(m_rows == 0)
+		return;
+	vector<size_t> index(m_rows);
+	for(size_t i = 0; i < m_rows; i++)
+		index[i] = storedRowIndex(order[i]);
+	m_rowIndex.swap(index);
+	forgetColumnInfo();
+}
+
+void Matrix::indexRows()
+{
+	if(!m_rowIndex.empty() || m_rows == 0)
+		return;
+	m_rowIndex.resize(m_rows);
+	for(size_t i = 0; i < m_rows; i++)
+		m_rowIndex[i] = m_rowBegin + i;
+}
+
+const ValidityMask& Matrix::validity(size_t col)
+{
+	ColumnInfo& info = columnInfo(col);
+	if(!info.hasValidity)
 	{
-		for(size_t n = rows(); n > 0; n--)
+		if(m_pColumns && m_pColumns->missing(storedCol(col)) == 0)
+			info.validity = ValidityMask(); // (none of the stored column is missing)
+		else
 		{
-			size_t i = (size_t)r.next(n);
-			std::swap(m_data[i], m_data[n - 1]);
-			std::swap((*pBuddy)[i], (*pBuddy)[n - 1]);
+			vector<uint64_t> bits((m_rows + 63) / 64, 0);
+			size_t missing = 0;
+			size_t i = 0;
+			forEachInColumn(col, [&](double val)
+			{
+				if(val == UNKNOWN_VALUE)
+					missing++;
+				else
+					bits[i / 64] |= (uint64_t)1 << (i % 64);
+				i++;
+			});
+			info.validity = ValidityMask(bits, missing);
 		}
+		info.hasValidity = true;
 	}
-	else
+	return info.validity;
+}
+
+Matrix::ColumnInfo& Matrix::columnInfo(size_t col)
+{
+	if(!infoCurrent())
 	{
-		for(size_t n = rows(); n > 0; n--)
-			std::swap(m_data[(size_t)r.next(n)], m_data[n - 1]);
+		m_columnInfo.assign(cols(), ColumnInfo());
+		m_pInfoData = m_pData;
+		m_infoVersion = m_pData->observe();
 	}
+	return m_columnInfo[col];
 }
 
-double Matrix::columnMean(size_t col)
+void Matrix::setComplete(size_t col)
 {
+	ColumnInfo& info = columnInfo(col);
+	info.validity = ValidityMask();
+	info.hasValidity = true;
+}
+
+Matrix::ColumnInfo& Matrix::columnStats(size_t col)
+{
+	ColumnInfo& info = columnInfo(col);
+	if(info.hasStats)
+		return info;
+
+	// Compute everything in one pass. The values of a nominal column are
+	// counted in an array indexed by enumeration, and anything that is not
+	// one of them (such as UNKNOWN_VALUE) in a map.
+	bool complete = knownComplete(col);
+	size_t values = valueCount(col);
+	vector<uint64_t> bits(complete ? 0 : (m_rows + 63) / 64, 0);
+	vector<size_t> enumCounts(values, 0);
+	map<double, size_t> otherCounts;
+	size_t missing = 0;
 	double sum = 0.0;
-	size_t count = 0;
-	std::vector< std::vector<double> >::iterator it;
-	for(it = m_data.begin(); it != m_data.end(); it++)
+	double min = 1e300;
+	double max = -1e300;
+	size_t i = 0;
+	forEachInColumn(col, [&](double val)
 	{
-		double val = (*it)[col];
-		if(val != UNKNOWN_VALUE)
+		if(!complete && val == UNKNOWN_VALUE)
+			missing++;
+		else
 		{
+			if(!complete)
+				bits[i / 64] |= (uint64_t)1 << (i % 64);
 			sum += val;
-			count++;
+			min = std::min(min, val);
+			max = std::max(max, val);
+		}
+		if(values > 0)
+		{
+			if(isValue(val, values))
+				enumCounts[(size_t)val]++;
+			else
+				otherCounts[val]++;
 		}
+		i++;
+	});
+
+	if(!info.hasValidity)
+	{
+		info.validity = ValidityMask(bits, missing);
+		info.hasValidity = true;
+	}
+	info.count = m_rows - missing;
+	info.sum = sum;
+	info.min = min;
+	info.max = max;
+	info.hasMoments = true;
+	if(values > 0)
+	{
+		info.enumCounts.swap(enumCounts);
+		info.otherCounts.swap(otherCounts);
+		info.hasCounts = true;
 	}
-	return sum / count;
+	info.hasStats = true;
+	return info;
 }
 
-double Matrix::columnMin(size_t col)
+Matrix::ColumnInfo& Matrix::columnMoments(size_t col)
 {
-	double m = 1e300;
-	std::vector< std::vector<double> >::iterator it;
-	for(it = m_data.begin(); it != m_data.end(); it++)
+	ColumnInfo& info = columnInfo(col);
+	if(info.hasMoments)
+		return info;
+	if(m_pSparse || m_pColumns)
+		return columnStats(col);
+	computeMoments();
+	return columnInfo(col);
+}
+
+void Matrix::computeMoments()
+{
+	size_t c = cols();
+	vector<size_t> counts(c, 0);
+	vector<double> sums(c, 0.0);
+	vector<double> mins(c, 1e300);
+	vector<double> maxs(c, -1e300);
+	if(m_pSpill)
+	{
+		// Read the file in order
+		BlockIterator it(*this);
+		while(it.next())
+		{
+			for(size_t i = 0; i < it.size(); i++)
+				simdAccumulate(it.row(i).data(), c, sums.data(), counts.data(), mins.data(), maxs.data());
+		}
+	}
+	else
 	{
-		double val = (*it)[col];
-		if(val != UNKNOWN_VALUE)
-			m = std::min(m, val);
+		vector<double> row;
+		for(size_t i = 0; i < m_rows; i++)
+		{
+			if(m_colIndex.empty())
+				simdAccumulate(storedRow(i) + m_colBegin, c, sums.data(), counts.data(), mins.data(), maxs.data());
+			else
+			{
+				getRow(i, row);
+				simdAccumulate(row.data(), c, sums.data(), counts.data(), mins.data(), maxs.data());
+			}
+		}
+	}
+	for(size_t j = 0; j < c; j++)
+	{
+		ColumnInfo& info = columnInfo(j);
+		info.count = counts[j];
+		info.sum = sums[j];
+		info.min = mins[j];
+		info.max = maxs[j];
+		info.hasMoments = true;
+		if(counts[j] == m_rows && !info.hasValidity)
+		{
+			info.validity = ValidityMask();
+			info.hasValidity = true;
+		}
 	}
-	return m;
+}
+
+double Matrix::columnMean(size_t col)
+{
+	ColumnInfo& info = columnMoments(col);
+	return info.sum / info.count;
+}
+
+double Matrix::columnMin(size_t col)
+{
+	return columnMoments(col).min;
 }
 
 double Matrix::columnMax(size_t col)
 {
-	double m = -1e300;
-	std::vector< std::vector<double> >::iterator it;
-	for(it = m_data.begin(); it != m_data.end(); it++)
-	{
-		double val = (*it)[col];
-		if(val != UNKNOWN_VALUE)
-			m = std::max(m, val);
-	}
-	return m;
+	return columnMoments(col).max;
 }
 
 double Matrix::mostCommonValue(size_t col)
 {
-	map<double, size_t> counts = getValueCounts(col);
+	ColumnInfo& info = countedColumn(col);
+	const map<double, size_t>& others = info.otherCounts;
+	if(others.empty() || (others.size() == 1 && others.begin()->first == UNKNOWN_VALUE))
+	{
+		// Only the values of a nominal column are candidates
+		size_t valueCount = 0;
+		double value = 0;
+		for(size_t i = 0; i < info.enumCounts.size(); i++)
+		{
+			if(info.enumCounts[i] > valueCount)
+			{
+				value = (double)i;
+				valueCount = info.enumCounts[i];
+			}
+		}
+		return value;
+	}
 
+	map<double, size_t> counts = getValueCounts(col);
 	size_t valueCount = 0;
 	double value = 0;
 	for(map<double, size_t>::iterator i = counts.begin(); i != counts.end(); i++)
@@ -139,26 +956,152 @@ double Matrix::mostCommonValue(size_t col)
 
 map<double, size_t> Matrix::getValueCounts(size_t col)
 {
-    map<double, size_t> counts;
-	vector< vector<double> >::iterator it;
-	for(it = m_data.begin(); it != m_data.end(); it++)
+	ColumnInfo& info = countedColumn(col);
+	map<double, size_t> counts(info.otherCounts);
+	for(size_t i = 0; i < info.enumCounts.size(); i++)
 	{
-		double val = (*it)[col];
-        map<double, size_t>::iterator pair = counts.find(val);
-        if(pair == counts.end())
-            counts[val] = 1;
-        else
-            pair->second++;
-    }
+		if(info.enumCounts[i] > 0)
+			counts[(double)i] = info.enumCounts[i];
+	}
+	return counts;
+}
 
-    return counts;
+Matrix::ColumnInfo& Matrix::countedColumn(size_t col)
+{
+	if(valueCount(col) > 0)
+		return columnStats(col); // (which counts the values of nominal columns)
+	ColumnInfo& info = columnInfo(col);
+	if(!info.hasCounts)
+	{
+		map<double, size_t>& counts = info.otherCounts;
+		forEachInColumn(col, [&](double val)
+		{
+			map<double, size_t>::iterator pair = counts.find(val);
+			if(pair == counts.end())
+				counts[val] = 1;
+			else
+				pair->second++;
+		});
+		info.hasCounts = true;
+	}
+	return info;
 }
 
-void Matrix::copyRow(vector<double>& row)
+bool Matrix::countValues(size_t col, vector<size_t>& counts)
+{
+	size_t values = valueCount(col);
+	if(values == 0)
+		return false;
+	ColumnInfo& info = countedColumn(col);
+	counts.assign(info.enumCounts.begin(), info.enumCounts.end());
+	counts.push_back(0);
+	for(map<double, size_t>::const_iterator it = info.otherCounts.begin(); it != info.otherCounts.end(); ++it)
+	{
+		if(it->first != UNKNOWN_VALUE)
+			return false;
+		counts[values] = it->second;
+	}
+	return true;
+}
+
+bool Matrix::countValues(size_t col, Matrix& labels, size_t labelCol, vector<size_t>& table)
+{
+	size_t values = valueCount(col);
+	size_t labelValues = labels.valueCount(labelCol);
+	if(values == 0 || labelValues == 0)
+		return false;
+	if(labels.rows() != m_rows)
+		ThrowError("Expected the same number of rows");
+
+	// Find the row of the table for each row, then count the labels
+	vector<size_t> offsets(m_rows);
+	size_t i = 0;
+	bool ok = true;
+	forEachInColumn(col, [&](double val)
+	{
+		size_t v = values;
+		if(isValue(val, values))
+			v = (size_t)val;
+		else if(val != UNKNOWN_VALUE)
+			ok = false;
+		offsets[i++] = v * (labelValues + 1);
+	});
+	if(!ok)
+		return false;
+	table.assign((values + 1) * (labelValues + 1), 0);
+	i = 0;
+	labels.forEachInColumn(labelCol, [&](double val)
+	{
+		size_t c = labelValues;
+		if(isValue(val, labelValues))
+			c = (size_t)val;
+		else if(val != UNKNOWN_VALUE)
+			ok = false;
+		table[offsets[i++] + c]++;
+	});
+	return ok;
+}
+
+void Matrix::copyRow(const vector<double>& row)
 {
 	if(row.size() != cols())
 		ThrowError("mismatching size");
-	m_data.push_back(row);
+	if(m_pSparse)
+	{
+		// Keep the elements that are not zero
+		detachSparse();
+		for(size_t i = 0; i < row.size(); i++)
+		{
+			if(row[i] != 0.0)
+			{
+				m_pSparse->cols.push_back(i);
+				m_pSparse->values.push_back(row[i]);
+			}
+		}
+		m_pSparse->endRow();
+		m_rows++;
+		forgetColumnInfo();
+		return;
+	}
+	detach();
+	m_pData->elements().insert(m_pData->elements().end(), row.begin(), row.end());
+	m_rows++;
+	forgetColumnInfo();
+}
+
+void Matrix::copyRow(const SparseRow& row)
+{
+	if(row.width() != cols())
+		ThrowError("mismatching size");
+	if(!m_pSparse && m_rows == 0)
+	{
+		// Start out sparse
+		m_pData.reset(new MatrixStorage());
+		m_pSparse.reset(new SparseStorage());
+		m_stride = cols();
+		m_rowBegin = 0;
+		m_colBegin = 0;
+		m_rowIndex.clear();
+		m_colIndex.clear();
+	}
+	if(m_pSparse)
+	{
+		detachSparse();
+		for(size_t i = 0; i < row.size(); i++)
+		{
+			m_pSparse->cols.push_back(row.col(i));
+			m_pSparse->values.push_back(row.value(i));
+		}
+		m_pSparse->endRow();
+		m_rows++;
+		forgetColumnInfo();
+	}
+	else
+	{
+		vector<double> dense;
+		row.copyTo(dense);
+		copyRow(dense);
+	}
 }
 
 void Matrix::copyPart(Matrix& that, size_t rowBegin, size_t colBegin, size_t rowCount, size_t colCount)
@@ -169,233 +1112,130 @@ void Matrix::copyPart(Matrix& that, size_t rowBegin, size_t colBegin, size_t row
 	// Copy the specified region of meta-data
 	if(cols() != colCount)
 		setSize(0, colCount);
-	for(size_t i = 0; i < colCount; i++)
-	{
-		m_attr_name[i] = that.m_attr_name[colBegin + i];
-		m_str_to_enum[i] = that.m_str_to_enum[colBegin + i];
-		m_enum_to_str[i] = that.m_enum_to_str[colBegin + i];
-	}
+	shareSchema(that, colBegin, colCount);
 
 	// Copy the specified region of data
-	size_t rowsBefore = m_data.size();
-	m_data.resize(rowsBefore + rowCount);
+	detach();
+	vector<double>& data = m_pData->elements();
+	data.reserve(data.size() + rowCount * colCount);
+	vector<double> in;
 	for(size_t i = 0; i < rowCount; i++)
 	{
-		vector<double>::iterator itIn = that[rowBegin + i].begin() + colBegin;
-		m_data[rowsBefore + i].resize(colCount);
-		vector<double>::iterator itOut = m_data[rowsBefore + i].begin();
+		that.getRow(rowBegin + i, in);
 		for(size_t j = 0; j < colCount; j++)
-			*itOut++ = *itIn++;
+			data.push_back(in[colBegin + j]);
 	}
+	m_rows += rowCount;
+	forgetColumnInfo();
 }
 
-string toLower(string strToConvert)
+void Matrix::loadARFF(string fileName, bool useCache, Layout layout)
 {
-	//change each element of the string to lower case
-	for(size_t i = 0; i < strToConvert.length(); i++)
-		strToConvert[i] = tolower(strToConvert[i]);
-	return strToConvert;//return the converted string
-}
-
-void Matrix::loadARFF(string fileName)
-{
-	size_t lineNum = 0;
-	string line;                 //line of input from the arff file
-	ifstream inputFile;          //input stream
-	map <string, size_t> tempMap;   //temp map for int->string map (attrInts)
-	map <size_t, string> tempMapS;  //temp map for string->int map (attrString)
-	size_t attrCount = 0;           //Count number of attributes
-
-	inputFile.open ( fileName.c_str() );
-
-	//Ensure that the file name is correct
-	if ( !inputFile )
-		ThrowError ( "failed to open the file: ", fileName );
-	//Parse the file. save data in data variable
-	while ( !inputFile.eof() && inputFile )
+	string key;
+	string cacheFile;
+	if(useCache)
 	{
-		//Iterate through each line of the file
-		getline ( inputFile, line );
-		lineNum++;
-		if ( toLower ( line ).find ( "@relation" ) == 0 )
+		key = ArffCache::makeKey(fileName);
+		cacheFile = ArffCache::cacheName(fileName);
+		if(ArffCache::load(*this, cacheFile, key))
 		{
-			m_filename = line.substr ( line.find_first_of ( " " ) );
+			if(layout == SPILL)
+				spill();
+			else if(layout != DENSE)
+				compact(layout == COMPACT_FLOAT);
+			return;
 		}
-		else if ( toLower ( line ).find ( "@attribute" ) == 0 )
+	}
+	ArffParser parser(*this, NULL, layout);
+	parser.load(fileName);
+	if(useCache && !isSparse() && layout != COMPACT_FLOAT) // (the cache only holds dense matrices, with exact values)
+	{
+		// The data is already loaded, so a cache that cannot be written
+		// (such as in a read-only directory) only costs the next run time
+		try
 		{
-			line = line.substr ( line.find_first_of ( " \t" ) + 1 );
-
-			//Parse the attribute name
-			string attrName = line.substr ( 0, line.find_first_of ( " \t" ) );
-			m_attr_name.push_back ( attrName );
-
-			line = line.substr ( attrName.size() );
-			string value = line.substr ( line.find_first_not_of ( " \t" ) );
-			tempMap.clear();
-			tempMapS.clear();
-
-			//If the attribute is nominal
-			if ( value.find_first_of ( "{" ) == 0 )
-			{
-				int firstComma;
-				int firstSpace;
-				int firstLetter;
-				value = value.substr ( 1, value.find_last_of ( "}" ) - 1 );
-				size_t valCount = 0;
-				string tempValue;
-
-				//Parse the attributes--push onto the maps
-				while ( ( firstComma = value.find_first_of ( "," ) ) > -1 )
-				{
-					firstLetter = value.find_first_not_of ( " \t," );
-
-					value = value.substr ( firstLetter );
-					firstComma = value.find_first_of ( "," );
-					firstSpace = value.find_first_of ( " \t" );
-					tempMapS[valCount] = value.substr ( 0, firstComma );
-					string valName = value.substr ( 0, firstComma );
-					valName = valName.substr ( 0, valName.find_last_not_of(" \t") + 1);
-					tempMap[valName] = valCount++;
-					firstComma = ( firstComma < firstSpace &&
-						firstSpace < ( firstComma + 2 ) ) ? firstSpace :
-						firstComma;
-					value = value.substr ( firstComma + 1 );
-				}
-
-				//Push final attribute onto the maps
-				firstLetter = value.find_first_not_of ( " \t," );
-				value = value.substr ( firstLetter );
-				string valName = value.substr ( 0, value.find_last_not_of(" \t") + 1);
-				tempMapS[valCount] = valName;
-				tempMap[valName] = valCount++;
-				m_str_to_enum.push_back ( tempMap );
-				m_enum_to_str.push_back ( tempMapS );
-			}
-			else
-			{
-				//The attribute is continuous
-				m_str_to_enum.push_back ( tempMap );
-				m_enum_to_str.push_back ( tempMapS );
-			}
-			attrCount++;
+			ArffCache::save(*this, cacheFile, key);
 		}
-		else if ( toLower ( line ).find ( "@data" ) == 0 )
+		catch(const std::exception& e)
 		{
-			vector<double> temp; //Holds each line of data
-			temp.reserve(attrCount);
-
-			//Clear the data
-			m_data.clear();
-
-			//Read through the rest of the file
-			while ( !inputFile.eof() )
-			{
-				getline ( inputFile, line );
-				lineNum++;
-				line = line.substr ( 0, line.find_first_of ( "\r\n" ) );
-				//Check for commented out lines
-				if ( line.find ( "%" ) != 0 && line != "" )
-				{
-					//Push each data item onto the back of the temp vector
-					for ( size_t i = 0; i < attrCount; i++ )
-					{
-						size_t vals = valueCount ( i );
-						string val = line.substr ( line.find_first_not_of ( " \t" ), line.find_first_of ( ",\n\r" ) );
-						if ( vals > 0 ) //if the attribute is nominal...
-						{
-							if ( val == "?" )
-							{
-								temp.push_back(UNKNOWN_VALUE);
-							}
-							else
-							{
-								map<string, size_t>::iterator it = m_str_to_enum[i].find ( val );
-								if ( it == m_str_to_enum[i].end() && m_str_to_enum[i].size() > 1 )
-								{
-									m_str_to_enum[i][val] = ( m_enum_to_str[i].end()->first )-1;
-									m_enum_to_str[i][ ( m_enum_to_str[i].end()->first )-1] = val;
-								}
-								temp.push_back ( m_str_to_enum[i][val] );
-							}
-						}
-						else
-						{
-							//the attribute is continuous
-							std::stringstream convert ( val );
-							double tempDouble;
-							if ( val == "?" )
-							{
-								tempDouble = UNKNOWN_VALUE;
-							}
-							else
-							{
-								convert >> tempDouble;
-							}
-							temp.push_back ( tempDouble );
-						}
-						if ( i != attrCount - 1 )
-						{
-							size_t pos = line.find_first_of ( ", \t" );
-							if(pos == string::npos)
-								ThrowError("Expected more elements on line ", to_str(lineNum));
-							line = line.substr ( pos );
-							pos = line.find_first_not_of ( ", \t" );
-							if(pos == string::npos)
-								ThrowError("Expected something after the last delimiter on line ", to_str(lineNum));
-							line = line.substr ( pos );
-						}
-					}
-					if(temp.size() != cols())
-						ThrowError("Expected ", to_str(cols()), " elements on line ", to_str(lineNum), ". Found ", to_str(lineNum), ".");
-					m_data.push_back ( temp );
-					temp.clear();
-				}
-			}
+			std::cerr << "Warning: the dataset was not cached: " << e.what() << "\n";
 		}
 	}
 }
 
+void Matrix::loadCSV(const string& filename, Matrix* pSchema, Layout layout)
+{
+	CsvParser parser(*this, pSchema, layout);
+	parser.load(filename);
+}
+
+void Matrix::loadLibSVM(const string& filename, Matrix* pSchema)
+{
+	LibSvmParser parser(*this, pSchema);
+	parser.load(filename);
+}
+
+void Matrix::loadBinary(const string& filename)
+{
+	MlbFile::load(*this, filename);
+}
+
+void Matrix::saveBinary(const string& filename)
+{
+	MlbFile::save(*this, filename);
+}
+
 void Matrix::useUnknown()
 {
+    detach();
     size_t c = cols();
+
+    // Find the missing nominal values first. (Changing any of them makes
+    // the matrix forget which columns are known to have none.)
+    vector< vector<size_t> > missingRows(c);
+    for (size_t i = 0; i < c; ++i)
+    {
+        if (valueCount(i) > 0 && hasMissing(i)) //if the attribute is nominal...
+        {
+            const ValidityMask& mask = validity(i);
+            for (size_t r = 0; r < m_rows; ++r)
+            {
+                if (!mask.has(r))
+                    missingRows[i].push_back(r);
+            }
+        }
+        //continuous values are not enumerated, so it is ok for them to have UNKNOWN_VALUE
+    }
+
     for (size_t i = 0; i < c; ++i)
     {
-        vector<size_t> rowIs = getRowsWithAttrValues(i, UNKNOWN_VALUE);
+        vector<size_t>& rowIs = missingRows[i];
         if (rowIs.size() > 0)
         {
-            size_t vals = valueCount ( i );
-            if ( vals > 0 ) //if the attribute is nominal... 
+            std::string val = "?";
+            size_t e = attribute(i).enumToStr.size();
+            const Dictionary& strToEnum = attribute(i).strToEnum;
+
+            // add unknown as enum
+            if ( strToEnum.find ( val ) == Dictionary::NOT_FOUND && strToEnum.size() > 1 )
             {
-                std::string val = "?";
-                size_t e = m_enum_to_str[i].end()->first;
-                map<string, size_t>::iterator it = m_str_to_enum[i].find ( val );
-                
-                // add unknown as enum
-                if ( it == m_str_to_enum[i].end() && m_str_to_enum[i].size() > 1 )
-                {
-                    m_str_to_enum[i][val] = e;
-                    m_enum_to_str[i][e] = val;
-                }
-
-                // convert data values to enum instead
-                for (size_t j = 0; j < rowIs.size(); ++j)
-                {
-                    size_t row = rowIs[j];
-                    if (this->row(row)[i] == UNKNOWN_VALUE)
-                        this->row(row)[i] = e;
-                }
+                Attribute& attr = ownAttribute(i);
+                attr.strToEnum.set(val, e);
+                attr.enumToStr.push_back(val);
             }
-            //continuous values are not enumerated, so it is ok for them to have UNKNOWN_VALUE
+
+            // convert data values to enum instead
+            for (size_t j = 0; j < rowIs.size(); ++j)
+                this->row(rowIs[j])[i] = e;
         }
     }
 }
 
 void Matrix::setAll(double val)
 {
-	size_t c = cols();
-	std::vector< std::vector<double> >::iterator it;
-	for(it = m_data.begin(); it != m_data.end(); it++)
-		it->assign(c, val);
+	detach();
+	m_pData->touch();
+	simdFill(m_pData->data(), m_pData->size(), val);
 }
 
 void Matrix::checkCompatibility(Matrix& that)
@@ -416,79 +1256,26 @@ void Matrix::makeContinuousAttrsNominal(size_t values)
 	for(size_t i = 0; i < c; i++)
 	{
 		if(valueCount(i) == 0)
-		{
-			for(size_t j = 0; j < values; j++)
-				m_enum_to_str[i][j] = "";
-		}
+			ownAttribute(i).enumToStr.assign(values, "");
 	}
 }
 
 std::vector<size_t> Matrix::getRowsWithAttrValues(size_t attr, double value)
 {
-    size_t r = rows();
     if (attr >= cols())
         ThrowError("getRowsWithAttrValues::Invalid attr number");
 
     std::vector<size_t> result;
-    for (size_t i = 0; i < r; ++i)
+    size_t i = 0;
+    forEachInColumn(attr, [&](double val)
     {
-        if (row(i)[attr] == value)
-        {
+        if (val == value)
             result.push_back(i);
-        }
-    }
+        ++i;
+    });
     return result;
 }
 
-std::vector<size_t> Matrix::copyReduce(Matrix& reduced, size_t attr, double value)
-{
-    reduced.setSize(0, this->cols());
-    reduced = Matrix(*this);
-
-    // remove attribute and value info not in new matrix
-    std::vector<std::string>::iterator attr_name_it = reduced.m_attr_name.begin() + attr;
-    reduced.m_attr_name.erase(attr_name_it);
-
-    std::vector< std::map<std::string, size_t> >::iterator str_to_enum_it = reduced.m_str_to_enum.begin() + attr;
-    reduced.m_str_to_enum.erase(str_to_enum_it);
-
-    std::vector< std::map<size_t, std::string> >::iterator enum_to_str_it = reduced.m_enum_to_str.begin() + attr;
-    reduced.m_enum_to_str.erase(enum_to_str_it);
-
-    // copy the rows we want
-    std::vector<size_t> keepRows = getRowsWithAttrValues(attr, value);
-    for (size_t i = 0; i < keepRows.size(); ++i)
-    {
-        // copy this row
-        std::vector<double> row = std::vector<double> (this->row(keepRows[i]));
-
-        // remove attr column from every row
-        std::vector<double>::iterator row_it = row.begin() + attr;
-        row.erase(row_it, row_it + 1);
-
-        // copy row (again?) into reduced matrix
-        reduced.copyRow(row);
-    }
-    //std::cout << "copyReduce - " << this->rows() << " x " << this->cols() << " --> " << reduced.rows() << " x " << reduced.cols() << std::endl;
-
-    return keepRows;
-}
-
-void Matrix::copyReduce(Matrix& reduced, std::vector<size_t> rows)
-{
-    reduced.setSize(0, this->cols());
-    reduced = Matrix(*this);
-
-    for (size_t i = 0; i < rows.size(); ++i)
-    {
-        // copy this row
-        std::vector<double> row = std::vector<double> (this->row(rows[i]));
-
-        // copy row (again?) into reduced matrix
-        reduced.copyRow(row);
-    }
-}
-
 void Matrix::toCSV()
 {
     size_t rows = this->rows();
@@ -507,3 +1294,112 @@ void Matrix::toCSV()
         }
     }
 }
+
+
+
+MatrixView::MatrixView(Matrix& that, size_t rowBegin, size_t colBegin, size_t rowCount, size_t colCount)
+{
+	if(rowBegin + rowCount > that.rows() || colBegin + colCount > that.cols())
+		ThrowError("out of range");
+	refer(that, colBegin, colCount);
+	addRows(that, rowBegin, rowCount);
+	inheritColumnInfo(that, colBegin);
+}
+
+MatrixView::MatrixView(Matrix& that, const vector<size_t>& rows)
+{
+	refer(that, 0, that.cols());
+	addRows(that, rows);
+	inheritColumnInfo(that, 0);
+}
+
+MatrixView::MatrixView(Matrix& that, const vector<size_t>& rows, size_t dropCol)
+{
+	if(dropCol >= that.cols())
+		ThrowError("out of range");
+	refer(that, 0, that.cols());
+	addRows(that, rows);
+	if(m_pSparse)
+		densify(); // (sparse rows are not indexed by column)
+
+	// Leave out the meta-data and the elements of the dropped column
+	Schema& schema = ownSchema();
+	schema.erase(schema.begin() + dropCol);
+	if(m_colIndex.empty())
+	{
+		m_colIndex.resize(that.cols());
+		for(size_t i = 0; i < that.cols(); i++)
+			m_colIndex[i] = m_colBegin + i;
+	}
+	m_colIndex.erase(m_colIndex.begin() + dropCol);
+	inheritColumnInfo(that, 0, dropCol);
+}
+
+void MatrixView::refer(Matrix& that, size_t colBegin, size_t colCount)
+{
+	// Copy the meta-data of the specified columns
+	m_filename = that.m_filename;
+	shareSchema(that, colBegin, colCount);
+
+	// Share the elements
+	m_pData = that.m_pData;
+	m_pSparse = that.m_pSparse;
+	m_pColumns = that.m_pColumns;
+	m_pSpill = that.m_pSpill;
+	m_stride = that.m_stride;
+	if(that.m_colIndex.empty())
+		m_colBegin = that.m_colBegin + colBegin;
+	else
+		m_colIndex.assign(that.m_colIndex.begin() + colBegin, that.m_colIndex.begin() + colBegin + colCount);
+}
+
+void MatrixView::addRows(Matrix& that, size_t rowBegin, size_t rowCount)
+{
+	if(that.m_pData != m_pData)
+		ThrowError("Expected the matrix this view was made from");
+	if(rowBegin + rowCount > that.rows())
+		ThrowError("out of range");
+	if(m_rowIndex.empty() && that.m_rowIndex.empty() && (m_rows == 0 || that.m_rowBegin + rowBegin == m_rowBegin + m_rows))
+	{
+		// The rows follow on from the ones already in this view
+		if(m_rows == 0)
+			m_rowBegin = that.m_rowBegin + rowBegin;
+	}
+	else
+	{
+		indexRows();
+		m_rowIndex.reserve(m_rows + rowCount);
+		for(size_t i = 0; i < rowCount; i++)
+			m_rowIndex.push_back(that.m_rowIndex.empty() ? that.m_rowBegin + rowBegin + i : that.m_rowIndex[rowBegin + i]);
+	}
+	m_rows += rowCount;
+	forgetColumnInfo();
+}
+
+void MatrixView::addRows(Matrix& that, const vector<size_t>& rows)
+{
+	if(that.m_pData != m_pData)
+		ThrowError("Expected the matrix this view was made from");
+	indexRows();
+	m_rowIndex.reserve(m_rows + rows.size());
+	for(size_t i = 0; i < rows.size(); i++)
+	{
+		if(rows[i] >= that.rows())
+			ThrowError("out of range");
+		m_rowIndex.push_back(that.m_rowIndex.empty() ? that.m_rowBegin + rows[i] : that.m_rowIndex[rows[i]]);
+	}
+	m_rows += rows.size();
+	forgetColumnInfo();
+}
+
+void MatrixView::inheritColumnInfo(Matrix& that, size_t colBegin, size_t dropCol)
+{
+	// Any rows of a column with no missing values have none either
+	if(!that.infoCurrent() || m_pData != that.m_pData)
+		return;
+	for(size_t i = 0; i < cols(); i++)
+	{
+		if(that.knownComplete(i < dropCol ? colBegin + i : colBegin + i + 1))
+			setComplete(i);
+	}
+}
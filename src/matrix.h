@@ -6,16 +6,212 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include "dictionary.h"
+#include "spillstorage.h"
 #include <vector>
 #include <map>
 #include <string>
 #include <iostream>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <string_view>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 class Rand;
 
 #define UNKNOWN_VALUE -1e308
 
 
+// Holds the elements of one or more matrices. (A MatrixView shares the
+// storage of the matrix it refers to.) Usually the elements are kept in a
+// vector that can grow, but they may also live in memory owned by
+// something else, such as a memory-mapped file, in which case they can be
+// changed but not added to.
+//
+// The storage also has a version, which changes whenever the elements
+// may have changed since something was last computed from them, so that
+// matrices can tell when what they know about their columns is out of
+// date. (A matrix that is sparse or compact keeps an empty MatrixStorage
+// for this.)
+class MatrixStorage
+{
+private:
+	std::vector<double> m_elements; // used unless m_pExternal is set
+	double* m_pExternal;
+	size_t m_externalSize;
+	boost::shared_ptr<void> m_pOwner; // keeps the external memory alive
+	std::atomic<bool> m_observed; // true if the version has been read since it last changed
+	std::atomic<unsigned long> m_version;
+
+public:
+	// Makes storage for size elements with the value val
+	MatrixStorage(size_t size = 0, double val = 0.0)
+	: m_elements(size, val), m_pExternal(NULL), m_externalSize(0), m_observed(false), m_version(0) {}
+
+	// Refers to size elements at pExternal. (pOwner is held until this storage is destroyed.)
+	MatrixStorage(double* pExternal, size_t size, boost::shared_ptr<void> pOwner)
+	: m_pExternal(pExternal), m_externalSize(size), m_pOwner(pOwner), m_observed(false), m_version(0) {}
+
+	// Returns a pointer to the first element
+	double* data() { return m_pExternal ? m_pExternal : m_elements.data(); }
+
+	// Returns the number of elements
+	size_t size() const { return m_pExternal ? m_externalSize : m_elements.size(); }
+
+	// Returns true if elements can be added
+	bool growable() const { return m_pExternal == NULL; }
+
+	// Returns the vector that holds the elements, so they can be added to. (Only for growable storage.)
+	std::vector<double>& elements() { return m_elements; }
+
+	// Notes that the elements may be about to change. (This only writes
+	// anything if the version has been read since it last changed, so it
+	// is cheap to call for every access that could write.)
+	void touch()
+	{
+		if(m_observed.load(std::memory_order_relaxed))
+		{
+			m_observed = false;
+			m_version++;
+		}
+	}
+
+	// Returns the version of the elements, which stays the same until they
+	// change, and makes sure that the next change will change it
+	unsigned long observe() { m_observed = true; return m_version; }
+
+	// Returns the version of the elements
+	unsigned long version() const { return m_version; }
+};
+
+
+// Holds the elements of a sparse matrix in compressed sparse row (CSR)
+// form. Only the elements that are not zero are kept, row by row, each
+// with its column. (Like MatrixStorage, this is shared with views.)
+class SparseStorage
+{
+public:
+	std::vector<size_t> rowStart; // the first element of each stored row, followed by the number of elements
+	std::vector<size_t> cols; // the stored column of each element (ascending within a row)
+	std::vector<double> values; // the value of each element
+
+	SparseStorage() : rowStart(1, 0) {}
+
+	// Returns the number of stored rows
+	size_t rows() const { return rowStart.size() - 1; }
+
+	// Ends the row that holds the elements added since the last row ended
+	void endRow() { rowStart.push_back(cols.size()); }
+
+	// Removes all the rows
+	void clear() { rowStart.assign(1, 0); cols.clear(); values.clear(); }
+};
+
+
+// Holds the elements of a matrix column by column, each column in the
+// smallest type that holds its values: one- or two-byte codes for nominal
+// columns (the largest code means UNKNOWN_VALUE), and doubles, or
+// optionally floats (with NaN for UNKNOWN_VALUE), for continuous ones.
+// (Like MatrixStorage, this is shared with views.)
+class ColumnStorage
+{
+public:
+	enum Type { UINT8, UINT16, FLOAT32, FLOAT64 };
+
+	static const uint8_t MISSING8 = 0xff;
+	static const uint16_t MISSING16 = 0xffff;
+
+private:
+	struct Column
+	{
+		Type type;
+		size_t values; // the number of values of a nominal column (or 0)
+		size_t missing; // the number of elements that are UNKNOWN_VALUE
+		std::vector<uint8_t> uint8s;
+		std::vector<uint16_t> uint16s;
+		std::vector<float> floats;
+		std::vector<double> doubles;
+	};
+
+	std::vector<Column> m_columns;
+	size_t m_rows;
+
+public:
+	// Makes an empty column for each element of valueCounts (which is the
+	// number of values of a nominal column, or 0 for a continuous one).
+	// Continuous columns hold floats if floats is true.
+	ColumnStorage(const std::vector<size_t>& valueCounts, bool floats);
+
+	// Returns the number of rows
+	size_t rows() const { return m_rows; }
+
+	// Returns the type of the specified column
+	Type type(size_t col) const { return m_columns[col].type; }
+
+	// Returns the number of elements of the specified column that are UNKNOWN_VALUE
+	size_t missing(size_t col) const { return m_columns[col].missing; }
+
+	// Adds rows, given as consecutive rows of one double per column. Throws
+	// if a nominal column is given a value that is not one of its codes.
+	void append(const double* pRows, size_t rows);
+
+	// Returns the specified element
+	double get(size_t row, size_t col) const;
+
+	// Returns the elements of the specified column, which must have the type that holds T
+	template<class T> const T* data(size_t col) const;
+
+	// Converts an element to a double
+	static double toDouble(uint8_t code) { return code == MISSING8 ? UNKNOWN_VALUE : (double)code; }
+	static double toDouble(uint16_t code) { return code == MISSING16 ? UNKNOWN_VALUE : (double)code; }
+	static double toDouble(float val) { return val != val ? UNKNOWN_VALUE : (double)val; }
+	static double toDouble(double val) { return val; }
+
+private:
+	// Throws if the specified column does not have the specified type
+	void checkType(size_t col, Type type) const;
+};
+
+template<> inline const uint8_t* ColumnStorage::data<uint8_t>(size_t col) const { checkType(col, UINT8); return m_columns[col].uint8s.data(); }
+template<> inline const uint16_t* ColumnStorage::data<uint16_t>(size_t col) const { checkType(col, UINT16); return m_columns[col].uint16s.data(); }
+template<> inline const float* ColumnStorage::data<float>(size_t col) const { checkType(col, FLOAT32); return m_columns[col].floats.data(); }
+template<> inline const double* ColumnStorage::data<double>(size_t col) const { checkType(col, FLOAT64); return m_columns[col].doubles.data(); }
+
+
+// Marks which rows of a column have a value (that is, are not
+// UNKNOWN_VALUE), with one bit per row. A column with no missing values
+// needs no bits at all, so loops can check complete() once and then skip
+// the test for UNKNOWN_VALUE altogether.
+class ValidityMask
+{
+private:
+	std::vector<uint64_t> m_bits; // bit i % 64 of m_bits[i / 64] is set if row i has a value (empty if every row does)
+	size_t m_missing;
+
+public:
+	// Makes a mask for a column with no missing values
+	ValidityMask() : m_missing(0) {}
+
+	// Makes a mask from its bits and the number of rows whose bits are clear
+	ValidityMask(const std::vector<uint64_t>& bits, size_t missing)
+	: m_bits(missing > 0 ? bits : std::vector<uint64_t>()), m_missing(missing) {}
+
+	// Returns true if no row is missing a value
+	bool complete() const { return m_missing == 0; }
+
+	// Returns the number of rows that are missing a value
+	size_t missing() const { return m_missing; }
+
+	// Returns true if the specified row has a value
+	bool has(size_t row) const { return m_missing == 0 || ((m_bits[row / 64] >> (row % 64)) & 1) != 0; }
+
+	// Returns the bits, 64 rows per word (or NULL if complete)
+	const uint64_t* words() const { return m_bits.empty() ? NULL : m_bits.data(); }
+};
+
+
 // This stores a matrix, A.K.A. data set, A.K.A. table. Each element is
 // represented as a double value. Nominal values are represented using their
 // corresponding zero-indexed enumeration value. For convenience,
@@ -35,31 +231,284 @@ class Rand;
 //
 class Matrix
 {
+public:
+	// A lightweight reference to the elements of one row. It does not own
+	// the elements, so it is only valid until the matrix is resized.
+	class Row
+	{
+	private:
+		double* m_pData;
+		const size_t* m_pCols; // the position of each element in m_pData, or NULL if they are consecutive
+		size_t m_size;
+
+	public:
+		Row(double* pData, size_t size, const size_t* pCols = NULL) : m_pData(pData), m_pCols(pCols), m_size(size) {}
+
+		// Returns a reference to the specified element
+		double& operator [](size_t index) const { return m_pCols ? m_pData[m_pCols[index]] : m_pData[index]; }
+
+		// Returns the number of elements in the row
+		size_t size() const { return m_size; }
+
+		// Copies the elements into out, resizing it to fit
+		void copyTo(std::vector<double>& out) const
+		{
+			if(!m_pCols)
+				out.assign(m_pData, m_pData + m_size);
+			else
+			{
+				out.resize(m_size);
+				for(size_t i = 0; i < m_size; i++)
+					out[i] = m_pData[m_pCols[i]];
+			}
+		}
+
+		// Copies the elements into a vector
+		operator std::vector<double>() const { std::vector<double> v; copyTo(v); return v; }
+	};
+
+	// A lightweight reference to the elements of one row of a sparse matrix
+	// that are not zero, in order of column. It is only valid until the
+	// matrix is changed.
+	class SparseRow
+	{
+	private:
+		const size_t* m_pCols;
+		const double* m_pValues;
+		size_t m_size;
+		size_t m_width;
+		size_t m_colBegin; // subtracted from each element of m_pCols
+
+	public:
+		SparseRow(const size_t* pCols, const double* pValues, size_t size, size_t width, size_t colBegin = 0)
+		: m_pCols(pCols), m_pValues(pValues), m_size(size), m_width(width), m_colBegin(colBegin) {}
+
+		// Returns the number of elements that are not zero
+		size_t size() const { return m_size; }
+
+		// Returns the number of columns in the row (including the zeros)
+		size_t width() const { return m_width; }
+
+		// Returns the column of the specified element
+		size_t col(size_t i) const { return m_pCols[i] - m_colBegin; }
+
+		// Returns the value of the specified element
+		double value(size_t i) const { return m_pValues[i]; }
+
+		// Copies the row into out, with zeros where there are no elements
+		void copyTo(std::vector<double>& out) const
+		{
+			out.assign(m_width, 0.0);
+			for(size_t i = 0; i < m_size; i++)
+				out[m_pCols[i] - m_colBegin] = m_pValues[i];
+		}
+	};
+
+	// A lightweight reference to the elements of one column of a compact
+	// matrix, in their stored type (see ColumnStorage::toDouble). It is only
+	// valid until the matrix is changed.
+	template<class T>
+	class Column
+	{
+	private:
+		const T* m_pData;
+		const size_t* m_pRows; // the stored row of each row, or NULL if they are consecutive
+		size_t m_rowBegin;
+		size_t m_size;
+
+	public:
+		Column(const T* pData, const size_t* pRows, size_t rowBegin, size_t size)
+		: m_pData(pData), m_pRows(pRows), m_rowBegin(rowBegin), m_size(size) {}
+
+		// Returns the element in the specified row
+		T operator [](size_t index) const { return m_pRows ? m_pData[m_pRows[index]] : m_pData[m_rowBegin + index]; }
+
+		// Returns the number of rows
+		size_t size() const { return m_size; }
+	};
+
+	// Ways to keep the elements of a matrix in memory
+	enum Layout
+	{
+		DENSE, // a double for each element
+		COMPACT, // column by column, with small codes for nominal columns (see ColumnStorage)
+		COMPACT_FLOAT, // like COMPACT, with floats for continuous columns
+		SPILL, // in a temporary file, with only some blocks of rows in memory (see spill)
+	};
+
+	// Visits the rows of a matrix a block at a time, in the order in which
+	// they are stored rather than their order in the matrix. For a matrix
+	// kept in a spill file (see spill), each block is a block of the file,
+	// and the next block is read ahead while one is visited, so the file
+	// is read once, from start to end, however the rows have been shuffled
+	// or split into views. Any other matrix is visited as a single block,
+	// in order. For example:
+	//
+	// Matrix::BlockIterator it(features);
+	// while(it.next())
+	// {
+	//     for(size_t i = 0; i < it.size(); i++)
+	//         process(it.index(i), it.row(i));
+	// }
+	//
+	class BlockIterator
+	{
+	private:
+		Matrix& m_matrix;
+		std::vector<size_t> m_rows; // the rows of the matrix, grouped by the stored block that holds them (empty if the matrix is not spilled and has not been shuffled)
+		std::vector<size_t> m_starts; // where the rows of each block start in m_rows, and where the last ones end (empty along with m_rows)
+		size_t m_block; // the current block, or the number of blocks once they have all been visited
+		SpillStorage::BlockPtr m_pBlock; // the current block (only if spilled)
+		std::vector<double> m_row; // the row that row last returned
+		bool m_started;
+
+	public:
+		// Prepares to visit the rows of m, which should not change until they have been visited
+		BlockIterator(Matrix& m);
+
+		// Moves to the next block. Returns false when every block has been visited.
+		bool next();
+
+		// Returns the number of rows in the current block
+		size_t size() const { return m_starts.empty() ? m_matrix.rows() : m_starts[m_block + 1] - m_starts[m_block]; }
+
+		// Returns the row of the matrix that is the specified row of the current block
+		size_t index(size_t i) const { return m_starts.empty() ? i : m_rows[m_starts[m_block] + i]; }
+
+		// Returns the specified element of the specified row of the current block
+		double get(size_t i, size_t col);
+
+		// Returns the elements of the specified row of the current block.
+		// (They are valid until the next call.)
+		const std::vector<double>& row(size_t i);
+
+		// Shuffles the rows of the current block
+		void shuffle(Rand& r);
+	};
+
 private:
+	friend class MatrixView;
+	friend class ArffParser;
+	friend class ArffReader;
+	friend class CsvParser;
+	friend class LibSvmParser;
+	friend class MlbFile;
+
+	// What is known about one column. It is computed when it is first
+	// needed, and forgotten when the elements change.
+	struct ColumnInfo
+	{
+		bool hasValidity; // true if validity has been computed
+		bool hasMoments; // true if count, sum, min and max have been computed
+		bool hasStats; // true if the moments, the validity and the counts of a nominal column have been computed
+		bool hasCounts; // true if the counts have been computed
+		ValidityMask validity;
+		size_t count; // the number of elements that are not UNKNOWN_VALUE
+		double sum; // the sum of the elements that are not UNKNOWN_VALUE
+		double min; // the smallest element that is not UNKNOWN_VALUE (or 1e300 if there is none)
+		double max; // the largest element that is not UNKNOWN_VALUE (or -1e300 if there is none)
+		std::vector<size_t> enumCounts; // the number of times each value of a nominal column occurs
+		std::map<double, size_t> otherCounts; // the number of times each other element occurs (such as UNKNOWN_VALUE, or any element of a continuous column)
+
+		ColumnInfo() : hasValidity(false), hasMoments(false), hasStats(false), hasCounts(false), count(0), sum(0.0), min(1e300), max(-1e300) {}
+	};
+
+	// The meta-data of one column
+	struct Attribute
+	{
+		std::string name; // the name of the attribute
+		Dictionary strToEnum; // value to enumeration
+		std::vector<std::string> enumToStr; // enumeration to value
+	};
+
+	// The meta-data of every column. A copy of a matrix shares the whole
+	// list with the original, and a view of some of the columns shares the
+	// attributes of those columns, so neither copies any strings. The list
+	// and the attributes are copied on write: whichever matrix changes its
+	// meta-data first gets its own copy of the part that it changes.
+	typedef std::vector< boost::shared_ptr<Attribute> > Schema;
+
 	// Data
-	std::vector< std::vector<double> > m_data; // matrix elements
+	boost::shared_ptr<MatrixStorage> m_pData; // elements, stored contiguously in row-major order. (Views share this with their parent.)
+	boost::shared_ptr<SparseStorage> m_pSparse; // if non-NULL, the elements are kept here instead (and m_pData is empty)
+	boost::shared_ptr<ColumnStorage> m_pColumns; // if non-NULL, the elements are kept here instead, column by column (and m_pData is empty)
+	boost::shared_ptr<SpillStorage> m_pSpill; // if non-NULL, the elements are kept here instead, in a file (and m_pData is empty)
+	size_t m_rows; // the number of rows in the matrix
+	size_t m_stride; // the distance between the first elements of consecutive stored rows (or the number of stored columns, if sparse or compact)
+	size_t m_rowBegin; // the first stored row (used when m_rowIndex is empty)
+	size_t m_colBegin; // the stored column of column 0 (used when m_colIndex is empty)
+	std::vector<size_t> m_rowIndex; // the stored row of each row, or empty if the rows are stored consecutively
+	std::vector<size_t> m_colIndex; // the stored column of each column, or empty if the columns are stored consecutively
+	std::vector<ColumnInfo> m_columnInfo; // what is known about each column (or empty if nothing is)
+	boost::weak_ptr<MatrixStorage> m_pInfoData; // the storage that m_columnInfo was computed from
+	unsigned long m_infoVersion; // the version of that storage when it was
 
 	// Meta-data
 	std::string m_filename; // the name of the file
-	std::vector<std::string> m_attr_name; // the name of each attribute (or column)
-	std::vector< std::map<std::string, size_t> > m_str_to_enum; // value to enumeration
-	std::vector< std::map<size_t, std::string> > m_enum_to_str; // enumeration to value
+	boost::shared_ptr<Schema> m_pSchema; // the meta-data of each attribute (or column)
 
 public:
 	// Creates a 0x0 matrix. You should call loadARFF or setSize to 
-	Matrix() {}
+	Matrix();
 
-	// Copies the meta-data from that, but not the data
+	// Copies the meta-data from that, but not the data. (The meta-data is
+	// shared until one of the matrices changes it, so this copies no strings.)
 	Matrix(Matrix& that);
 
     // Copies the meta-data from const that, but not the data
     Matrix(const Matrix& that);
 
+	// Takes the data and the meta-data of that, leaving it an empty 0x0 matrix
+	Matrix(Matrix&& that);
+
 	// Destructor
 	~Matrix() {}
 
-	// Loads the matrix from an ARFF file
-	void loadARFF(std::string filename);
+	// Copies the data and the meta-data of that, so a change made through
+	// either matrix is not seen through the other. (Dense elements are
+	// copied now. Sparse, compact and spilled elements are shared, because
+	// any change to them first gives the matrix its own copy. The meta-data
+	// is shared until one of the matrices changes it.)
+	Matrix& operator=(const Matrix& that);
+
+	// Shares the data and the meta-data of that, like a view of all of it,
+	// so a change made through either matrix is seen through the other.
+	// (Nothing is copied.)
+	void share(const Matrix& that);
+
+	// Takes the data and the meta-data of that, leaving it with what this matrix had
+	Matrix& operator=(Matrix&& that);
+
+	// Exchanges the data and the meta-data of the two matrices
+	void swap(Matrix& that);
+
+	// Loads the matrix from an ARFF file. If useCache is true, the parsed
+	// matrix is saved in a sidecar file, and later loads of the same
+	// (unchanged) file read that instead. (See ArffCache in arff.h.) The
+	// elements are kept in the specified layout (unless the file is sparse).
+	// With the SPILL layout, each block of rows goes to the spill file as
+	// soon as it is parsed, so the file may be bigger than memory.
+	void loadARFF(std::string filename, bool useCache = false, Layout layout = DENSE);
+
+	// Loads the matrix from a CSV file with a line of column names (see
+	// CsvParser in csv.h). If pSchema is non-NULL, the file is read with
+	// its columns and nominal values; otherwise a column is nominal if it
+	// has values that are not numbers in the first block of the file. The
+	// elements are kept in the specified layout.
+	void loadCSV(const std::string& filename, Matrix* pSchema = NULL, Layout layout = DENSE);
+
+	// Loads the matrix from a LibSVM file (see LibSvmParser in libsvm.h),
+	// keeping its elements in sparse form. The label becomes the last
+	// column. If pSchema is non-NULL, the matrix gets its columns.
+	void loadLibSVM(const std::string& filename, Matrix* pSchema = NULL);
+
+	// Refers to the contents of a binary dataset file (see mlbfile.h)
+	// without copying them. The file is memory-mapped, so loading takes
+	// about the same time no matter how big it is.
+	void loadBinary(const std::string& filename);
+
+	// Writes the matrix and its meta-data to a binary dataset file
+	void saveBinary(const std::string& filename);
 
     // creates an enum value for UNKNOWN_VALUE in the metadata
     void useUnknown();
@@ -68,36 +517,148 @@ public:
 	void setSize(size_t rows, size_t cols);
 
 	// Returns the number of rows in the matrix
-	size_t rows() { return m_data.size(); }
+	size_t rows() const { return m_rows; }
 
 	// Returns the number of columns (or attributes) in the matrix
-	size_t cols() { return m_attr_name.size(); }
+	size_t cols() const { return m_pSchema->size(); }
 
 	// Returns the name of the specified attribute
-	std::string& attrName(size_t col) { return m_attr_name[col]; }
+	const std::string& attrName(size_t col) const { return attribute(col).name; }
 
-	// Returns the name of the specified value
-    std::string& attrValue(size_t attr, size_t val) { return m_enum_to_str[attr][val]; }
+	// Returns the name of the specified value (or an empty string if the attribute has no such value)
+    const std::string& attrValue(size_t attr, size_t val);
 
     std::vector<size_t> allAttrValues(size_t attr);
 
-    // Returns the value of the specified attr name
-    size_t nameValue(size_t attr, std::string name) { return m_str_to_enum[attr][name]; }
-
-	// Returns a pointer to the specified row
-	std::vector<double>& row(size_t index) { return m_data[index]; }
-
-	// Returns a pointer to the specified row
-	std::vector<double>& operator [](size_t index) { return m_data[index]; }
+    // Returns the value of the specified attr name (or 0 if the attribute has no such value)
+    size_t nameValue(size_t attr, std::string_view name);
+
+	// Returns true if the elements are kept in sparse form (see sparseRow)
+	bool isSparse() const { return m_pSparse.get() != NULL; }
+
+	// Returns the elements of the specified row that are not zero. (Only
+	// for sparse matrices. This is the way to read a sparse matrix
+	// without making it dense.)
+	SparseRow sparseRow(size_t index) const;
+
+	// Converts a sparse, compact or spilled matrix to the usual dense form.
+	// (This is done automatically by row and anything else that needs a dense
+	// matrix. Only this matrix is converted, not any other matrix that
+	// shares its elements.)
+	void densify();
+
+	// Keeps the elements column by column in the smallest types that hold
+	// them (see ColumnStorage), which takes an eighth of the memory for
+	// nominal columns. If floats is true, continuous columns are kept as
+	// floats, which halves their memory but rounds their values. The
+	// matrix can still be read in any way; anything that changes it first
+	// makes it dense again.
+	void compact(bool floats = false);
+
+	// Returns true if the elements are kept column by column (see compact)
+	bool isCompact() const { return m_pColumns.get() != NULL; }
+
+	// Moves the elements to a temporary file (see SpillStorage), keeping
+	// only the blocks of rows that were used most recently in memory. The
+	// matrix can still be read in any way, but it is fastest to read it
+	// with a BlockIterator, which reads the file in order. The file is read
+	// in blocks of blockRows rows (or of about SPILL_BLOCK_BYTES, if
+	// blockRows is 0). Anything that changes the matrix first makes it
+	// dense again (which needs it to fit in memory).
+	void spill(size_t blockRows = 0);
+
+	// Returns true if the elements are kept in a spill file (see spill)
+	bool isSpilled() const { return m_pSpill.get() != NULL; }
+
+	// Returns the type in which the elements of the specified column are
+	// kept. (This is FLOAT64 unless the matrix is compact.)
+	ColumnStorage::Type columnType(size_t col) { return m_pColumns ? m_pColumns->type(storedCol(col)) : ColumnStorage::FLOAT64; }
+
+	// Returns the elements of a column of a compact matrix in their stored
+	// type, T, which must match columnType. This is the fastest way to read
+	// a compact matrix.
+	template<class T>
+	Column<T> column(size_t col)
+	{
+		return Column<T>(columnStorage().data<T>(storedCol(col)), m_rowIndex.empty() ? NULL : &m_rowIndex[0], m_rowBegin, m_rows);
+	}
+
+	// Returns the specified element, whatever form the matrix is kept in
+	double get(size_t row, size_t col) const;
+
+	// Copies the specified row into out, whatever form the matrix is kept
+	// in. (Unlike row, this does not make a sparse or compact matrix dense.)
+	void getRow(size_t index, std::vector<double>& out) const;
+
+	// Returns a reference to the specified row
+	Row row(size_t index)
+	{
+		if(m_pSparse || m_pColumns || m_pSpill)
+			densify();
+		m_pData->touch(); // (the row may be written through)
+		if(m_colIndex.empty())
+			return Row(storedRow(index) + m_colBegin, cols());
+		return Row(storedRow(index), cols(), &m_colIndex[0]);
+	}
+
+	// Returns a reference to the specified row
+	Row operator [](size_t index) { return row(index); }
 
 	// Shuffles the rows in the matrix. If pBuddy is non-NULL, it also
 	// shuffles the rows in pBuddy, keeping the corresponding rows in
-	// both matrices in the same locations.
+	// both matrices in the same locations. (Only the row order changes; the
+	// elements stay where they are stored.)
 	void shuffleRows(Rand& r, Matrix* pBuddy = NULL);
 
+	// Shuffles a list of row numbers, drawing from r exactly as shuffleRows
+	// does. A learner that visits the rows in a different order each epoch
+	// can shuffle a list like this instead of the rows themselves, and then
+	// visit row order[0], order[1], and so on:
+	//
+	// std::vector<size_t> order;
+	// Matrix::identityOrder(features.rows(), order);
+	// for(each epoch)
+	// {
+	//     Matrix::shuffleOrder(r, order);
+	//     for(size_t i = 0; i < order.size(); i++)
+	//         train on features.row(order[i]) and labels.row(order[i])
+	// }
+	static void shuffleOrder(Rand& r, std::vector<size_t>& order);
+
+	// Sets order to 0, 1, ..., rows - 1
+	static void identityOrder(size_t rows, std::vector<size_t>& order);
+
+	// Visits every row in a new random order for an epoch of training,
+	// calling f with the number of each row. A matrix in memory is visited
+	// in the order of order, which is shuffled with shuffleOrder (so keep
+	// it from one epoch to the next; it starts as identityOrder). A spilled
+	// matrix is read in order, a block at a time (see BlockIterator), so
+	// only the rows within each block are shuffled, and getRow finds each
+	// row in the block that is being visited.
+	void visitShuffled(Rand& r, std::vector<size_t>& order, const std::function<void (size_t)>& f);
+
 	// Returns the number of values associated with the specified attribute (or column)
 	// 0=continuous, 2=binary, 3=trinary, etc.
-	size_t valueCount(size_t attr) { return m_enum_to_str[attr].size(); }
+	size_t valueCount(size_t attr) const { return attribute(attr).enumToStr.size(); }
+
+	// Returns which rows of the specified column have a value. This is
+	// computed when it is first needed, and kept until the elements change.
+	// (A column is known to be complete without looking at it if it was
+	// loaded from an ARFF file with no missing values in it, or if it is
+	// part of such a column in the matrix that a view refers to.)
+	const ValidityMask& validity(size_t col);
+
+	// Returns true if any element of the specified column is UNKNOWN_VALUE
+	bool hasMissing(size_t col) { return !validity(col).complete(); }
+
+	// The following statistics are all computed in a single pass over the
+	// column the first time any of them is needed, and kept (with the
+	// validity of the column) until the elements change. (The value counts
+	// of a nominal column are computed in the same pass; those of a
+	// continuous column only when they are asked for.) The mean, min and
+	// max of a dense matrix are computed for all of its columns at once, in
+	// one pass over the rows with vector instructions (see simd.h). Filters
+	// and learners given the same matrix share them.
 
 	// Returns the mean of the elements in the specified column. (Elements with the value UNKNOWN_VALUE are ignored.)
 	double columnMean(size_t col);
@@ -115,8 +676,28 @@ public:
     // Basically, every possible value in the specified column with the # of counts for each value
     std::map<double, size_t> getValueCounts(size_t col);
 
+	// Counts the values of a nominal column into an array, which is faster
+	// than getValueCounts: counts[v] is the number of rows with the value v,
+	// and counts[valueCount(col)] the number with UNKNOWN_VALUE. Returns
+	// false if the column is continuous or has any other element.
+	bool countValues(size_t col, std::vector<size_t>& counts);
+
+	// Counts the rows with each pair of values of a nominal column and a
+	// nominal column of labels (with the same number of rows) into a
+	// contingency table, with a row for each value of the column:
+	// table[v * (labels.valueCount(labelCol) + 1) + c] is the number of rows
+	// with the value v and the label c. (The last row and the last column are
+	// for UNKNOWN_VALUE.) Returns false if either column is continuous or
+	// has any other element.
+	bool countValues(size_t col, Matrix& labels, size_t labelCol, std::vector<size_t>& table);
+
 	// Adds a new row to this matrix that is a copy of row.
-	void copyRow(std::vector<double>& row);
+	void copyRow(const std::vector<double>& row);
+
+	// Adds a new row to this matrix with the elements of a sparse row. An
+	// empty matrix becomes sparse; otherwise the row is stored in whatever
+	// form the matrix already has.
+	void copyRow(const SparseRow& row);
 
 	// Copies the specified rectangular portion of that matrix, and adds it to the bottom of this matrix.
 	// (If colCount does not match the number of columns in this matrix, then this matrix will be cleared first.)
@@ -136,15 +717,187 @@ public:
     // Return a vector with the indices of the rows corresponding to the given attribute value
     std::vector<size_t> getRowsWithAttrValues(size_t attr, double value);
 
-    // Gets a matrix copy of the rows of the matrix matching the given attribute value, with that dimension removed
-    // Returns the vector with the indices of the rows that were kept in the original matrix
-    std::vector<size_t> copyReduce(Matrix& reduced, size_t attr, double value);
-
-    // Gets a matrix copy of the rows of the matrix matching the row indices in the given vector
-    void copyReduce(Matrix& reduced, std::vector<size_t> rows);
-
     // Prints the matrix in CSV format to stdout
     void toCSV();
+
+private:
+	// Returns a pointer to the stored row that holds the specified row
+	double* storedRow(size_t index) { return m_pData->data() + storedRowIndex(index) * m_stride; }
+	const double* storedRow(size_t index) const { return m_pData->data() + storedRowIndex(index) * m_stride; }
+
+	// Returns the number of the stored row that holds the specified row
+	size_t storedRowIndex(size_t index) const { return m_rowIndex.empty() ? m_rowBegin + index : m_rowIndex[index]; }
+
+	// Returns the position of the specified column within a stored row
+	size_t storedCol(size_t col) const { return m_colIndex.empty() ? m_colBegin + col : m_colIndex[col]; }
+
+	// Returns the element at the specified row and column of a sparse matrix
+	double sparseElement(size_t row, size_t col) const;
+
+	// Returns what is known about the specified column, first forgetting
+	// everything if the elements have changed since it was computed
+	ColumnInfo& columnInfo(size_t col);
+
+	// Returns true if m_columnInfo still describes the elements
+	bool infoCurrent()
+	{
+		return m_columnInfo.size() == cols() && !m_pInfoData.owner_before(m_pData) && !m_pData.owner_before(m_pInfoData) && m_pData->version() == m_infoVersion;
+	}
+
+	// Makes m_columnInfo describe the current storage, after it has been
+	// replaced by a copy of the same elements in the same order. (wasCurrent
+	// is what infoCurrent returned before the copy was made.)
+	void keepColumnInfo(bool wasCurrent);
+
+	// Returns what is known about the specified column, after computing
+	// its statistics if they are not known yet
+	ColumnInfo& columnStats(size_t col);
+
+	// Returns what is known about the specified column, after computing its
+	// moments (see ColumnInfo) if they are not known yet
+	ColumnInfo& columnMoments(size_t col);
+
+	// Computes the moments of every column of a dense matrix in one pass over its rows
+	void computeMoments();
+
+	// Returns what is known about the specified column, after counting its
+	// values if they are not known yet
+	ColumnInfo& countedColumn(size_t col);
+
+	// Returns true if the specified column is already known to have no missing values
+	bool knownComplete(size_t col) { return infoCurrent() && m_columnInfo[col].hasValidity && m_columnInfo[col].validity.complete(); }
+
+	// Forgets everything known about the columns. (This is for changes to
+	// which rows the matrix holds. Changes to the elements themselves are
+	// noticed through the version of the storage.)
+	void forgetColumnInfo() { m_columnInfo.clear(); }
+
+	// Notes that the specified column is known to have no missing values
+	void setComplete(size_t col);
+
+	// Returns the storage of a compact matrix (or throws if it is not compact)
+	const ColumnStorage& columnStorage();
+
+	// Calls f with each element of the specified column (as a double), in
+	// order, whatever form the matrix is kept in. For a compact matrix, the
+	// loop is compiled separately for each stored type.
+	template<class F>
+	void forEachInColumn(size_t col, F f)
+	{
+		if(m_pColumns)
+			visitColumn(col, [&](auto column) { for(size_t i = 0; i < m_rows; i++) f(ColumnStorage::toDouble(column[i])); });
+		else if(m_pSparse)
+		{
+			for(size_t i = 0; i < m_rows; i++)
+				f(sparseElement(i, col));
+		}
+		else if(m_pSpill)
+		{
+			std::vector<double> values;
+			gatherColumn(col, values);
+			for(size_t i = 0; i < m_rows; i++)
+				f(values[i]);
+		}
+		else
+		{
+			size_t stored = storedCol(col);
+			for(size_t i = 0; i < m_rows; i++)
+				f(storedRow(i)[stored]);
+		}
+	}
+
+	// Calls f with the typed Column that holds the specified column of a compact matrix
+	template<class F>
+	void visitColumn(size_t col, F f)
+	{
+		switch(columnType(col))
+		{
+			case ColumnStorage::UINT8: f(column<uint8_t>(col)); break;
+			case ColumnStorage::UINT16: f(column<uint16_t>(col)); break;
+			case ColumnStorage::FLOAT32: f(column<float>(col)); break;
+			case ColumnStorage::FLOAT64: f(column<double>(col)); break;
+		}
+	}
+
+	// Copies the specified column of a spilled matrix into values, in one
+	// pass over the blocks of the file. (A column is small enough to keep
+	// in memory, even when the whole matrix is not.)
+	void gatherColumn(size_t col, std::vector<double>& values);
+
+	// Gives a sparse matrix its own copy of its elements, like detach
+	void detachSparse();
+
+	// Returns the meta-data of the specified column
+	const Attribute& attribute(size_t col) const { return *(*m_pSchema)[col]; }
+
+	// Returns the meta-data of the specified column for changing it, after
+	// giving this matrix its own copy of it if it is shared
+	Attribute& ownAttribute(size_t col);
+
+	// Returns the list of attributes for changing it, after giving this
+	// matrix its own copy of it if it is shared. (The attributes in it are
+	// still shared.)
+	Schema& ownSchema();
+
+	// Replaces the meta-data with that of the specified columns of that
+	void shareSchema(const Matrix& that, size_t colBegin, size_t colCount);
+
+	// Puts row order[i] in place i, for each i, by changing only m_rowIndex
+	void reorderRows(const std::vector<size_t>& order);
+
+	// Switches to listing the stored rows individually in m_rowIndex
+	void indexRows();
+
+	// Gives this matrix its own copy of its elements if they are shared
+	// with another matrix, or if it only refers to part of them.
+	void detach();
+};
+
+
+// A matrix that refers to part of another matrix instead of copying it.
+// The elements are shared, so a change made through one is visible
+// through the other, but the view has its own row order. Operations that
+// restructure a view (such as copyRow, setSize or useUnknown) first give
+// it a private copy of its elements. For example, this makes a view of
+// all but the last column without copying anything:
+//
+// MatrixView features(dataset, 0, 0, dataset.rows(), dataset.cols() - 1);
+//
+// and this gathers the rows where column 2 has the value 1, leaving out
+// column 2:
+//
+// MatrixView reduced(features, features.getRowsWithAttrValues(2, 1), 2);
+//
+// (Note that initializing a Matrix from a view only copies the meta-data,
+// just like initializing it from any other Matrix. Assignment shares.)
+class MatrixView : public Matrix
+{
+public:
+	// Refers to the specified rectangular portion of that matrix
+	MatrixView(Matrix& that, size_t rowBegin, size_t colBegin, size_t rowCount, size_t colCount);
+
+	// Refers to the specified rows of that matrix (in the given order)
+	MatrixView(Matrix& that, const std::vector<size_t>& rows);
+
+	// Refers to the specified rows of that matrix, without the column dropCol
+	MatrixView(Matrix& that, const std::vector<size_t>& rows, size_t dropCol);
+
+	// Adds rowCount rows of that, starting with rowBegin, to the bottom of this view.
+	// (that must be the matrix this view was made from.)
+	void addRows(Matrix& that, size_t rowBegin, size_t rowCount);
+
+	// Adds the specified rows of that to the bottom of this view.
+	// (that must be the matrix this view was made from.)
+	void addRows(Matrix& that, const std::vector<size_t>& rows);
+
+private:
+	// Shares the elements of that, and copies the meta-data of the specified columns
+	void refer(Matrix& that, size_t colBegin, size_t colCount);
+
+	// Notes which columns are complete because the columns of that they
+	// refer to are. (Column i of this view is column colBegin + i of that,
+	// or colBegin + i + 1 if i is not less than dropCol.)
+	void inheritColumnInfo(Matrix& that, size_t colBegin, size_t dropCol = (size_t)-1);
 };
 
 #endif // MATRIX_H
@@ -0,0 +1,466 @@
+#include "matrix.h"
+#include "rand.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "tests/include/gtest/gtest.h"
+
+// Makes a rows x cols matrix where element (r, c) is r * 10 + c
+void fillMatrix(Matrix& m, size_t rows, size_t cols)
+{
+    m.setSize(rows, cols);
+    for (size_t r = 0; r < rows; ++r)
+        for (size_t c = 0; c < cols; ++c)
+            m[r][c] = r * 10.0 + c;
+}
+
+TEST(MatrixViewTest, sharesRectangle)
+{
+    Matrix m;
+    fillMatrix(m, 5, 4);
+
+    MatrixView v (m, 1, 2, 3, 2);
+    ASSERT_EQ(3u, v.rows());
+    ASSERT_EQ(2u, v.cols());
+    EXPECT_EQ(12.0, v[0][0]);
+    EXPECT_EQ(33.0, v[2][1]);
+
+    // writes are visible through the parent
+    v[1][0] = -1.0;
+    EXPECT_EQ(-1.0, m[2][2]);
+}
+
+TEST(MatrixViewTest, addRowsSkipsFold)
+{
+    Matrix m;
+    fillMatrix(m, 6, 2);
+
+    MatrixView v (m, 0, 0, 2, 2);
+    v.addRows(m, 4, 2);
+    ASSERT_EQ(4u, v.rows());
+    EXPECT_EQ(0.0, v[0][0]);
+    EXPECT_EQ(10.0, v[1][0]);
+    EXPECT_EQ(40.0, v[2][0]);
+    EXPECT_EQ(51.0, v[3][1]);
+
+    // a view of a view refers back to the same elements
+    MatrixView w (v, 1, 1, 2, 1);
+    EXPECT_EQ(11.0, w[0][0]);
+    EXPECT_EQ(41.0, w[1][0]);
+}
+
+TEST(MatrixViewTest, shuffleLeavesParentAlone)
+{
+    Matrix m;
+    fillMatrix(m, 20, 3);
+    MatrixView features (m, 0, 0, 20, 2);
+    MatrixView labels (m, 0, 2, 20, 1);
+
+    Rand r (0);
+    features.shuffleRows(r, &labels);
+
+    for (size_t i = 0; i < 20; ++i)
+    {
+        EXPECT_EQ(i * 10.0, m[i][0]);
+        EXPECT_EQ(features[i][0] + 2.0, labels[i][0]);
+    }
+}
+
+TEST(MatrixViewTest, copyRowDetaches)
+{
+    Matrix m;
+    fillMatrix(m, 3, 2);
+    MatrixView v (m, 1, 0, 2, 2);
+
+    std::vector<double> row (2, 7.0);
+    v.copyRow(row);
+    ASSERT_EQ(3u, v.rows());
+    EXPECT_EQ(10.0, v[0][0]);
+    EXPECT_EQ(7.0, v[2][1]);
+
+    v[0][0] = 99.0;
+    EXPECT_EQ(10.0, m[1][0]);
+}
+
+TEST(MatrixViewTest, gathersRowsWithoutColumn)
+{
+    Matrix m;
+    fillMatrix(m, 5, 4);
+    std::vector<size_t> rows;
+    rows.push_back(3);
+    rows.push_back(0);
+    rows.push_back(4);
+
+    MatrixView v (m, rows, 1);
+    ASSERT_EQ(3u, v.rows());
+    ASSERT_EQ(3u, v.cols());
+    EXPECT_EQ(30.0, v[0][0]);
+    EXPECT_EQ(32.0, v[0][1]);
+    EXPECT_EQ(3.0, v[1][2]);
+    EXPECT_EQ(42.0, v.columnMax(1));
+
+    // dropping another column composes with the first
+    std::vector<size_t> some;
+    some.push_back(2);
+    MatrixView w (v, some, 0);
+    ASSERT_EQ(2u, w.cols());
+    EXPECT_EQ(42.0, w[0][0]);
+    EXPECT_EQ(43.0, w[0][1]);
+
+    std::vector<double> copy = w[0];
+    ASSERT_EQ(2u, copy.size());
+    EXPECT_EQ(43.0, copy[1]);
+}
+
+TEST(MatrixBinaryTest, roundTrip)
+{
+    Matrix m;
+    fillMatrix(m, 4, 3);
+    m[2][1] = UNKNOWN_VALUE;
+
+    // save a view, so the elements are gathered from the parent
+    std::vector<size_t> rows;
+    rows.push_back(3);
+    rows.push_back(2);
+    MatrixView v (m, rows, 0);
+    v.saveBinary("matrix_unittest.tmp.mlb");
+
+    Matrix loaded;
+    loaded.loadBinary("matrix_unittest.tmp.mlb");
+    remove("matrix_unittest.tmp.mlb");
+    ASSERT_EQ(2u, loaded.rows());
+    ASSERT_EQ(2u, loaded.cols());
+    EXPECT_EQ(31.0, loaded[0][0]);
+    EXPECT_EQ(UNKNOWN_VALUE, loaded[1][0]);
+    EXPECT_EQ(22.0, loaded[1][1]);
+
+    // the mapped elements can be changed and added to
+    loaded[0][1] = 5.0;
+    std::vector<double> row (2, 7.0);
+    loaded.copyRow(row);
+    ASSERT_EQ(3u, loaded.rows());
+    EXPECT_EQ(5.0, loaded[0][1]);
+    EXPECT_EQ(7.0, loaded[2][0]);
+}
+
+TEST(MatrixCompactTest, keepsTypedColumns)
+{
+    std::string filename = "matrix_unittest.tmp.arff";
+    {
+        std::ofstream out(filename.c_str());
+        out << "@attribute x real\n@attribute color {red,blue}\n@data\n1.5,blue\n?,red\n-2,?\n";
+    }
+    Matrix m;
+    m.loadARFF(filename, false, Matrix::COMPACT);
+    remove(filename.c_str());
+
+    ASSERT_TRUE(m.isCompact());
+    EXPECT_EQ(ColumnStorage::FLOAT64, m.columnType(0));
+    ASSERT_EQ(ColumnStorage::UINT8, m.columnType(1));
+    Matrix::Column<uint8_t> color = m.column<uint8_t>(1);
+    EXPECT_EQ(1, color[0]);
+    EXPECT_EQ(UNKNOWN_VALUE, ColumnStorage::toDouble(color[2]));
+    EXPECT_EQ(UNKNOWN_VALUE, m.get(1, 0));
+    EXPECT_EQ(0.5, m.columnMean(1));
+
+    // a view reads the same storage
+    MatrixView v(m, 1, 0, 2, 2);
+    std::vector<double> row;
+    v.getRow(1, row);
+    EXPECT_EQ(-2.0, row[0]);
+    EXPECT_EQ(UNKNOWN_VALUE, row[1]);
+    EXPECT_TRUE(v.isCompact());
+
+    // writing converts to dense form
+    m[0][0] = 7.0;
+    EXPECT_FALSE(m.isCompact());
+    EXPECT_EQ(UNKNOWN_VALUE, m[2][1]);
+    EXPECT_EQ(1.0, m[0][1]);
+}
+
+TEST(MatrixSpillTest, readsBlocksInOrder)
+{
+    Matrix m;
+    fillMatrix(m, 25, 3);
+    m[4][1] = UNKNOWN_VALUE;
+    m.spill(4); // 7 blocks, the last of one row
+    ASSERT_TRUE(m.isSpilled());
+    EXPECT_EQ(25u, m.rows());
+    EXPECT_EQ(122.0, m.get(12, 2));
+    std::vector<double> row;
+    m.getRow(24, row);
+    EXPECT_EQ(241.0, row[1]);
+    EXPECT_EQ(120.0, m.columnMean(0));
+    EXPECT_DOUBLE_EQ(2984.0 / 24, m.columnMean(1)); // (without the missing element)
+
+    // A shuffled view of some of the rows visits each of them once, a
+    // block at a time
+    MatrixView v(m, 2, 1, 20, 2);
+    Rand r(3);
+    v.shuffleRows(r);
+    EXPECT_TRUE(v.isSpilled());
+    std::vector<size_t> seen(20, 0);
+    size_t lastBlock = 0;
+    Matrix::BlockIterator it(v);
+    while (it.next())
+    {
+        it.shuffle(r);
+        for (size_t i = 0; i < it.size(); ++i)
+        {
+            size_t index = it.index(i);
+            seen[index]++;
+            size_t stored = (size_t)v.get(index, 1) / 10; // (the row it came from)
+            EXPECT_LE(lastBlock, stored / 4);
+            lastBlock = stored / 4;
+            EXPECT_EQ(v.get(index, 0), it.get(i, 0));
+            EXPECT_EQ(stored * 10.0 + 2.0, it.row(i)[1]);
+        }
+    }
+    EXPECT_EQ(std::vector<size_t>(20, 1), seen);
+
+    // Writing makes it dense again
+    m[0][0] = 5.0;
+    EXPECT_FALSE(m.isSpilled());
+    EXPECT_EQ(UNKNOWN_VALUE, m[4][1]);
+    EXPECT_EQ(242.0, m[24][2]);
+}
+
+TEST(MatrixSpillTest, visitsShuffledRowsABlockAtATime)
+{
+    // A matrix in memory is visited in the order that shuffleOrder gives
+    Matrix m;
+    fillMatrix(m, 25, 3);
+    Rand r1(5), r2(5);
+    std::vector<size_t> order;
+    std::vector<size_t> expected;
+    Matrix::identityOrder(25, expected);
+    for (size_t epoch = 0; epoch < 2; ++epoch)
+    {
+        std::vector<size_t> visited;
+        m.visitShuffled(r1, order, [&](size_t i) { visited.push_back(i); });
+        Matrix::shuffleOrder(r2, expected);
+        EXPECT_EQ(expected, visited);
+    }
+
+    // A spilled one visits each row once, without going back a block
+    m.spill(4);
+    std::vector<size_t> seen(25, 0);
+    size_t lastBlock = 0;
+    std::vector<double> row;
+    m.visitShuffled(r1, order, [&](size_t i)
+    {
+        seen[i]++;
+        EXPECT_LE(lastBlock, i / 4);
+        lastBlock = i / 4;
+        m.getRow(i, row);
+        EXPECT_EQ(i * 10.0 + 1.0, row[1]);
+    });
+    EXPECT_EQ(std::vector<size_t>(25, 1), seen);
+}
+
+TEST(MatrixSpillTest, loadsArffIntoFile)
+{
+    std::string filename = "matrix_unittest.tmp.arff";
+    {
+        std::ofstream out(filename.c_str());
+        out << "@attribute a real\n@attribute b {x,y}\n@data\n1,x\n2,y\n3,?\n4,x\n";
+    }
+    Matrix m;
+    m.loadARFF(filename, false, Matrix::SPILL);
+    remove(filename.c_str());
+
+    ASSERT_TRUE(m.isSpilled());
+    EXPECT_EQ(4u, m.rows());
+    EXPECT_EQ(1.0, m.get(1, 1));
+    EXPECT_EQ(UNKNOWN_VALUE, m.get(2, 1));
+    EXPECT_EQ(2.5, m.columnMean(0));
+    EXPECT_FALSE(m.hasMissing(0));
+}
+
+TEST(MatrixValidityTest, tracksMissingValues)
+{
+    std::string filename = "matrix_unittest.tmp.arff";
+    {
+        std::ofstream out(filename.c_str());
+        out << "@attribute a real\n@attribute b {x,y}\n@data\n1,x\n2,y\n3,?\n4,x\n";
+    }
+    Matrix m;
+    m.loadARFF(filename);
+    remove(filename.c_str());
+
+    EXPECT_FALSE(m.hasMissing(0));
+    const ValidityMask& b = m.validity(1);
+    EXPECT_EQ(1u, b.missing());
+    EXPECT_TRUE(b.has(1));
+    EXPECT_FALSE(b.has(2));
+    EXPECT_EQ(2.5, m.columnMean(0));
+
+    // a view of the last two rows
+    MatrixView v(m, 2, 0, 2, 2);
+    EXPECT_FALSE(v.hasMissing(0));
+    EXPECT_TRUE(v.hasMissing(1));
+    EXPECT_FALSE(v.validity(1).has(0));
+
+    // writing through the view is noticed by both
+    v[1][0] = UNKNOWN_VALUE;
+    EXPECT_TRUE(m.hasMissing(0));
+    EXPECT_TRUE(v.hasMissing(0));
+    EXPECT_EQ(2.0, m.columnMean(0));
+    m[3][0] = 4.0;
+    EXPECT_FALSE(v.hasMissing(0));
+}
+
+TEST(MatrixStatsTest, cachesUntilChanged)
+{
+    Matrix m;
+    fillMatrix(m, 4, 2);
+    m.attrValue(1, 0); // (makes column 1 nominal, with values 0 and 1)
+    m.attrValue(1, 1);
+    for (size_t r = 0; r < 4; ++r)
+        m[r][1] = r < 3 ? 1.0 : 0.0;
+
+    EXPECT_EQ(0.0, m.columnMin(0));
+    EXPECT_EQ(30.0, m.columnMax(0));
+    EXPECT_EQ(15.0, m.columnMean(0));
+    EXPECT_EQ(1.0, m.mostCommonValue(1));
+    EXPECT_EQ(3u, m.getValueCounts(1)[1.0]);
+
+    m[0][0] = 50.0;
+    m[1][1] = UNKNOWN_VALUE;
+    m[2][1] = 0.0;
+    EXPECT_EQ(10.0, m.columnMin(0));
+    EXPECT_EQ(50.0, m.columnMax(0));
+    EXPECT_EQ(0.0, m.mostCommonValue(1));
+    std::map<double, size_t> counts = m.getValueCounts(1);
+    EXPECT_EQ(1u, counts[UNKNOWN_VALUE]);
+    EXPECT_EQ(3u, counts.size());
+
+    // a view has its own statistics
+    MatrixView v(m, 2, 0, 2, 2);
+    EXPECT_EQ(25.0, v.columnMean(0));
+}
+
+TEST(MatrixStatsTest, countsIntoArrays)
+{
+    std::string filename = "matrix_unittest.tmp.arff";
+    {
+        std::ofstream out(filename.c_str());
+        out << "@attribute a {x,y,z}\n@attribute n real\n@attribute class {p,q}\n@data\n"
+            "x,1,p\ny,2,q\nx,3,q\n?,4,p\nx,5,?\n";
+    }
+    Matrix m;
+    m.loadARFF(filename);
+    remove(filename.c_str());
+
+    std::vector<size_t> counts;
+    ASSERT_TRUE(m.countValues(0, counts));
+    ASSERT_EQ(4u, counts.size());
+    EXPECT_EQ(3u, counts[0]);
+    EXPECT_EQ(1u, counts[1]);
+    EXPECT_EQ(0u, counts[2]);
+    EXPECT_EQ(1u, counts[3]);
+    EXPECT_FALSE(m.countValues(1, counts)); // (continuous)
+
+    MatrixView features(m, 0, 0, m.rows(), 2);
+    MatrixView labels(m, 0, 2, m.rows(), 1);
+    std::vector<size_t> table;
+    ASSERT_TRUE(features.countValues(0, labels, 0, table));
+    ASSERT_EQ(12u, table.size());
+    EXPECT_EQ(1u, table[0 * 3 + 0]); // x, p
+    EXPECT_EQ(1u, table[0 * 3 + 1]); // x, q
+    EXPECT_EQ(1u, table[0 * 3 + 2]); // x, ?
+    EXPECT_EQ(1u, table[1 * 3 + 1]); // y, q
+    EXPECT_EQ(1u, table[3 * 3 + 0]); // ?, p
+    EXPECT_FALSE(features.countValues(1, labels, 0, table));
+}
+
+TEST(MatrixShuffleTest, permutesOrderOnly)
+{
+    Matrix m;
+    fillMatrix(m, 20, 3);
+    Matrix labels;
+    fillMatrix(labels, 20, 1);
+    const double* pFirst = &m[0][0];
+    const double* pLast = &m[19][0];
+
+    // shuffleOrder draws the same numbers as shuffleRows
+    Rand r1(7), r2(7);
+    std::vector<size_t> order;
+    Matrix::identityOrder(20, order);
+    Matrix::shuffleOrder(r1, order);
+    m.shuffleRows(r2, &labels);
+    for (size_t i = 0; i < 20; ++i)
+    {
+        EXPECT_EQ(order[i] * 10.0, m[i][0]);
+        EXPECT_EQ(m[i][0], labels[i][0]); // (the buddy stays in step)
+    }
+
+    // The elements did not move
+    EXPECT_EQ(pFirst, &m[std::find(order.begin(), order.end(), 0) - order.begin()][0]);
+    EXPECT_EQ(pLast, &m[std::find(order.begin(), order.end(), 19) - order.begin()][0]);
+}
+
+TEST(MatrixSchemaTest, sharedUntilChanged)
+{
+    std::string filename = "schema_test.arff";
+    {
+        std::ofstream out(filename.c_str());
+        out << "@attribute a {x,y}\n@attribute n real\n@attribute class {p,q}\n@data\n"
+            "x,1,p\ny,?,q\n";
+    }
+    Matrix m;
+    m.loadARFF(filename);
+    remove(filename.c_str());
+
+    // Copies and views refer to the same strings
+    Matrix copy(m);
+    EXPECT_EQ(&m.attrValue(0, 1), &copy.attrValue(0, 1));
+    MatrixView reduced(m, std::vector<size_t>(1, 0), 1);
+    ASSERT_EQ(2u, reduced.cols());
+    EXPECT_EQ("class", reduced.attrName(1));
+    EXPECT_EQ(&m.attrValue(2, 0), &reduced.attrValue(1, 0));
+
+    // Changing the meta-data of one leaves the others alone
+    copy.makeContinuousAttrsNominal(3);
+    EXPECT_EQ(3u, copy.valueCount(1));
+    EXPECT_EQ(0u, m.valueCount(1));
+    EXPECT_EQ(&m.attrValue(0, 1), &copy.attrValue(0, 1)); // (unchanged columns are still shared)
+    EXPECT_EQ("", m.attrValue(0, 7));
+    EXPECT_EQ(2u, m.valueCount(0));
+
+    // Moving takes everything, leaving an empty matrix
+    const std::string* pName = &m.attrName(2);
+    Matrix moved(std::move(m));
+    EXPECT_EQ(2u, moved.rows());
+    EXPECT_EQ(pName, &moved.attrName(2));
+    EXPECT_EQ(1.0, moved[1][0]);
+    EXPECT_EQ(0u, m.rows());
+    EXPECT_EQ(0u, m.cols());
+    m = std::move(moved);
+    EXPECT_EQ(2u, m.rows());
+    EXPECT_EQ("q", m.attrValue(2, 1));
+}
+
+TEST(MatrixAssignTest, copiesElementsButSharesMetaData)
+{
+    Matrix m;
+    fillMatrix(m, 4, 3);
+
+    // Assignment copies the elements, even of a view
+    Matrix a;
+    a = m;
+    a[1][2] = -1.0;
+    EXPECT_EQ(12.0, m[1][2]);
+    MatrixView v(m, 1, 1, 2, 2);
+    a = v;
+    ASSERT_EQ(2u, a.rows());
+    a[0][0] = -2.0;
+    EXPECT_EQ(11.0, m[1][1]);
+    EXPECT_EQ(&m.attrName(1), &a.attrName(0)); // (but not the meta-data)
+
+    // share makes the other matrix refer to the same elements
+    Matrix s;
+    s.share(m);
+    s[3][0] = -3.0;
+    EXPECT_EQ(-3.0, m[3][0]);
+}
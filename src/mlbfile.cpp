@@ -0,0 +1,235 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "mlbfile.h"
+#include "matrix.h"
+#include "error.h"
+#include <cstring>
+#include <fstream>
+#ifndef WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif // !WIN32
+
+using std::string;
+using std::vector;
+
+typedef unsigned long long int uint64;
+
+#define MLB_MAGIC "MLBFILE1"
+#define MLB_BYTE_ORDER 0x0102030405060708ULL
+#define MLB_ALIGNMENT 64
+
+MappedFile::MappedFile(const string& filename)
+: m_pData(NULL), m_size(0)
+{
+#ifdef WIN32
+	// No mmap here, so just read the whole file
+	std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+	if(!in)
+		ThrowError("failed to open the file: ", filename);
+	m_size = (size_t)in.tellg();
+	m_pData = new char[m_size > 0 ? m_size : 1];
+	in.seekg(0);
+	in.read(m_pData, m_size);
+	if(!in)
+	{
+		delete[] m_pData;
+		ThrowError("failed to read the file: ", filename);
+	}
+#else // WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		ThrowError("failed to open the file: ", filename);
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		close(fd);
+		ThrowError("failed to read the size of the file: ", filename);
+	}
+	m_size = (size_t)st.st_size;
+	if(m_size > 0)
+	{
+		void* p = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED)
+		{
+			close(fd);
+			ThrowError("failed to map the file: ", filename);
+		}
+		m_pData = (char*)p;
+	}
+	close(fd); // (the mapping stays valid)
+#endif // else WIN32
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef WIN32
+	delete[] m_pData;
+#else // WIN32
+	if(m_pData)
+		munmap(m_pData, m_size);
+#endif // else WIN32
+}
+
+
+namespace
+{
+	void writeUint(std::ostream& out, uint64 n)
+	{
+		out.write((const char*)&n, sizeof(uint64));
+	}
+
+	void writeString(std::ostream& out, const string& s)
+	{
+		writeUint(out, s.size());
+		out.write(s.data(), s.size());
+	}
+
+	// Reads the header of a mapped file, checking that it stays within bounds
+	class HeaderReader
+	{
+	private:
+		const char* m_pPos;
+		const char* m_pEnd;
+		const string& m_filename;
+
+	public:
+		HeaderReader(const char* pBegin, const char* pEnd, const string& filename)
+		: m_pPos(pBegin), m_pEnd(pEnd), m_filename(filename) {}
+
+		void need(uint64 bytes)
+		{
+			if(bytes > (uint64)(m_pEnd - m_pPos))
+				ThrowError("The binary dataset file is truncated: ", m_filename);
+		}
+
+		uint64 readUint()
+		{
+			need(sizeof(uint64));
+			uint64 n;
+			memcpy(&n, m_pPos, sizeof(uint64));
+			m_pPos += sizeof(uint64);
+			return n;
+		}
+
+		string readString()
+		{
+			uint64 len = readUint();
+			need(len);
+			string s(m_pPos, (size_t)len);
+			m_pPos += len;
+			return s;
+		}
+	};
+}
+
+void MlbFile::save(Matrix& m, const string& filename)
+{
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	if(!out)
+		ThrowError("failed to create the file: ", filename);
+	write(m, out);
+	if(!out.flush())
+		ThrowError("failed to write the file: ", filename);
+}
+
+void MlbFile::write(Matrix& m, std::ostream& out)
+{
+	size_t rows = m.rows();
+	size_t cols = m.cols();
+	std::streampos start = out.tellp();
+
+	// Header
+	out.write(MLB_MAGIC, 8);
+	writeUint(out, MLB_BYTE_ORDER);
+	writeUint(out, rows);
+	writeUint(out, cols);
+	std::streampos offsetPos = out.tellp();
+	writeUint(out, 0); // the data offset, filled in below
+	writeString(out, m.m_filename);
+	for(size_t i = 0; i < cols; i++)
+	{
+		const Matrix::Attribute& attr = m.attribute(i);
+		writeString(out, attr.name);
+		const vector<string>& values = attr.enumToStr;
+		writeUint(out, values.size());
+		for(size_t j = 0; j < values.size(); j++)
+		{
+			writeUint(out, j);
+			writeString(out, values[j]);
+		}
+	}
+
+	// Pad to the data offset
+	uint64 offset = (uint64)(out.tellp() - start);
+	offset = (offset + MLB_ALIGNMENT - 1) / MLB_ALIGNMENT * MLB_ALIGNMENT;
+	while((uint64)(out.tellp() - start) < offset)
+		out.put(0);
+	out.seekp(offsetPos);
+	writeUint(out, offset);
+	out.seekp(start + (std::streamoff)offset);
+
+	// Elements. (A sparse or compact matrix is written in dense form.)
+	vector<double> row;
+	for(size_t i = 0; i < rows; i++)
+	{
+		m.getRow(i, row);
+		out.write((const char*)row.data(), cols * sizeof(double));
+	}
+}
+
+void MlbFile::load(Matrix& m, const string& filename)
+{
+	boost::shared_ptr<MappedFile> pFile(new MappedFile(filename));
+	load(m, pFile, 0, filename);
+}
+
+void MlbFile::load(Matrix& m, boost::shared_ptr<MappedFile> pFile, size_t begin, const string& filename)
+{
+	if(begin > pFile->size() || pFile->size() - begin < 8 || memcmp(pFile->data() + begin, MLB_MAGIC, 8) != 0)
+		ThrowError("Not a binary dataset file: ", filename);
+	const char* pImage = pFile->data() + begin;
+	size_t size = pFile->size() - begin;
+	HeaderReader header(pImage + 8, pImage + size, filename);
+	if(header.readUint() != MLB_BYTE_ORDER)
+		ThrowError("The binary dataset file was written on a machine with a different byte order: ", filename);
+	uint64 rows = header.readUint();
+	uint64 cols = header.readUint();
+	uint64 offset = header.readUint();
+	if(cols > size / 16)
+		ThrowError("The binary dataset file is truncated: ", filename); // (each column takes at least 16 bytes of header)
+
+	// Meta-data
+	m.setSize(0, cols);
+	m.m_filename = header.readString();
+	for(size_t i = 0; i < cols; i++)
+	{
+		Matrix::Attribute& attr = m.ownAttribute(i);
+		attr.name = header.readString();
+		uint64 values = header.readUint();
+		for(uint64 j = 0; j < values; j++)
+		{
+			size_t e = header.readUint();
+			string val = header.readString();
+			if(e >= values)
+				ThrowError("The binary dataset file is corrupt: ", filename);
+			if(e >= attr.enumToStr.size())
+				attr.enumToStr.resize(e + 1);
+			attr.enumToStr[e] = val;
+			attr.strToEnum.set(val, e);
+		}
+	}
+
+	// Refer to the elements where they are in the file
+	if(offset % MLB_ALIGNMENT != 0 || offset > size || (size - offset) / sizeof(double) / (cols > 0 ? cols : 1) < rows)
+		ThrowError("The binary dataset file is truncated: ", filename);
+	double* pElements = (double*)(pFile->data() + begin + offset);
+	m.m_pData.reset(new MatrixStorage(pElements, rows * cols, pFile));
+	m.m_rows = rows;
+	m.m_stride = cols;
+}
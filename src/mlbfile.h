@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef MLBFILE_H
+#define MLBFILE_H
+
+#include <string>
+#include <cstddef>
+#include <ostream>
+#include <boost/shared_ptr.hpp>
+
+class Matrix;
+
+// A whole file mapped into memory. The pages are private copy-on-write,
+// so the memory can be changed without changing the file.
+class MappedFile
+{
+private:
+	char* m_pData;
+	size_t m_size;
+
+public:
+	// Maps the specified file
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	// Returns a pointer to the first byte of the file
+	char* data() { return m_pData; }
+
+	// Returns the size of the file in bytes
+	size_t size() { return m_size; }
+
+private:
+	// Not copyable
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+
+// Reads and writes binary dataset (.mlb) files, which hold a Matrix and
+// its meta-data in a form that can be used without parsing. The layout is:
+//
+//   "MLBFILE1"      magic number (8 bytes)
+//   byte order      the uint64 0x0102030405060708, as written
+//   rows, cols      uint64 each
+//   data offset     uint64, a multiple of 64
+//   relation name   a string
+//   for each column:
+//     name          a string
+//     value count   uint64 (0 for continuous columns)
+//     values        an enumeration (uint64) and a string, for each value
+//   elements        rows * cols doubles in row-major order, at data offset
+//
+// Integers and doubles are in the byte order of the machine that wrote the
+// file. A string is a uint64 length followed by that many bytes.
+class MlbFile
+{
+public:
+	// Writes the matrix to the specified file
+	static void save(Matrix& m, const std::string& filename);
+
+	// Writes the matrix to a stream. (Offsets are relative to where the
+	// stream is now, which should be a multiple of 64 bytes into the file.)
+	static void write(Matrix& m, std::ostream& out);
+
+	// Maps the specified file, and makes the matrix refer to its elements
+	static void load(Matrix& m, const std::string& filename);
+
+	// Makes the matrix refer to the elements of the .mlb image that starts
+	// begin bytes into a mapped file. (filename is only used in errors.)
+	static void load(Matrix& m, boost::shared_ptr<MappedFile> pFile, size_t begin, const std::string& filename);
+};
+
+#endif // MLBFILE_H
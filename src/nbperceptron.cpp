@@ -9,15 +9,13 @@ void NBPerceptron::train(Matrix& features, Matrix& labels)
 //    features.toCSV();
 
     Matrix classLabels ( labels );
-    Matrix classFeatures ( features );
     for (size_t i = 0; i < valueCount; ++i)
     {
         // create a perceptron for each output value
         this->perceptrons.push_back(Perceptron( this->m_rand, this->maxEpochs, this->learningRate, false ));
 
-        // copy the features matrix for each perceptron (because of shuffling rows)
-        classFeatures.setSize(0, 0);
-        classFeatures.copyPart(features, 0, 0, features.rows(), features.cols());
+        // give each perceptron its own view of the features (because of shuffling rows)
+        MatrixView classFeatures(features, 0, 0, features.rows(), features.cols());
 
         // copy the labels matrix for each output value
         // also, alter the matrix so only outputs corresponding to the i-th perceptron are 1 (all others are 0)
@@ -38,7 +36,7 @@ void NBPerceptron::train(Matrix& features, Matrix& labels)
 }
 
 
-void NBPerceptron::predict(const std::vector<double>& features, std::vector<double>& labels)
+void NBPerceptron::predict(const std::vector<double>& features, std::vector<double>& labels) const
 {
     size_t valueCount = this->perceptrons.size();
     std::vector<double> preds;
@@ -57,7 +55,7 @@ void NBPerceptron::predict(const std::vector<double>& features, std::vector<doub
 }
 
 
-void NBPerceptron::hardMax(const std::vector<double>& predictions, std::vector<double>& labels)
+void NBPerceptron::hardMax(const std::vector<double>& predictions, std::vector<double>& labels) const
 {
     size_t predCount = predictions.size();
     size_t maxLabel;
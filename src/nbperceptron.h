@@ -18,7 +18,7 @@ private:
     std::vector<Perceptron> perceptrons;
         
     static const int MAX_EPOCHS = 300;
-    static const double LEARNING_RATE = 0.1;
+    static constexpr double LEARNING_RATE = 0.1;
 
 public:
     NBPerceptron(Rand& r, int maxEpochs = MAX_EPOCHS, double learningRate = LEARNING_RATE)
@@ -33,11 +33,14 @@ public:
 	// Train the model to predict the labels
 	void train(Matrix& features, Matrix& labels);
 
+	// Returns an untrained learner with the same settings
+	SupervisedLearner* clone(Rand& r) { return new NBPerceptron(r, maxEpochs, learningRate); }
+
 	// Evaluate the features and predict the labels
-	void predict(const std::vector<double>& features, std::vector<double>& labels);
+	void predict(const std::vector<double>& features, std::vector<double>& labels) const;
     
     // Use a hard max function to pick the predicted label
-    void hardMax(const std::vector<double>& predictions, std::vector<double>& labels);
+    void hardMax(const std::vector<double>& predictions, std::vector<double>& labels) const;
 
     // Normalize the continuous values in the features matrix between min and max
     void normalizeFeatures(Matrix& features, const double min, const double max);
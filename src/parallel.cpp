@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "parallel.h"
+
+namespace
+{
+	std::atomic<size_t> g_workerCount(0);
+
+	// Whether the current thread is making calls for parallelFor
+	thread_local bool t_inParallelFor = false;
+
+	// What the current thread prints, if it is captured (see OutputCapture)
+	thread_local std::string* t_pOutput = NULL;
+}
+
+size_t workerCount()
+{
+	size_t count = g_workerCount;
+	if(count == 0)
+	{
+		count = std::thread::hardware_concurrency();
+		if(count == 0)
+			count = 1; // unknown
+	}
+	return count;
+}
+
+void setWorkerCount(size_t count)
+{
+	g_workerCount = count;
+}
+
+bool inParallelFor()
+{
+	return t_inParallelFor;
+}
+
+ParallelForScope::ParallelForScope()
+: m_outer(t_inParallelFor)
+{
+	t_inParallelFor = true;
+}
+
+ParallelForScope::~ParallelForScope()
+{
+	t_inParallelFor = m_outer;
+}
+
+OutputCapture::OutputCapture(std::ostream& stream)
+: m_stream(stream), m_pOriginal(stream.rdbuf())
+{
+	m_stream.rdbuf(this);
+}
+
+// virtual
+OutputCapture::~OutputCapture()
+{
+	m_stream.rdbuf(m_pOriginal);
+}
+
+// static
+void OutputCapture::captureTo(std::string* pOutput)
+{
+	t_pOutput = pOutput;
+}
+
+// virtual
+std::streamsize OutputCapture::xsputn(const char* s, std::streamsize n)
+{
+	if(t_pOutput)
+	{
+		t_pOutput->append(s, (size_t)n);
+		return n;
+	}
+	return m_pOriginal->sputn(s, n);
+}
+
+// virtual
+OutputCapture::int_type OutputCapture::overflow(int_type c)
+{
+	if(traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+	char ch = traits_type::to_char_type(c);
+	return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+// virtual
+int OutputCapture::sync()
+{
+	return t_pOutput ? 0 : m_pOriginal->pubsync();
+}
@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Returns the number of threads that parallel work should use. (This is
+// one per core unless setWorkerCount has been called.)
+size_t workerCount();
+
+// Sets the number of threads that parallel work should use. 0 means one per core.
+void setWorkerCount(size_t count);
+
+// Returns true if the calling thread is making calls for parallelFor
+bool inParallelFor();
+
+// While it exists, this marks the calling thread as making calls for parallelFor
+class ParallelForScope
+{
+private:
+	bool m_outer; // what inParallelFor returned before
+
+public:
+	ParallelForScope();
+	~ParallelForScope();
+};
+
+// Calls f(i) for every i from 0 to n - 1, spreading the calls over up to
+// workerCount() threads (including the calling one). The calls may happen
+// in any order. If any call throws, the first exception (by thread) is
+// rethrown here after all the threads have finished. A parallelFor inside
+// one of the calls of another makes its calls on the thread that runs it,
+// so nested work does not multiply the threads (and what it prints goes
+// wherever that thread's output goes; see OutputCapture).
+template<typename F>
+void parallelFor(size_t n, F f)
+{
+	size_t threads = inParallelFor() ? 1 : std::min(n, workerCount());
+	if(threads <= 1)
+	{
+		ParallelForScope scope;
+		for(size_t i = 0; i < n; i++)
+			f(i);
+		return;
+	}
+	std::atomic<size_t> next(0);
+	std::vector<std::exception_ptr> errors(threads);
+	auto work = [&](size_t t)
+	{
+		ParallelForScope scope;
+		try
+		{
+			for(size_t i = next++; i < n; i = next++)
+				f(i);
+		}
+		catch(...)
+		{
+			errors[t] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> pool;
+	for(size_t t = 1; t < threads; t++)
+		pool.push_back(std::thread(work, t));
+	work(0);
+	for(size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+	for(size_t t = 0; t < threads; t++)
+	{
+		if(errors[t])
+			std::rethrow_exception(errors[t]);
+	}
+}
+
+// While it exists, this collects what each thread that has called captureTo
+// prints to a stream, so that the output of work that runs at the same time
+// is not mixed together. Other threads print as usual.
+class OutputCapture : public std::streambuf
+{
+private:
+	std::ostream& m_stream;
+	std::streambuf* m_pOriginal;
+
+public:
+	OutputCapture(std::ostream& stream);
+	virtual ~OutputCapture();
+
+	// Sets the string that collects what the calling thread prints while an
+	// OutputCapture exists. NULL means the thread prints as usual.
+	static void captureTo(std::string* pOutput);
+
+protected:
+	virtual std::streamsize xsputn(const char* s, std::streamsize n);
+	virtual int_type overflow(int_type c);
+	virtual int sync();
+};
+
+#endif // PARALLEL_H
@@ -8,9 +8,6 @@ void Perceptron::train(Matrix& features, Matrix& labels)
     if(features.rows() != labels.rows())
         ThrowError("Expected the features and labels to have the same number of rows");
 
-    // save the number of inputs
-    int nInputs = (int)features.rows();
-    
     // save the number of attributes
     int nAttrs = (int)features.cols();
 
@@ -23,27 +20,36 @@ void Perceptron::train(Matrix& features, Matrix& labels)
     int wrongs = 0;
     double maxAcc = -1.0;
     std::vector<double> maxWeights;
+    std::vector<double> feature;
     int sinceMax = 0;
+    std::vector<size_t> order; // the order in which the inputs were visited
 
     // loop through the inputs until analysis end
     do
     {
         wrongs = 0;
 
-        // Shuffle the rows
-        features.shuffleRows(m_rand, &labels);
-
-        // for every input vector:
+        // for every input vector, in a new order each epoch:
         //  compute activation function and,
         //  adjust weights
-        for (int featureIndex = 0; featureIndex < nInputs; ++featureIndex)
+        features.visitShuffled(m_rand, order, [&](size_t featureIndex)
         {
-            std::vector<double> feature = features.row(featureIndex);
+            double target = labels.get(featureIndex, 0);
+            if (features.isSparse())
+            {
+                Matrix::SparseRow row = features.sparseRow(featureIndex);
+                double output = this->activation(row, this->biasAttr, this->weights);
+                if (target - output != 0.0)
+                    ++wrongs;
+                this->perceptronRule(row, this->biasAttr, this->weights, target, output);
+                return;
+            }
+
+            features.getRow(featureIndex, feature);
             if ((int)feature.size() != nAttrs)
                 ThrowError("Expected the feature to have the same number of attributes");
 
             // compute activation
-            double target = labels.row(featureIndex)[0];
             double output = this->activation(feature, this->biasAttr, this->weights);
 //            std::cout << "targ " << target << " out " << output << " diff " << target - output << std::endl;
             if (target - output != 0.0) // if one of the inputs is incorrect
@@ -52,7 +58,7 @@ void Perceptron::train(Matrix& features, Matrix& labels)
             }
 
             this->perceptronRule(feature, this->biasAttr, this->weights, target, output);
-        }
+        });
 
         double accuracy = this->measureAccuracy(features, labels);
 //        std::cout << "acc vs maxAcc " << accuracy << " " << maxAcc << std::endl;
@@ -84,13 +90,19 @@ void Perceptron::train(Matrix& features, Matrix& labels)
 }
 
 
-void Perceptron::predict(const std::vector<double>& features, std::vector<double>& labels)
+void Perceptron::predict(const std::vector<double>& features, std::vector<double>& labels) const
+{
+    labels[0] = this->activation(features, this->biasAttr, this->weights, true);
+}
+
+
+void Perceptron::predictSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const
 {
     labels[0] = this->activation(features, this->biasAttr, this->weights, true);
 }
 
 
-double Perceptron::activation(const std::vector<double>& feature, const double biasAttr, std::vector<double>& weights, const bool threshold)
+double Perceptron::activation(const std::vector<double>& feature, const double biasAttr, const std::vector<double>& weights, const bool threshold) const
 {
     double activation = 0.0;
     int featureSize = feature.size();
@@ -112,6 +124,24 @@ double Perceptron::activation(const std::vector<double>& feature, const double b
 }
 
 
+double Perceptron::activation(const Matrix::SparseRow& feature, const double biasAttr, const std::vector<double>& weights, const bool threshold) const
+{
+    double activation = 0.0;
+    int featureSize = feature.width();
+
+    // sum weights (the zero elements add nothing)
+    for (size_t i = 0; i < feature.size(); ++i)
+        activation += feature.value(i) * weights[feature.col(i)];
+    // add bias to activation function
+    activation += biasAttr * weights[featureSize];
+
+    // threshold activation function
+    if (threshold)
+        return activation > 0.0 ? 1.0 : 0.0;
+    return activation;
+}
+
+
 void Perceptron::perceptronRule(const std::vector<double>& input, const double biasAttr, std::vector<double>& weights, const double target, const double output)
 {
     double t_output = output > 0.0 ? 1.0 : 0.0;
@@ -131,3 +161,16 @@ void Perceptron::perceptronRule(const std::vector<double>& input, const double b
     weights[inputSize] += diff * biasAttr;
 }
 
+
+void Perceptron::perceptronRule(const Matrix::SparseRow& input, const double biasAttr, std::vector<double>& weights, const double target, const double output)
+{
+    double t_output = output > 0.0 ? 1.0 : 0.0;
+    // compute part of perceptron rule
+    double diff = this->learningRate * (target - t_output);
+
+    // adjust the weights of the nonzero elements
+    for (size_t i = 0; i < input.size(); ++i)
+        weights[input.col(i)] += diff * input.value(i);
+    // do the same for bias weight
+    weights[input.width()] += diff * biasAttr;
+}
@@ -23,7 +23,7 @@ private:
     double biasAttr;
 
     static const int MAX_EPOCHS = 50;
-    static const double LEARNING_RATE = 0.5;
+    static constexpr double LEARNING_RATE = 0.5;
 
 public:
     Perceptron()
@@ -61,15 +61,28 @@ public:
 	// Train the model to predict the labels
 	void train(Matrix& features, Matrix& labels);
 
+	// Returns an untrained perceptron with the same settings
+	SupervisedLearner* clone(Rand& r) { return new Perceptron(r, maxEpochs, learningRate, thresholdPrediction); }
+
 	// Evaluate the features and predict the labels
-	void predict(const std::vector<double>& features, std::vector<double>& labels);
+	void predict(const std::vector<double>& features, std::vector<double>& labels) const;
+
+	// Evaluate a sparse row of features and predict the labels
+	void predictSparse(const Matrix::SparseRow& features, std::vector<double>& labels) const;
     
     // Activation function
-    double activation(const std::vector<double>& feature, const double biasAttr, std::vector<double>& weights, const bool threshold = true);
+    double activation(const std::vector<double>& feature, const double biasAttr, const std::vector<double>& weights, const bool threshold = true) const;
+
+    // Activation function for a sparse row (only its nonzero elements are visited)
+    double activation(const Matrix::SparseRow& feature, const double biasAttr, const std::vector<double>& weights, const bool threshold = true) const;
 
     // Adjust the given weights and bias weight according to the perceptron rule
     void perceptronRule(const std::vector<double>& input, const double biasAttr, std::vector<double>& weights, const double target, const double output);
 
+    // Adjust the given weights and bias weight according to the perceptron rule, for a sparse row
+    // (weights of the zero elements would not change, so only the nonzero elements are visited)
+    void perceptronRule(const Matrix::SparseRow& input, const double biasAttr, std::vector<double>& weights, const double target, const double output);
+
 };
 
 #endif // PERCEPTRON_H
@@ -0,0 +1,216 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "search.h"
+#include "error.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <math.h>
+
+using std::vector;
+using std::string;
+
+// The fewest rows that a round of a search trains on (unless there are fewer)
+#define MIN_SEARCH_ROWS 20
+
+namespace
+{
+	// Returns s without the spaces at either end
+	string trim(const string& s)
+	{
+		size_t begin = s.find_first_not_of(" \t");
+		if(begin == string::npos)
+			return "";
+		size_t end = s.find_last_not_of(" \t");
+		return s.substr(begin, end + 1 - begin);
+	}
+
+	// Splits s at every separator
+	vector<string> split(const string& s, char separator)
+	{
+		vector<string> parts;
+		size_t begin = 0;
+		while(true)
+		{
+			size_t end = s.find(separator, begin);
+			if(end == string::npos)
+			{
+				parts.push_back(s.substr(begin));
+				return parts;
+			}
+			parts.push_back(s.substr(begin, end - begin));
+			begin = end + 1;
+		}
+	}
+
+	// Returns true if a scored better than b (so a lower RMSE is better, if the label is continuous)
+	bool scoredBetter(double a, double b, bool continuous)
+	{
+		return continuous ? a < b : a > b;
+	}
+}
+
+double paramValue(const ParamSetting& setting, const string& name, double defaultValue)
+{
+	for(size_t i = 0; i < setting.size(); i++)
+	{
+		if(setting[i].first == name)
+			return setting[i].second;
+	}
+	return defaultValue;
+}
+
+string describeSetting(const ParamSetting& setting)
+{
+	std::ostringstream os;
+	for(size_t i = 0; i < setting.size(); i++)
+	{
+		if(i > 0)
+			os << " ";
+		os << setting[i].first << "=" << setting[i].second;
+	}
+	return os.str();
+}
+
+ParamGrid::ParamGrid(const string& spec)
+{
+	vector<string> params = split(spec, ';');
+	for(size_t i = 0; i < params.size(); i++)
+	{
+		if(trim(params[i]) == "" && params.size() > 1)
+			continue; // as after a trailing ';'
+		size_t equals = params[i].find('=');
+		if(equals == string::npos)
+			ThrowError("Expected a parameter in the grid to look like \"name=value,value\", not \"", params[i], "\"");
+		string name = trim(params[i].substr(0, equals));
+		if(name == "")
+			ThrowError("Expected a name for the values \"", params[i], "\" in the grid");
+		if(std::find(m_names.begin(), m_names.end(), name) != m_names.end())
+			ThrowError("The parameter ", name, " is in the grid more than once");
+		vector<string> values = split(params[i].substr(equals + 1), ',');
+		vector<double> parsed;
+		for(size_t j = 0; j < values.size(); j++)
+		{
+			string value = trim(values[j]);
+			char* pEnd;
+			double d = strtod(value.c_str(), &pEnd);
+			if(value == "" || *pEnd != '\0')
+				ThrowError("Invalid value for ", name, " in the grid: \"", value, "\"");
+			parsed.push_back(d);
+		}
+		m_names.push_back(name);
+		m_values.push_back(parsed);
+	}
+	if(m_names.size() == 0)
+		ThrowError("Expected the grid to have at least one parameter");
+}
+
+size_t ParamGrid::size() const
+{
+	size_t n = 1;
+	for(size_t i = 0; i < m_values.size(); i++)
+		n *= m_values[i].size();
+	return n;
+}
+
+ParamSetting ParamGrid::setting(size_t index) const
+{
+	if(index >= size())
+		ThrowError("Setting ", to_str(index), " is out of range");
+	ParamSetting setting(m_names.size());
+	for(size_t i = m_names.size(); i-- > 0; )
+	{
+		const vector<double>& values = m_values[i];
+		setting[i] = std::make_pair(m_names[i], values[index % values.size()]);
+		index /= values.size();
+	}
+	return setting;
+}
+
+vector<SearchResult> successiveHalving(const ParamGrid& grid, const LearnerFactory& makeLearner, Matrix& features, Matrix& labels, Rand& r, double validationPortion)
+{
+	if(features.rows() != labels.rows())
+		ThrowError("Expected the features and labels to have the same number of rows");
+	size_t validationRows = (size_t)floor(features.rows() * validationPortion + 0.5);
+	if(validationRows == 0 || validationRows >= features.rows())
+		ThrowError("Expected enough rows for both a training set and a validation set");
+	size_t trainRows = features.rows() - validationRows;
+	bool continuous = labels.valueCount(0) == 0;
+	features.shuffleRows(r, &labels);
+
+	// Each setting has its own seed (and starts from it every round), so the
+	// results do not depend on the number of threads
+	size_t n = grid.size();
+	vector<SearchResult> results(n);
+	vector<uint64> seeds(n);
+	vector<size_t> remaining(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		results[i].setting = grid.setting(i);
+		results[i].rounds = 0;
+		results[i].trainingRows = 0;
+		results[i].score = 0.0;
+		seeds[i] = r.next();
+		remaining[i] = i;
+	}
+
+	// Halving n settings down to one takes ceil(log2(n)) rounds after the first
+	size_t rounds = 1;
+	while(((size_t)1 << (rounds - 1)) < n)
+		rounds++;
+	for(size_t round = 0; round < rounds; round++)
+	{
+		size_t rows = std::max(trainRows >> (rounds - 1 - round), std::min(trainRows, (size_t)MIN_SEARCH_ROWS));
+		{
+			OutputCapture output(std::cout);
+			parallelFor(remaining.size(), [&](size_t i)
+			{
+				SearchResult& result = results[remaining[i]];
+				string dropped;
+				OutputCapture::captureTo(&dropped);
+				try
+				{
+					MatrixView trainFeatures(features, 0, 0, rows, features.cols());
+					MatrixView trainLabels(labels, 0, 0, rows, labels.cols());
+					MatrixView validationFeatures(features, trainRows, 0, validationRows, features.cols());
+					MatrixView validationLabels(labels, trainRows, 0, validationRows, labels.cols());
+					Rand rand(seeds[remaining[i]]);
+					std::unique_ptr<SupervisedLearner> pLearner(makeLearner(result.setting, rand));
+					pLearner->train(trainFeatures, trainLabels);
+					result.score = pLearner->measureAccuracy(validationFeatures, validationLabels);
+					result.rounds = round + 1;
+					result.trainingRows = rows;
+				}
+				catch(...)
+				{
+					OutputCapture::captureTo(NULL);
+					throw;
+				}
+				OutputCapture::captureTo(NULL);
+			});
+		}
+
+		// Keep the better half (ties go to the setting that comes first in the grid)
+		std::sort(remaining.begin(), remaining.end(), [&](size_t a, size_t b)
+		{
+			if(results[a].score != results[b].score)
+				return scoredBetter(results[a].score, results[b].score, continuous);
+			return a < b;
+		});
+		remaining.resize((remaining.size() + 1) / 2);
+	}
+
+	std::stable_sort(results.begin(), results.end(), [&](const SearchResult& a, const SearchResult& b)
+	{
+		if(a.rounds != b.rounds)
+			return a.rounds > b.rounds;
+		return scoredBetter(a.score, b.score, continuous);
+	});
+	return results;
+}
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "learner.h"
+#include "rand.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One value for each parameter of a grid, in the order the grid names them
+typedef std::vector< std::pair<std::string, double> > ParamSetting;
+
+// Returns the value of the named parameter in a setting, or defaultValue if
+// the setting does not name it
+double paramValue(const ParamSetting& setting, const std::string& name, double defaultValue);
+
+// Returns a setting as "name=value name=value ..."
+std::string describeSetting(const ParamSetting& setting);
+
+// A grid of parameter values, parsed from a specification such as
+// "learningRate=0.1,0.3;hiddenNodes=8,16". The grid holds every combination
+// of the values (four settings in that example).
+class ParamGrid
+{
+private:
+	std::vector<std::string> m_names;
+	std::vector< std::vector<double> > m_values;
+
+public:
+	// Throws if the specification cannot be parsed, or names a parameter twice
+	ParamGrid(const std::string& spec);
+
+	// Returns the number of settings in the grid
+	size_t size() const;
+
+	// Returns one of the settings. (The values of the last parameter change
+	// fastest as the index grows.)
+	ParamSetting setting(size_t index) const;
+};
+
+// Makes an untrained learner with a setting of the parameters. (The learner
+// may keep a reference to the Rand.)
+typedef std::function<SupervisedLearner*(const ParamSetting&, Rand&)> LearnerFactory;
+
+// How one setting fared in a search
+struct SearchResult
+{
+	ParamSetting setting;
+	size_t rounds; // the number of rounds that it was trained in
+	size_t trainingRows; // the number of rows that it was trained on in its last round
+	double score; // the accuracy (or RMSE, for a continuous label) on the validation set in its last round
+};
+
+// Searches a grid of settings by successive halving. A portion of the rows
+// is held out to score the settings with. The first round trains every
+// setting on a small part of the other rows, and each later round trains
+// the better half of the last one on twice as many, until the last round
+// trains the best setting on all of them. The settings of a round are
+// trained in parallel, and what the learners print is dropped. Returns the
+// results ranked best first: by the number of rounds, then by score.
+std::vector<SearchResult> successiveHalving(const ParamGrid& grid, const LearnerFactory& makeLearner, Matrix& features, Matrix& labels, Rand& r, double validationPortion = 0.25);
+
+#endif // SEARCH_H
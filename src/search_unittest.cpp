@@ -0,0 +1,77 @@
+#include "search.h"
+#include "knn.h"
+#include "parallel.h"
+#include <iostream>
+#include <sstream>
+#include "tests/include/gtest/gtest.h"
+
+TEST(ParamGridTest, everyCombination)
+{
+    ParamGrid grid("learningRate=0.1, 0.3;hiddenNodes=8,16,32;");
+    ASSERT_EQ(6u, grid.size());
+    ParamSetting first = grid.setting(0);
+    ASSERT_EQ(2u, first.size());
+    EXPECT_EQ("learningRate", first[0].first);
+    EXPECT_EQ(0.1, first[0].second);
+    EXPECT_EQ(8.0, first[1].second);
+    EXPECT_EQ("learningRate=0.3 hiddenNodes=16", describeSetting(grid.setting(4)));
+    EXPECT_EQ(16.0, paramValue(grid.setting(4), "hiddenNodes", 0.0));
+    EXPECT_EQ(0.2, paramValue(grid.setting(4), "momentum", 0.2));
+
+    EXPECT_THROW(ParamGrid("k"), std::exception);
+    EXPECT_THROW(ParamGrid("k=1,x"), std::exception);
+    EXPECT_THROW(ParamGrid("k=1,"), std::exception);
+    EXPECT_THROW(ParamGrid("k=1;k=2"), std::exception);
+}
+
+// Searches k for KNN on y = x0 + x1 with the specified number of threads
+std::vector<SearchResult> searchK(size_t threads)
+{
+    Matrix features, labels;
+    features.setSize(200, 2);
+    labels.setSize(200, 1);
+    Rand data(3);
+    for (size_t i = 0; i < features.rows(); ++i)
+    {
+        features[i][0] = data.normal();
+        features[i][1] = data.normal();
+        labels[i][0] = features[i][0] + features[i][1];
+    }
+    ParamGrid grid("k=1,2,4,8,16,32,64");
+    LearnerFactory makeKNN = [](const ParamSetting& setting, Rand& r)
+    {
+        return new KNN(r, (size_t)paramValue(setting, "k", KNN::K));
+    };
+    setWorkerCount(threads);
+    Rand r(7);
+    std::vector<SearchResult> results = successiveHalving(grid, makeKNN, features, labels, r);
+    setWorkerCount(0);
+    return results;
+}
+
+TEST(SuccessiveHalvingTest, ranksSettings)
+{
+    std::vector<SearchResult> results = searchK(1);
+    ASSERT_EQ(7u, results.size());
+
+    // 7 settings take 4 rounds: 7, 4, 2 and then 1 of them, on 150 training rows at the end
+    EXPECT_EQ(4u, results[0].rounds);
+    EXPECT_EQ(150u, results[0].trainingRows);
+    EXPECT_EQ(3u, results[1].rounds);
+    EXPECT_EQ(2u, results[2].rounds);
+    EXPECT_EQ(2u, results[3].rounds);
+    EXPECT_EQ(1u, results[6].rounds);
+    EXPECT_LE(results[2].score, results[3].score); // (a lower RMSE is better)
+
+    // The smooth label favors more than one neighbor, but not too many
+    double bestK = paramValue(results[0].setting, "k", 0.0);
+    EXPECT_LT(1.0, bestK);
+    EXPECT_GT(64.0, bestK);
+
+    std::vector<SearchResult> parallel = searchK(4);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        EXPECT_EQ(results[i].setting, parallel[i].setting);
+        EXPECT_EQ(results[i].score, parallel[i].score);
+    }
+}
@@ -0,0 +1,242 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "simd.h"
+#include "matrix.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#if defined(__GNUC__) && defined(__x86_64__)
+# define SIMD_X86_64
+# include <immintrin.h>
+#endif // __GNUC__ && __x86_64__
+
+namespace
+{
+	// The plain versions, for elements begin to n - 1. (The vector
+	// versions use these for the elements left over at the end.)
+
+	void accumulateScalar(const double* row, size_t begin, size_t n, double* sums, size_t* counts, double* mins, double* maxs)
+	{
+		for(size_t i = begin; i < n; i++)
+		{
+			double val = row[i];
+			if(val != UNKNOWN_VALUE)
+			{
+				sums[i] += val;
+				counts[i]++;
+				mins[i] = std::min(mins[i], val);
+				maxs[i] = std::max(maxs[i], val);
+			}
+		}
+	}
+
+	void shiftScaleScalar(const double* in, double* out, const double* shift, const double* scale, size_t begin, size_t n)
+	{
+		for(size_t i = begin; i < n; i++)
+			out[i] = in[i] == UNKNOWN_VALUE ? in[i] : (in[i] - shift[i]) / scale[i];
+	}
+
+	void fillScalar(double* p, size_t begin, size_t n, double val)
+	{
+		for(size_t i = begin; i < n; i++)
+			p[i] = val;
+	}
+
+	void accumulatePlain(const double* row, size_t n, double* sums, size_t* counts, double* mins, double* maxs)
+	{
+		accumulateScalar(row, 0, n, sums, counts, mins, maxs);
+	}
+
+	void shiftScalePlain(const double* in, double* out, const double* shift, const double* scale, size_t n)
+	{
+		shiftScaleScalar(in, out, shift, scale, 0, n);
+	}
+
+	void fillPlain(double* p, size_t n, double val)
+	{
+		fillScalar(p, 0, n, val);
+	}
+
+#ifdef SIMD_X86_64
+	// SSE2 is part of every x86-64 processor, so these need no special flags.
+	// (std::min(m, val) is val < m ? val : m, which is what minpd does with
+	// its operands in this order, NaN included. Likewise for max.)
+
+	inline __m128d select(__m128d mask, __m128d a, __m128d b) // a where mask is set, b elsewhere
+	{
+		return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+	}
+
+	void accumulateSse2(const double* row, size_t n, double* sums, size_t* counts, double* mins, double* maxs)
+	{
+		const __m128d unknown = _mm_set1_pd(UNKNOWN_VALUE);
+		size_t i = 0;
+		for( ; i + 2 <= n; i += 2)
+		{
+			__m128d x = _mm_loadu_pd(row + i);
+			__m128d known = _mm_cmpneq_pd(x, unknown); // (true for NaN, like !=)
+			_mm_storeu_pd(sums + i, _mm_add_pd(_mm_loadu_pd(sums + i), _mm_and_pd(x, known)));
+			__m128i c = _mm_loadu_si128((const __m128i*)(counts + i));
+			_mm_storeu_si128((__m128i*)(counts + i), _mm_sub_epi64(c, _mm_castpd_si128(known)));
+			__m128d lo = _mm_loadu_pd(mins + i);
+			_mm_storeu_pd(mins + i, select(known, _mm_min_pd(x, lo), lo));
+			__m128d hi = _mm_loadu_pd(maxs + i);
+			_mm_storeu_pd(maxs + i, select(known, _mm_max_pd(x, hi), hi));
+		}
+		accumulateScalar(row, i, n, sums, counts, mins, maxs);
+	}
+
+	void shiftScaleSse2(const double* in, double* out, const double* shift, const double* scale, size_t n)
+	{
+		const __m128d unknown = _mm_set1_pd(UNKNOWN_VALUE);
+		const __m128d one = _mm_set1_pd(1.0);
+		size_t i = 0;
+		for( ; i + 2 <= n; i += 2)
+		{
+			// (Unknown lanes divide shift - shift by 1 instead, so they cannot
+			// overflow or trip a floating point trap.)
+			__m128d x = _mm_loadu_pd(in + i);
+			__m128d known = _mm_cmpneq_pd(x, unknown);
+			__m128d s = _mm_loadu_pd(shift + i);
+			__m128d y = _mm_div_pd(_mm_sub_pd(select(known, x, s), s), select(known, _mm_loadu_pd(scale + i), one));
+			_mm_storeu_pd(out + i, select(known, y, x));
+		}
+		shiftScaleScalar(in, out, shift, scale, i, n);
+	}
+
+	void fillSse2(double* p, size_t n, double val)
+	{
+		const __m128d v = _mm_set1_pd(val);
+		size_t i = 0;
+		for( ; i + 2 <= n; i += 2)
+			_mm_storeu_pd(p + i, v);
+		fillScalar(p, i, n, val);
+	}
+
+	__attribute__((target("avx2")))
+	void accumulateAvx2(const double* row, size_t n, double* sums, size_t* counts, double* mins, double* maxs)
+	{
+		const __m256d unknown = _mm256_set1_pd(UNKNOWN_VALUE);
+		size_t i = 0;
+		for( ; i + 4 <= n; i += 4)
+		{
+			__m256d x = _mm256_loadu_pd(row + i);
+			__m256d known = _mm256_cmp_pd(x, unknown, _CMP_NEQ_UQ);
+			_mm256_storeu_pd(sums + i, _mm256_add_pd(_mm256_loadu_pd(sums + i), _mm256_and_pd(x, known)));
+			__m256i c = _mm256_loadu_si256((const __m256i*)(counts + i));
+			_mm256_storeu_si256((__m256i*)(counts + i), _mm256_sub_epi64(c, _mm256_castpd_si256(known)));
+			__m256d lo = _mm256_loadu_pd(mins + i);
+			_mm256_storeu_pd(mins + i, _mm256_blendv_pd(lo, _mm256_min_pd(x, lo), known));
+			__m256d hi = _mm256_loadu_pd(maxs + i);
+			_mm256_storeu_pd(maxs + i, _mm256_blendv_pd(hi, _mm256_max_pd(x, hi), known));
+		}
+		accumulateScalar(row, i, n, sums, counts, mins, maxs);
+	}
+
+	__attribute__((target("avx2")))
+	void shiftScaleAvx2(const double* in, double* out, const double* shift, const double* scale, size_t n)
+	{
+		const __m256d unknown = _mm256_set1_pd(UNKNOWN_VALUE);
+		const __m256d one = _mm256_set1_pd(1.0);
+		size_t i = 0;
+		for( ; i + 4 <= n; i += 4)
+		{
+			__m256d x = _mm256_loadu_pd(in + i);
+			__m256d known = _mm256_cmp_pd(x, unknown, _CMP_NEQ_UQ);
+			__m256d s = _mm256_loadu_pd(shift + i);
+			__m256d y = _mm256_div_pd(_mm256_sub_pd(_mm256_blendv_pd(s, x, known), s), _mm256_blendv_pd(one, _mm256_loadu_pd(scale + i), known));
+			_mm256_storeu_pd(out + i, _mm256_blendv_pd(x, y, known));
+		}
+		shiftScaleScalar(in, out, shift, scale, i, n);
+	}
+
+	__attribute__((target("avx2")))
+	void fillAvx2(double* p, size_t n, double val)
+	{
+		const __m256d v = _mm256_set1_pd(val);
+		size_t i = 0;
+		for( ; i + 4 <= n; i += 4)
+			_mm256_storeu_pd(p + i, v);
+		fillScalar(p, i, n, val);
+	}
+#endif // SIMD_X86_64
+
+	// One version of all the kernels
+	struct Kernels
+	{
+		const char* name;
+		void (*accumulate)(const double*, size_t, double*, size_t*, double*, double*);
+		void (*shiftScale)(const double*, double*, const double*, const double*, size_t);
+		void (*fill)(double*, size_t, double);
+	};
+
+	const Kernels g_versions[] =
+	{
+#ifdef SIMD_X86_64
+		{ "avx2", accumulateAvx2, shiftScaleAvx2, fillAvx2 },
+		{ "sse2", accumulateSse2, shiftScaleSse2, fillSse2 },
+#endif // SIMD_X86_64
+		{ "scalar", accumulatePlain, shiftScalePlain, fillPlain },
+	};
+
+	std::atomic<const Kernels*> g_pKernels(NULL);
+
+	bool supported(const Kernels& k)
+	{
+#ifdef SIMD_X86_64
+		if(strcmp(k.name, "avx2") == 0)
+			return __builtin_cpu_supports("avx2");
+#endif // SIMD_X86_64
+		return true;
+	}
+
+	const Kernels& kernels()
+	{
+		const Kernels* pKernels = g_pKernels.load(std::memory_order_relaxed);
+		if(!pKernels)
+		{
+			// Take the first version that works here
+			pKernels = g_versions;
+			while(!supported(*pKernels))
+				pKernels++;
+			g_pKernels = pKernels;
+		}
+		return *pKernels;
+	}
+}
+
+void simdAccumulate(const double* row, size_t n, double* sums, size_t* counts, double* mins, double* maxs)
+{
+	kernels().accumulate(row, n, sums, counts, mins, maxs);
+}
+
+void simdShiftScale(const double* in, double* out, const double* shift, const double* scale, size_t n)
+{
+	kernels().shiftScale(in, out, shift, scale, n);
+}
+
+void simdFill(double* p, size_t n, double val)
+{
+	kernels().fill(p, n, val);
+}
+
+const char* simdKernels()
+{
+	return kernels().name;
+}
+
+bool setSimdKernels(const char* name)
+{
+	for(size_t i = 0; i < sizeof(g_versions) / sizeof(g_versions[0]); i++)
+	{
+		if(strcmp(g_versions[i].name, name) == 0 && supported(g_versions[i]))
+		{
+			g_pKernels = &g_versions[i];
+			return true;
+		}
+	}
+	return false;
+}
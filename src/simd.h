@@ -0,0 +1,39 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+
+// Kernels for the element-wise loops over rows of doubles that dominate
+// whole-matrix operations. Each has a version for AVX2, one for SSE2 and
+// a plain one. The fastest version that the processor supports is chosen
+// the first time any of them is called. Every version computes each
+// element in the same way and in the same order, so they all give exactly
+// the same results.
+
+// For each i from 0 to n - 1 where row[i] is not UNKNOWN_VALUE, adds
+// row[i] to sums[i], adds one to counts[i], and updates mins[i] and
+// maxs[i]. (Calling this for every row of a matrix gives the statistics
+// of all of its columns in one pass over the elements.)
+void simdAccumulate(const double* row, size_t n, double* sums, size_t* counts, double* mins, double* maxs);
+
+// Sets out[i] to (in[i] - shift[i]) / scale[i] for each i from 0 to n - 1,
+// except that elements that are UNKNOWN_VALUE are copied as they are.
+// (in and out may be the same.)
+void simdShiftScale(const double* in, double* out, const double* shift, const double* scale, size_t n);
+
+// Sets the n elements at p to val
+void simdFill(double* p, size_t n, double val);
+
+// Returns the name of the version in use: "avx2", "sse2" or "scalar"
+const char* simdKernels();
+
+// Switches to the named version. Returns false (and changes nothing) if
+// there is no such version or the processor does not support it.
+bool setSimdKernels(const char* name);
+
+#endif // SIMD_H
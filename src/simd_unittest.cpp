@@ -0,0 +1,170 @@
+#include "simd.h"
+#include "matrix.h"
+#include "rand.h"
+#include <cmath>
+#ifdef __linux__
+# include <fenv.h>
+#endif // __linux__
+#include <string>
+#include <vector>
+#include "tests/include/gtest/gtest.h"
+
+using std::vector;
+
+namespace
+{
+    const char* g_names[] = { "avx2", "sse2", "scalar" };
+
+    // Makes rows x cols values with some UNKNOWN_VALUE and NaN elements
+    vector<double> makeRows(size_t rows, size_t cols)
+    {
+        Rand r(1234);
+        vector<double> v(rows * cols);
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            size_t k = r.next(13);
+            v[i] = k == 0 ? UNKNOWN_VALUE : k == 1 ? std::nan("") : r.normal() * 100.0;
+        }
+        return v;
+    }
+
+    // Formats doubles bit for bit
+    std::string bits(const vector<double>& v)
+    {
+        return std::string((const char*)v.data(), v.size() * sizeof(double));
+    }
+}
+
+TEST(SimdTest, versionsAgree)
+{
+    std::string original = simdKernels();
+    size_t cols = 11; // (not a multiple of the vector width, so the tails are used too)
+    vector<double> data = makeRows(50, cols);
+    vector<double> shift(cols), scale(cols);
+    for (size_t j = 0; j < cols; ++j)
+    {
+        shift[j] = j * 0.5;
+        scale[j] = j + 1.0;
+    }
+
+    std::string firstSums, firstMins, firstMaxs, firstScaled;
+    vector<size_t> firstCounts;
+    bool first = true;
+    for (const char* name : g_names)
+    {
+        if (!setSimdKernels(name))
+            continue;
+        EXPECT_EQ(std::string(name), simdKernels());
+        vector<double> sums(cols, 0.0), mins(cols, 1e300), maxs(cols, -1e300);
+        vector<size_t> counts(cols, 0);
+        for (size_t i = 0; i < 50; ++i)
+            simdAccumulate(data.data() + i * cols, cols, sums.data(), counts.data(), mins.data(), maxs.data());
+        vector<double> scaled(data.size());
+        for (size_t i = 0; i < 50; ++i)
+            simdShiftScale(data.data() + i * cols, scaled.data() + i * cols, shift.data(), scale.data(), cols);
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            if (data[i] == UNKNOWN_VALUE)
+            {
+                EXPECT_EQ(UNKNOWN_VALUE, scaled[i]);
+            }
+        }
+        if (first)
+        {
+            firstSums = bits(sums);
+            firstMins = bits(mins);
+            firstMaxs = bits(maxs);
+            firstScaled = bits(scaled);
+            firstCounts = counts;
+            first = false;
+        }
+        else
+        {
+            EXPECT_EQ(firstSums, bits(sums)) << name;
+            EXPECT_EQ(firstMins, bits(mins)) << name;
+            EXPECT_EQ(firstMaxs, bits(maxs)) << name;
+            EXPECT_EQ(firstScaled, bits(scaled)) << name;
+            EXPECT_EQ(firstCounts, counts) << name;
+        }
+    }
+    EXPECT_FALSE(setSimdKernels("mmx"));
+    ASSERT_TRUE(setSimdKernels(original.c_str()));
+}
+
+TEST(SimdTest, unknownsDoNotTrap)
+{
+    // A scale below 1 would overflow UNKNOWN_VALUE, and a scale of 0 would
+    // divide by zero, so neither may be applied to unknown elements. (The
+    // last column is all unknown, with a scale of 0.)
+    std::string original = simdKernels();
+    size_t cols = 9;
+    vector<double> data(6 * cols);
+    vector<double> shift(cols), scale(cols);
+    for (size_t j = 0; j < cols; ++j)
+    {
+        shift[j] = j * 0.25;
+        scale[j] = j + 1 < cols ? 0.001 * (j + 1) : 0.0;
+    }
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (i % 3 == 0 || i % cols == cols - 1) ? UNKNOWN_VALUE : i * 0.5;
+#ifdef __linux__
+    feenableexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW);
+#endif // __linux__
+    for (const char* name : g_names)
+    {
+        if (!setSimdKernels(name))
+            continue;
+        vector<double> scaled(data.size());
+        for (size_t i = 0; i < 6; ++i)
+            simdShiftScale(data.data() + i * cols, scaled.data() + i * cols, shift.data(), scale.data(), cols);
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            if (data[i] == UNKNOWN_VALUE)
+            {
+                EXPECT_EQ(UNKNOWN_VALUE, scaled[i]) << name;
+            }
+            else
+            {
+                size_t j = i % cols;
+                EXPECT_EQ((data[i] - shift[j]) / scale[j], scaled[i]) << name;
+            }
+        }
+    }
+#ifdef __linux__
+    fedisableexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW);
+#endif // __linux__
+    ASSERT_TRUE(setSimdKernels(original.c_str()));
+}
+
+TEST(SimdTest, matrixMomentsMatchColumnStats)
+{
+    Matrix m;
+    m.setSize(37, 9);
+    vector<double> data = makeRows(37, 9);
+    for (size_t i = 0; i < 37; ++i)
+        for (size_t j = 0; j < 9; ++j)
+            m[i][j] = std::isnan(data[i * 9 + j]) ? UNKNOWN_VALUE : data[i * 9 + j];
+    for (size_t j = 0; j < 9; ++j)
+    {
+        double sum = 0.0, lo = 1e300, hi = -1e300;
+        size_t count = 0;
+        for (size_t i = 0; i < 37; ++i)
+        {
+            double val = m[i][j];
+            if (val == UNKNOWN_VALUE)
+                continue;
+            sum += val;
+            count++;
+            lo = std::min(lo, val);
+            hi = std::max(hi, val);
+        }
+        EXPECT_EQ(sum / count, m.columnMean(j));
+        EXPECT_EQ(lo, m.columnMin(j));
+        EXPECT_EQ(hi, m.columnMax(j));
+    }
+
+    // Filling the matrix changes its statistics
+    m.setAll(2.5);
+    EXPECT_EQ(2.5, m.columnMin(3));
+    EXPECT_EQ(2.5, m.columnMean(8));
+}
@@ -0,0 +1,218 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#include "spillstorage.h"
+#include "error.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef WIN32
+# include <process.h>
+# define getpid _getpid
+#else // WIN32
+# include <unistd.h>
+#endif // else WIN32
+
+using std::string;
+using std::vector;
+
+namespace
+{
+	// Returns the name of a new spill file
+	string spillFileName()
+	{
+		static std::atomic<unsigned long> count(0);
+		const char* dir = getenv("TMPDIR");
+		string name = dir && *dir ? dir : "/tmp";
+		name += "/mlspill." + to_str(getpid()) + "." + to_str(count++) + ".tmp";
+		return name;
+	}
+}
+
+SpillStorage::SpillStorage(size_t cols, size_t blockRows, size_t maxResident)
+: m_cols(cols), m_blockRows(blockRows > 0 ? blockRows : rowsPerBlock(cols, SPILL_BLOCK_BYTES)), m_maxResident(std::max((size_t)2, maxResident)), m_rows(0),
+m_filename(spillFileName()), m_pTail(new Block()), m_stop(false)
+{
+	m_file.open(m_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!m_file)
+		ThrowError("failed to make the spill file: ", m_filename);
+#ifndef WIN32
+	// (The file lives on until it is closed, and nothing is left behind
+	// even if the program is killed.)
+	remove(m_filename.c_str());
+#endif // WIN32
+}
+
+SpillStorage::~SpillStorage()
+{
+	if(m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+	m_file.close();
+#ifdef WIN32
+	remove(m_filename.c_str());
+#endif // WIN32
+}
+
+size_t SpillStorage::rowsPerBlock(size_t cols, size_t blockBytes)
+{
+	return std::max((size_t)1, blockBytes / (std::max((size_t)1, cols) * sizeof(double)));
+}
+
+void SpillStorage::append(const double* pRows, size_t rows)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	while(rows > 0)
+	{
+		// Fill the tail, without disturbing anyone who holds it
+		if(!m_pTail.unique())
+			m_pTail.reset(new Block(*m_pTail));
+		vector<double>& tail = m_pTail->elements;
+		size_t n = std::min(rows, m_blockRows - tail.size() / m_cols);
+		tail.insert(tail.end(), pRows, pRows + n * m_cols);
+		pRows += n * m_cols;
+		rows -= n;
+		m_rows += n;
+
+		// Write a full block to the file
+		if(tail.size() == m_blockRows * m_cols)
+		{
+			size_t index = m_rows / m_blockRows - 1;
+			{
+				std::lock_guard<std::mutex> fileLock(m_fileMutex);
+				m_file.seekp((std::streamoff)index * m_blockRows * m_cols * sizeof(double));
+				m_file.write((const char*)tail.data(), tail.size() * sizeof(double));
+				if(!m_file)
+					ThrowError("failed to write the spill file: ", m_filename);
+			}
+			keepResident(index, m_pTail);
+			m_pTail.reset(new Block());
+		}
+	}
+}
+
+SpillStorage::BlockPtr SpillStorage::block(size_t index)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if(index >= m_rows / m_blockRows)
+	{
+		if(index >= blockCount())
+			ThrowError("The block is out of range");
+		return m_pTail;
+	}
+
+	// Use the block if it is in memory (or about to be)
+	while(true)
+	{
+		auto pos = m_residentPos.find(index);
+		if(pos != m_residentPos.end())
+		{
+			m_resident.splice(m_resident.begin(), m_resident, pos->second);
+			return pos->second->second;
+		}
+		if(m_loading.count(index) == 0)
+			break;
+		m_cond.wait(lock);
+	}
+
+	// Read it
+	m_loading.insert(index);
+	lock.unlock();
+	BlockPtr pBlock;
+	try
+	{
+		pBlock = readBlock(index);
+	}
+	catch(...)
+	{
+		lock.lock();
+		m_loading.erase(index);
+		m_cond.notify_all();
+		throw;
+	}
+	lock.lock();
+	m_loading.erase(index);
+	keepResident(index, pBlock);
+	m_cond.notify_all();
+	return pBlock;
+}
+
+void SpillStorage::readAhead(size_t index)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(index >= m_rows / m_blockRows || m_residentPos.count(index) > 0 || m_loading.count(index) > 0)
+		return;
+	if(std::find(m_wanted.begin(), m_wanted.end(), index) != m_wanted.end())
+		return;
+	m_wanted.push_back(index);
+	if(!m_thread.joinable())
+		m_thread = std::thread([this]() { readAheadLoop(); });
+	m_cond.notify_all();
+}
+
+SpillStorage::BlockPtr SpillStorage::readBlock(size_t index)
+{
+	boost::shared_ptr<Block> pBlock(new Block());
+	pBlock->elements.resize(m_blockRows * m_cols);
+	std::lock_guard<std::mutex> fileLock(m_fileMutex);
+	m_file.seekg((std::streamoff)index * m_blockRows * m_cols * sizeof(double));
+	m_file.read((char*)pBlock->elements.data(), pBlock->elements.size() * sizeof(double));
+	if(!m_file)
+	{
+		m_file.clear();
+		ThrowError("failed to read the spill file: ", m_filename);
+	}
+	return pBlock;
+}
+
+void SpillStorage::keepResident(size_t index, BlockPtr pBlock)
+{
+	m_resident.push_front(std::make_pair(index, pBlock));
+	m_residentPos[index] = m_resident.begin();
+	while(m_resident.size() > m_maxResident)
+	{
+		m_residentPos.erase(m_resident.back().first);
+		m_resident.pop_back();
+	}
+}
+
+void SpillStorage::readAheadLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while(true)
+	{
+		m_cond.wait(lock, [this]() { return !m_wanted.empty() || m_stop; });
+		if(m_stop)
+			break;
+		size_t index = m_wanted.front();
+		m_wanted.pop_front();
+		if(m_residentPos.count(index) > 0 || m_loading.count(index) > 0)
+			continue;
+		m_loading.insert(index);
+		lock.unlock();
+		BlockPtr pBlock;
+		try
+		{
+			pBlock = readBlock(index);
+		}
+		catch(...)
+		{
+			// (The reader will find the problem when it asks for the block)
+		}
+		lock.lock();
+		m_loading.erase(index);
+		if(pBlock)
+			keepResident(index, pBlock);
+		m_cond.notify_all();
+	}
+}
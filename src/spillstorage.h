@@ -0,0 +1,126 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef SPILLSTORAGE_H
+#define SPILLSTORAGE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+// The size of a block of rows in a spill file, unless it is given
+#define SPILL_BLOCK_BYTES (8 * 1024 * 1024)
+
+// The number of blocks of a spill file kept in memory, unless it is given
+#define SPILL_RESIDENT_BLOCKS 16
+
+// Holds the elements of a matrix that is too big for memory in a
+// temporary "spill" file, in blocks of a fixed number of rows. Only the
+// blocks that were used most recently are kept in memory (up to a fixed
+// number of them), and a block that is not is read from the file when it
+// is asked for. A reader that goes through the blocks in order can ask
+// for the next block to be read ahead, by another thread, while it works
+// on the current one. (Like MatrixStorage, this is shared with views.)
+//
+// Rows are added to the end, and cannot be changed once they are added.
+// The file is made in the directory named by the TMPDIR environment
+// variable (or /tmp), and is removed when the storage is destroyed.
+class SpillStorage
+{
+public:
+	// The elements of one block of rows, in row-major order
+	struct Block
+	{
+		std::vector<double> elements;
+	};
+
+	typedef boost::shared_ptr<const Block> BlockPtr;
+
+private:
+	size_t m_cols;
+	size_t m_blockRows; // the number of rows in each block (except perhaps the last)
+	size_t m_maxResident; // the number of blocks that may be kept in memory
+	size_t m_rows;
+	std::string m_filename;
+
+	std::mutex m_fileMutex; // held while the file is read or written
+	std::fstream m_file;
+
+	// Guarded by m_mutex
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	boost::shared_ptr<Block> m_pTail; // the rows after the last full block, which are not in the file
+	std::list< std::pair<size_t, BlockPtr> > m_resident; // the blocks in memory, most recently used first
+	std::unordered_map<size_t, std::list< std::pair<size_t, BlockPtr> >::iterator> m_residentPos; // where each block is in m_resident
+	std::set<size_t> m_loading; // the blocks that are being read
+	std::deque<size_t> m_wanted; // the blocks that should be read ahead, in order
+	bool m_stop; // true when the read-ahead thread should finish
+	std::thread m_thread; // reads blocks ahead (started when it is first needed)
+
+public:
+	// Makes empty storage for rows of cols elements, in blocks of blockRows
+	// rows (or of about SPILL_BLOCK_BYTES, if blockRows is 0), of which up
+	// to maxResident are kept in memory (at least 2)
+	SpillStorage(size_t cols, size_t blockRows = 0, size_t maxResident = SPILL_RESIDENT_BLOCKS);
+	~SpillStorage();
+
+	// Returns the number of elements in each row
+	size_t cols() const { return m_cols; }
+
+	// Returns the number of rows
+	size_t rows() const { return m_rows; }
+
+	// Returns the number of rows in each block
+	size_t blockRows() const { return m_blockRows; }
+
+	// Returns the number of blocks
+	size_t blockCount() const { return (m_rows + m_blockRows - 1) / m_blockRows; }
+
+	// Adds rows, given as consecutive rows of cols() elements. Each block
+	// is written to the file as soon as it is full.
+	void append(const double* pRows, size_t rows);
+
+	// Returns the specified block, reading it from the file if it is not in
+	// memory. (The block stays valid for as long as it is held, even if it
+	// is no longer kept in memory.)
+	BlockPtr block(size_t index);
+
+	// Asks for the specified block to be read by another thread, so that it
+	// is in memory by the time it is asked for
+	void readAhead(size_t index);
+
+	// Returns the specified element
+	double get(size_t row, size_t col) { return block(row / m_blockRows)->elements[(row % m_blockRows) * m_cols + col]; }
+
+	// Returns the number of rows in a block with the elements of blockBytes
+	// bytes of rows of cols elements (at least 1)
+	static size_t rowsPerBlock(size_t cols, size_t blockBytes);
+
+private:
+	// Reads a full block from the file
+	BlockPtr readBlock(size_t index);
+
+	// Notes that a block is in memory, and forgets the least recently used
+	// blocks beyond the limit. (The caller holds m_mutex.)
+	void keepResident(size_t index, BlockPtr pBlock);
+
+	// Reads the blocks in m_wanted (run by m_thread)
+	void readAheadLoop();
+
+	// Not copyable
+	SpillStorage(const SpillStorage&);
+	SpillStorage& operator=(const SpillStorage&);
+};
+
+#endif // SPILLSTORAGE_H
@@ -0,0 +1,58 @@
+// ----------------------------------------------------------------
+// The contents of this file are distributed under the CC0 license.
+// See http://creativecommons.org/publicdomain/zero/1.0/
+// ----------------------------------------------------------------
+
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Small helpers for the parsers of text datasets (ARFF, CSV and LibSVM),
+// which tokenize their input in place rather than making strings of it.
+
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+inline const char* skipSpace(const char* p, const char* end)
+{
+	while(p != end && isSpace(*p))
+		p++;
+	return p;
+}
+
+inline const char* trimSpace(const char* begin, const char* end)
+{
+	while(end != begin && isSpace(end[-1]))
+		end--;
+	return end;
+}
+
+// Returns the end of the line that starts at p
+inline const char* endOfLine(const char* p, const char* end)
+{
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	return eol ? eol : end;
+}
+
+// Parses the whole of [begin, end) as a number. Returns false if it is not one.
+inline bool parseNumber(const char* begin, const char* end, double& value)
+{
+	const char* p = begin;
+	if(p != end && *p == '+')
+		p++;
+	std::from_chars_result res = std::from_chars(p, end, value);
+	if(res.ec == std::errc::result_out_of_range)
+	{
+		value = strtod(std::string(begin, end).c_str(), NULL); // let strtod round it to 0 or HUGE_VAL
+		return true;
+	}
+	return res.ec == std::errc() && res.ptr == end;
+}
+
+#endif // TEXTSCAN_H